@@ -0,0 +1,41 @@
+#include "BuzzerSequencer.h"
+
+// One beep a second when someone has just stepped too close, speeding up to
+// four a second, then a steady tone when they are very close.
+const BuzzerSequencer::Pattern BuzzerSequencer::patterns_[BUZZER_LEVELS] = {
+    {0, 0}, {1000, 10}, {500, 30}, {250, 50}, {250, 100}};
+
+BuzzerSequencer::BuzzerSequencer(PwmOut &pwm) : pwm_(pwm) {
+  level_ = 0;
+  changes_ = 0;
+  pwm_.suspend();
+}
+
+bool BuzzerSequencer::post(int level) {
+  if (level < 0) {
+    level = 0;
+  } else if (level >= BUZZER_LEVELS) {
+    level = BUZZER_LEVELS - 1;
+  }
+  if (level == level_) {
+    return false;
+  }
+
+  if (level == 0) {
+    // Releasing the pin keeps the buzzer quiet.
+    pwm_.suspend();
+  } else {
+    if (level_ == 0) {
+      pwm_.resume();
+    }
+
+    // The buzzer sounds while the output is low, the rest of each period.
+    const Pattern &pattern = patterns_[level];
+    pwm_.period_ms(pattern.periodMs);
+    pwm_.write((100 - pattern.onPercent) / 100.0f);
+  }
+
+  level_ = level;
+  changes_++;
+  return true;
+}
@@ -0,0 +1,66 @@
+/**
+ * Beep patterns for the alarm buzzer, timed by the PWM hardware.
+ *
+ * The buzzer module sounds while its input is low and is quiet while the pin
+ * is released, so a PWM with a period of a fraction of a second makes it
+ * beep once per period, for the low part of it, with no interrupt and no
+ * CPU time per beep. Each alarm level is one period and duty cycle from a
+ * table, from slow short beeps to a steady tone.
+ *
+ * The caller posts the level it wants as often as it likes. Only a change
+ * of level reprograms the PWM, which restarts the pattern, so posting the
+ * same level every pass of a loop costs a comparison.
+ */
+
+#ifndef BUZZER_SEQUENCER_H
+#define BUZZER_SEQUENCER_H
+
+#include "mbed.h"
+
+// Number of levels, 0 (quiet) included.
+#define BUZZER_LEVELS 5
+
+class BuzzerSequencer {
+public:
+  /**
+   * Constructor. The buzzer starts quiet.
+   *
+   * @param pwm The PWM output driving the buzzer.
+   */
+  BuzzerSequencer(PwmOut &pwm);
+
+  /**
+   * Play the pattern of a level, unless it is already playing.
+   *
+   * @param level 0 for quiet, up to BUZZER_LEVELS - 1 for a steady tone.
+   *              Levels out of range are clamped.
+   * @return true if the level changed.
+   */
+  bool post(int level);
+
+  /**
+   * @return The level playing.
+   */
+  int level() const { return level_; }
+
+  /**
+   * @return Number of times the PWM was reprogrammed.
+   */
+  unsigned int changes() const { return changes_; }
+
+private:
+  struct Pattern {
+    // Period of the pattern in milliseconds.
+    int periodMs;
+    // Part of the period the buzzer sounds, in percent.
+    int onPercent;
+  };
+
+  static const Pattern patterns_[BUZZER_LEVELS];
+
+  PwmOut &pwm_;
+  int level_;
+  unsigned int changes_;
+};
+
+#endif /* BUZZER_SEQUENCER_H */
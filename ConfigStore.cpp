@@ -0,0 +1,164 @@
+#include "ConfigStore.h"
+#include <stddef.h>
+#include <string.h>
+
+ConfigStore::ConfigStore(mbed::BlockDevice &device) : device_(device) {
+  ready_ = false;
+  sectorSize_ = 0;
+  slotsPerSector_ = 0;
+  slots_ = 0;
+  next_ = 0;
+  seq_ = 0;
+  haveLast_ = false;
+  saves_ = 0;
+}
+
+bool ConfigStore::load(Settings &settings) {
+  static_assert(sizeof(Record) == CONFIG_RECORD_SIZE, "record size changed");
+
+  if (device_.init() != mbed::BD_ERROR_OK) {
+    return false;
+  }
+
+  // The records must tile the sectors, and there must be a sector to fall
+  // back on while another is erased.
+  sectorSize_ = device_.get_erase_size();
+  if (sectorSize_ == 0 || sectorSize_ % CONFIG_RECORD_SIZE != 0 ||
+      CONFIG_RECORD_SIZE % device_.get_program_size() != 0 ||
+      CONFIG_RECORD_SIZE % device_.get_read_size() != 0) {
+    return false;
+  }
+  slotsPerSector_ = sectorSize_ / CONFIG_RECORD_SIZE;
+  unsigned int sectors = device_.size() / sectorSize_;
+  if (sectors < 2) {
+    return false;
+  }
+  slots_ = sectors * slotsPerSector_;
+  ready_ = true;
+
+  // The sector written last is the one whose first record is newest.
+  Record record;
+  bool found = false;
+  unsigned int newest = 0;
+  uint32_t newestSeq = 0;
+  for (unsigned int sector = 0; sector < sectors; sector++) {
+    if (read(sector * slotsPerSector_, record) && valid(record) &&
+        (!found || (int32_t)(record.seq - newestSeq) > 0)) {
+      found = true;
+      newest = sector;
+      newestSeq = record.seq;
+    }
+  }
+  if (!found) {
+    // Nothing saved yet, or only a record cut short; start from the top.
+    next_ = 0;
+    seq_ = 0;
+    return false;
+  }
+
+  // Records are written in order, so the sector is written up to some slot
+  // and erased after it. Find that slot.
+  unsigned int first = newest * slotsPerSector_;
+  unsigned int low = 1;
+  unsigned int high = slotsPerSector_;
+  while (low < high) {
+    unsigned int middle = (low + high) / 2;
+    if (written(first + middle)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  next_ = (first + low) % slots_;
+
+  // The last record may have been cut short by a reset; use the newest one
+  // that is whole. The sector's first record is, so this stops there.
+  for (unsigned int slot = first + low; slot-- > first;) {
+    if (read(slot, record) && valid(record)) {
+      settings = record.settings;
+      last_ = record.settings;
+      haveLast_ = true;
+      seq_ = record.seq + 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ConfigStore::save(const Settings &settings) {
+  if (!ready_) {
+    return false;
+  }
+  if (haveLast_ && memcmp(&settings, &last_, sizeof(Settings)) == 0) {
+    return true;
+  }
+
+  Record record;
+  memset(&record, 0, sizeof(record));
+  record.magic = CONFIG_MAGIC;
+  record.seq = seq_;
+  record.settings = settings;
+  record.crc = crc32(&record, offsetof(Record, crc));
+
+  // Going into a sector erases its oldest records. The sector before keeps
+  // the newest ones until this record is programmed.
+  if (next_ % slotsPerSector_ == 0 &&
+      device_.erase((mbed::bd_addr_t)next_ * CONFIG_RECORD_SIZE,
+                    sectorSize_) != mbed::BD_ERROR_OK) {
+    return false;
+  }
+  if (device_.program(&record, (mbed::bd_addr_t)next_ * CONFIG_RECORD_SIZE,
+                      CONFIG_RECORD_SIZE) != mbed::BD_ERROR_OK) {
+    return false;
+  }
+
+  next_ = (next_ + 1) % slots_;
+  seq_++;
+  last_ = settings;
+  haveLast_ = true;
+  saves_++;
+  return true;
+}
+
+unsigned int ConfigStore::saves() { return saves_; }
+
+bool ConfigStore::read(unsigned int slot, Record &record) {
+  return device_.read(&record, (mbed::bd_addr_t)slot * CONFIG_RECORD_SIZE,
+                      CONFIG_RECORD_SIZE) == mbed::BD_ERROR_OK;
+}
+
+// Whether anything was programmed in the slot since it was erased.
+bool ConfigStore::written(unsigned int slot) {
+  Record record;
+  if (!read(slot, record)) {
+    // Treat it as written, so the search does not stop short of it.
+    return true;
+  }
+  int erased = device_.get_erase_value();
+  uint32_t blank = (erased < 0 ? 0xFF : erased) * 0x01010101u;
+  return record.magic != blank;
+}
+
+bool ConfigStore::valid(const Record &record) {
+  return record.magic == CONFIG_MAGIC &&
+         record.crc == crc32(&record, offsetof(Record, crc));
+}
+
+/**
+ * CRC-32 (the zip and Ethernet one, reflected polynomial 0xEDB88320), four
+ * bits at a time from a 16 entry table.
+ */
+uint32_t ConfigStore::crc32(const void *data, int length) {
+  static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+      0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+      0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint32_t crc = 0xFFFFFFFF;
+  for (int i = 0; i < length; i++) {
+    crc = (crc >> 4) ^ table[(crc ^ bytes[i]) & 0x0F];
+    crc = (crc >> 4) ^ table[(crc ^ (bytes[i] >> 4)) & 0x0F];
+  }
+  return ~crc;
+}
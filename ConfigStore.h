@@ -0,0 +1,110 @@
+/**
+ * Wear-leveled storage of the settings in flash.
+ *
+ * Every save appends a fixed-size record, with a sequence number and a
+ * CRC-32, after the previous one. The records fill the block device's
+ * sectors in turn, and a sector is only erased when the records come round
+ * to it again, so each sector is erased once per (sectors x records per
+ * sector) saves. The sector before the one being written always holds older
+ * records, so losing power in the middle of a save or an erase never loses
+ * more than that save.
+ *
+ * load() finds the newest record without reading them all: the first record
+ * of each sector says which sector was written last, and a binary search
+ * over that sector finds where writing stopped. From there it goes back to
+ * the first record whose CRC checks out. On the internal flash this takes a
+ * few microseconds.
+ */
+
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include "BlockDevice.h"
+#include <stdint.h>
+
+// Marks a record of this layout.
+#define CONFIG_MAGIC 0x53445331
+
+// Bytes one record takes, including padding to the program size.
+#define CONFIG_RECORD_SIZE 32
+
+/**
+ * The settings kept across resets. There are no sampling parameters among
+ * them: SonarArray picks the ping rate from what the sensors see, so nothing
+ * about it is set by the operator. The record's reserved words are left for
+ * settings that are.
+ */
+struct Settings {
+  // Alarm threshold in centimeters.
+  int32_t minDistance;
+
+  // Air temperature in tenths of a degree Celsius.
+  int32_t temperature;
+
+  // TimeOfFlight calibration correction, Q16.
+  uint32_t correction;
+};
+
+class ConfigStore {
+public:
+  /**
+   * Constructor
+   *
+   * @param device Storage for the records, at least two erase sectors.
+   */
+  ConfigStore(mbed::BlockDevice &device);
+
+  /**
+   * Initialize the device and read back the newest settings.
+   *
+   * @param settings Set to the saved settings if there are any.
+   * @return false if nothing valid was saved, leaving settings unchanged.
+   */
+  bool load(Settings &settings);
+
+  /**
+   * Append settings unless they are the same as the newest record. May erase
+   * a sector first, which blocks for tens of milliseconds.
+   *
+   * @return false if the device failed.
+   */
+  bool save(const Settings &settings);
+
+  /**
+   * @return Number of records written since startup.
+   */
+  unsigned int saves();
+
+private:
+  struct Record {
+    uint32_t magic;
+    uint32_t seq;
+    Settings settings;
+    uint32_t reserved[2];
+    uint32_t crc;
+  };
+
+  bool read(unsigned int slot, Record &record);
+  bool written(unsigned int slot);
+  bool valid(const Record &record);
+  static uint32_t crc32(const void *data, int length);
+
+  mbed::BlockDevice &device_;
+  bool ready_;
+
+  unsigned int sectorSize_;
+  unsigned int slotsPerSector_;
+  unsigned int slots_;
+
+  // The slot the next record goes in, and the sequence number it gets.
+  unsigned int next_;
+  uint32_t seq_;
+
+  // The newest record, to skip saving the same settings again.
+  bool haveLast_;
+  Settings last_;
+
+  unsigned int saves_;
+};
+
+#endif /* CONFIG_STORE_H */
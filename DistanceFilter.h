@@ -0,0 +1,207 @@
+/**
+ * Fixed-size filters for the ultrasonic distance samples.
+ *
+ * Each filter is a stage with the same interface:
+ *
+ *   bool update(T &value);
+ *
+ * update() takes a sample, replaces it with the stage's output and returns
+ * true, or returns false to drop the sample. FilterChain joins two stages so
+ * that the second only sees what the first lets through, and chains nest, so
+ * any pipeline is built from FilterChain<A, FilterChain<B, C> > and so on.
+ *
+ * Every size is a template argument and all state lives inside the objects,
+ * so nothing is allocated and update() takes the same time for every sample.
+ * The stages are small enough to run in interrupt context.
+ */
+
+#ifndef DISTANCE_FILTER_H
+#define DISTANCE_FILTER_H
+
+/**
+ * The last N values pushed, oldest first.
+ */
+template <typename T, int N> class RingBuffer {
+public:
+  RingBuffer() : next_(0), size_(0) {}
+
+  /**
+   * Add a value, overwriting the oldest one when full.
+   *
+   * @return The overwritten value, or value itself while not full.
+   */
+  T push(T value) {
+    T old = size_ == N ? data_[next_] : value;
+    data_[next_] = value;
+    next_ = (next_ + 1) % N;
+    if (size_ < N) {
+      size_++;
+    }
+    return old;
+  }
+
+  /**
+   * @param i 0 for the oldest value, size() - 1 for the newest.
+   */
+  T operator[](int i) const { return data_[(next_ - size_ + i + N) % N]; }
+
+  int size() const { return size_; }
+  bool full() const { return size_ == N; }
+  void clear() { next_ = size_ = 0; }
+
+private:
+  T data_[N];
+  int next_;
+  int size_;
+};
+
+/**
+ * Drops samples outside [min, max], and single samples that jump more than
+ * maxStep from the last accepted one. A jump is accepted once it has been
+ * seen confirm times in a row, so real changes still get through.
+ */
+template <typename T> class SpikeGate {
+public:
+  SpikeGate(T min, T max, T maxStep, int confirm)
+      : min_(min), max_(max), maxStep_(maxStep), confirm_(confirm),
+        last_(0), seen_(0), primed_(false) {}
+
+  bool update(T &value) {
+    if (value < min_ || value > max_) {
+      return false;
+    }
+    T step = value > last_ ? value - last_ : last_ - value;
+    if (primed_ && step > maxStep_ && ++seen_ < confirm_) {
+      return false;
+    }
+    seen_ = 0;
+    last_ = value;
+    primed_ = true;
+    return true;
+  }
+
+  void reset() {
+    seen_ = 0;
+    primed_ = false;
+  }
+
+private:
+  T min_;
+  T max_;
+  T maxStep_;
+  int confirm_;
+  T last_;
+  int seen_;
+  bool primed_;
+};
+
+/**
+ * Median of the last N samples. The window is kept sorted, so each sample
+ * costs one removal and one insertion of at most N steps.
+ */
+template <typename T, int N> class SlidingMedian {
+public:
+  SlidingMedian() {}
+
+  bool update(T &value) {
+    int size = window_.size();
+
+    // Take the sample leaving the window out of the sorted copy.
+    if (window_.full()) {
+      T old = window_[0];
+      int i = 0;
+      while (sorted_[i] != old) {
+        i++;
+      }
+      for (; i < size - 1; i++) {
+        sorted_[i] = sorted_[i + 1];
+      }
+      size--;
+    }
+    window_.push(value);
+
+    // Insert the new sample in order.
+    int i = size;
+    while (i > 0 && sorted_[i - 1] > value) {
+      sorted_[i] = sorted_[i - 1];
+      i--;
+    }
+    sorted_[i] = value;
+    size++;
+
+    value = sorted_[size / 2];
+    return true;
+  }
+
+  void reset() { window_.clear(); }
+
+private:
+  RingBuffer<T, N> window_;
+  T sorted_[N];
+};
+
+/**
+ * Alpha-beta tracker, the steady state form of a constant velocity Kalman
+ * filter. The velocity is in units per sample, so no clock is needed.
+ *
+ * alpha sets how much of each residual goes into the position and beta how
+ * much into the velocity. Larger values follow faster, smaller values smooth
+ * more; 0 < alpha < 1 and 0 < beta < 2 * (2 - alpha) - 4 * sqrt(1 - alpha)
+ * keep it stable.
+ */
+template <typename T> class AlphaBeta {
+public:
+  AlphaBeta(T alpha, T beta)
+      : alpha_(alpha), beta_(beta), x_(0), v_(0), primed_(false) {}
+
+  bool update(T &value) {
+    if (!primed_) {
+      x_ = value;
+      v_ = 0;
+      primed_ = true;
+      return true;
+    }
+    x_ += v_;
+    T residual = value - x_;
+    x_ += alpha_ * residual;
+    v_ += beta_ * residual;
+    value = x_;
+    return true;
+  }
+
+  T position() const { return x_; }
+  T velocity() const { return v_; }
+  void reset() { primed_ = false; }
+
+private:
+  T alpha_;
+  T beta_;
+  T x_;
+  T v_;
+  bool primed_;
+};
+
+/**
+ * Two stages run one after the other. B only sees the samples A lets through.
+ */
+template <typename T, typename A, typename B> class FilterChain {
+public:
+  FilterChain(const A &first, const B &second)
+      : first_(first), second_(second) {}
+
+  bool update(T &value) { return first_.update(value) && second_.update(value); }
+
+  void reset() {
+    first_.reset();
+    second_.reset();
+  }
+
+  A &first() { return first_; }
+  B &second() { return second_; }
+
+private:
+  A first_;
+  B second_;
+};
+
+#endif /* DISTANCE_FILTER_H */
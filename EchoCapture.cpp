@@ -0,0 +1,93 @@
+#include "EchoCapture.h"
+#include "Trace.h"
+
+EchoCapture::EchoCapture(PinName trigger, PinName echo, int timeoutUs)
+    : trigger_(trigger), echo_(echo) {
+
+  timeoutUs_ = timeoutUs;
+  riseUs_ = 0;
+  risen_ = false;
+  result_ = ECHO_NO_TARGET;
+  armed_ = false;
+  ready_ = false;
+
+  trigger_ = 0;
+
+  echo_.rise(callback(this, &EchoCapture::echoRise));
+  echo_.fall(callback(this, &EchoCapture::echoFall));
+}
+
+bool EchoCapture::ping() {
+  // Only one measurement at a time, and the sensor will not retrigger while
+  // it is still holding the echo line high.
+  if (armed_ || echo_.read() == 1) {
+    return false;
+  }
+
+  risen_ = false;
+  armed_ = true;
+  timer_.start();
+
+  // Arm the timeout before the trigger so a lost echo is always caught.
+  timeout_.attach(callback(this, &EchoCapture::expire),
+                  std::chrono::microseconds(timeoutUs_));
+
+  trigger_.write(1);
+  wait_us(ECHO_TRIGGER_US);
+  trigger_.write(0);
+
+  return true;
+}
+
+bool EchoCapture::ready() { return ready_; }
+
+bool EchoCapture::busy() { return armed_; }
+
+int EchoCapture::read() {
+  ready_ = false;
+  return result_;
+}
+
+void EchoCapture::setTimeout(int timeoutUs) { timeoutUs_ = timeoutUs; }
+
+void EchoCapture::attach(Callback<void()> complete) { complete_ = complete; }
+
+//------------------Interrupt handlers--------------------------------------
+
+void EchoCapture::echoRise() {
+  if (armed_) {
+    riseUs_ = timer_.read_us();
+    risen_ = true;
+    Trace::point(TRACE_ECHO_RISE);
+  }
+}
+
+void EchoCapture::echoFall() {
+  // Ignore a fall that belongs to a measurement that already timed out.
+  if (armed_ && risen_) {
+    timeout_.detach();
+
+    // Unsigned subtraction keeps the width correct across a timer wrap.
+    int width = (int)((unsigned int)timer_.read_us() - riseUs_);
+    Trace::point(TRACE_ECHO_FALL, width);
+    finish(width);
+  }
+}
+
+void EchoCapture::expire() {
+  if (armed_) {
+    Trace::point(TRACE_ECHO_TIMEOUT);
+    finish(ECHO_NO_TARGET);
+  }
+}
+
+void EchoCapture::finish(int width) {
+  timer_.stop();
+  result_ = width;
+  armed_ = false;
+  ready_ = true;
+
+  if (complete_) {
+    complete_();
+  }
+}
@@ -0,0 +1,112 @@
+/**
+ * Interrupt driven echo capture for the HC-SR04 ultrasonic sensor.
+ *
+ * A measurement is started with ping(), which pulses the trigger pin and
+ * returns straight away. The rising and falling edges of the echo pin are
+ * timestamped in interrupt context, and a Timeout ends the measurement if no
+ * complete echo arrives within the configured window. The caller collects the
+ * pulse width later with ready()/read(), or gets told through the completion
+ * callback set with attach().
+ *
+ * The sensor holds the echo pin high for about 58 us per centimetre of range,
+ * so its 400 cm maximum range is a pulse of roughly 23.3 ms. The default
+ * timeout of 25 ms covers that plus the delay before the echo starts, so a
+ * measurement never takes longer than 25 ms, whether or not there is a target.
+ */
+
+#ifndef ECHO_CAPTURE_H
+#define ECHO_CAPTURE_H
+
+#include "mbed.h"
+
+// Default time in microseconds to wait for a complete echo after the trigger.
+#define ECHO_TIMEOUT_US 25000
+
+// Length of the trigger pulse in microseconds, the datasheet asks for >= 10us.
+#define ECHO_TRIGGER_US 10
+
+// Pulse width reported when no echo was received within the timeout.
+#define ECHO_NO_TARGET -1
+
+class EchoCapture {
+public:
+  /**
+   * Constructor
+   *
+   * @param trigger   Pin connected to the sensor's trigger input.
+   * @param echo      Pin connected to the sensor's echo output.
+   * @param timeoutUs Time in microseconds after the trigger before a
+   *                  measurement is reported as "no target".
+   */
+  EchoCapture(PinName trigger, PinName echo,
+              int timeoutUs = ECHO_TIMEOUT_US);
+
+  /**
+   * Start a measurement. Returns immediately; the result becomes available
+   * through ready()/read() once the echo has been captured or timed out.
+   *
+   * @return false if a measurement is still in progress or the echo line is
+   *         still high from a previous ping, true if the trigger was sent.
+   */
+  bool ping();
+
+  /**
+   * @return true if a measurement finished and has not been read yet.
+   */
+  bool ready();
+
+  /**
+   * @return true while a measurement is in progress.
+   */
+  bool busy();
+
+  /**
+   * Collect the result of the last measurement and clear ready().
+   *
+   * @return The echo pulse width in microseconds, or ECHO_NO_TARGET.
+   */
+  int read();
+
+  /**
+   * Set the time allowed for a complete echo. Takes effect on the next ping.
+   *
+   * @param timeoutUs Timeout in microseconds.
+   */
+  void setTimeout(int timeoutUs);
+
+  /**
+   * Attach a function to call when a measurement finishes. It is called in
+   * interrupt context, so it must not block.
+   *
+   * @param complete Function to call, or nullptr to remove it.
+   */
+  void attach(Callback<void()> complete);
+
+private:
+  void echoRise();
+  void echoFall();
+  void expire();
+  void finish(int width);
+
+  DigitalOut trigger_;
+  InterruptIn echo_;
+
+  // Timestamps the echo edges. It only runs while a measurement is in
+  // flight, as a running Timer keeps the core out of deep sleep.
+  Timer timer_;
+
+  // Ends the measurement if the echo does not complete in time.
+  Timeout timeout_;
+
+  Callback<void()> complete_;
+
+  int timeoutUs_;
+
+  volatile unsigned int riseUs_;
+  volatile bool risen_;
+  volatile int result_;
+  volatile bool armed_;
+  volatile bool ready_;
+};
+
+#endif /* ECHO_CAPTURE_H */
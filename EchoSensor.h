@@ -0,0 +1,21 @@
+/**
+ * Build time choice of the echo measurement backend.
+ *
+ * EchoSensor is EchoCapture, which timestamps the echo edges with pin
+ * interrupts, unless the echo-input-capture option in mbed_app.json is set,
+ * in which case it is EchoTimerCapture, which measures the echo with TIM2.
+ * Both have the same interface.
+ */
+
+#ifndef ECHO_SENSOR_H
+#define ECHO_SENSOR_H
+
+#if MBED_CONF_APP_ECHO_INPUT_CAPTURE
+#include "EchoTimerCapture.h"
+typedef EchoTimerCapture EchoSensor;
+#else
+#include "EchoCapture.h"
+typedef EchoCapture EchoSensor;
+#endif
+
+#endif /* ECHO_SENSOR_H */
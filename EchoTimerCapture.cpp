@@ -0,0 +1,160 @@
+#include "EchoTimerCapture.h"
+#include "Trace.h"
+
+EchoTimerCapture *EchoTimerCapture::instance_ = NULL;
+
+EchoTimerCapture::EchoTimerCapture(PinName trigger, PinName echo,
+                                   int timeoutUs)
+    : trigger_(trigger) {
+
+  MBED_ASSERT(instance_ == NULL);
+  MBED_ASSERT(echo == PA_0 || echo == PA_5 || echo == PA_15);
+  instance_ = this;
+
+  timeoutUs_ = timeoutUs;
+  result_ = ECHO_NO_TARGET;
+  armed_ = false;
+  ready_ = false;
+  echoHigh_ = false;
+
+  trigger_ = 0;
+
+  // Hand the echo pin over to TIM2: alternate function mode, AF1.
+  int pin = echo & 0xF;
+  RCC->AHB2ENR |= RCC_AHB2ENR_GPIOAEN;
+  GPIOA->MODER = (GPIOA->MODER & ~(0x3U << (pin * 2))) | (0x2U << (pin * 2));
+  GPIOA->AFR[pin >> 3] = (GPIOA->AFR[pin >> 3] & ~(0xFU << ((pin & 7) * 4))) |
+                         (ECHO_TIMER_AF << ((pin & 7) * 4));
+
+  // TIM2 runs at twice the APB1 clock unless APB1 is undivided.
+  uint32_t clock = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+    clock *= 2;
+  }
+  ticksPerUs_ = clock / 1000000;
+
+  RCC->APB1ENR1 |= RCC_APB1ENR1_TIM2EN;
+  TIM2->CR1 = 0;
+  TIM2->PSC = 0;
+  TIM2->ARR = 0xFFFFFFFF;
+
+  // PWM input mode: both capture channels watch TI1, channel 1 on the rising
+  // edge and channel 2 on the falling edge, and the rising edge resets the
+  // counter, so CCR2 ends up holding the pulse width.
+  TIM2->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_CC2S_1;
+  TIM2->CCER = TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC2P;
+  TIM2->SMCR = TIM_SMCR_TS_2 | TIM_SMCR_TS_0 | TIM_SMCR_SMS_2;
+
+  // Only the falling edge interrupts.
+  TIM2->DIER = TIM_DIER_CC2IE;
+  TIM2->EGR = TIM_EGR_UG;
+  TIM2->SR = 0;
+
+  NVIC_SetVector(TIM2_IRQn, (uintptr_t)&EchoTimerCapture::irq);
+  NVIC_EnableIRQ(TIM2_IRQn);
+
+  TIM2->CR1 = TIM_CR1_CEN;
+}
+
+bool EchoTimerCapture::ping() {
+  // Only one measurement at a time, and the sensor will not retrigger while
+  // it is still holding the echo line high.
+  if (armed_ || echoHigh_) {
+    return false;
+  }
+
+  // Forget edges from before this ping, so a rising edge seen at the fall
+  // belongs to this measurement.
+  TIM2->SR = ~(TIM_SR_CC1IF | TIM_SR_CC2IF);
+  armed_ = true;
+
+  // Arm the timeout before the trigger so a lost echo is always caught.
+  timeout_.attach(callback(this, &EchoTimerCapture::expire),
+                  std::chrono::microseconds(timeoutUs_));
+
+  trigger_.write(1);
+  wait_us(ECHO_TRIGGER_US);
+  trigger_.write(0);
+
+  return true;
+}
+
+bool EchoTimerCapture::ready() { return ready_; }
+
+bool EchoTimerCapture::busy() { return armed_; }
+
+int EchoTimerCapture::read() {
+  ready_ = false;
+  int ticks = result_;
+  if (ticks == ECHO_NO_TARGET) {
+    return ECHO_NO_TARGET;
+  }
+  return (ticks + ticksPerUs_ / 2) / ticksPerUs_;
+}
+
+int EchoTimerCapture::readNs() {
+  int ticks = result_;
+  if (ticks == ECHO_NO_TARGET) {
+    return ECHO_NO_TARGET;
+  }
+  return (int)(((uint64_t)ticks * 1000 + ticksPerUs_ / 2) / ticksPerUs_);
+}
+
+void EchoTimerCapture::setTimeout(int timeoutUs) { timeoutUs_ = timeoutUs; }
+
+void EchoTimerCapture::attach(Callback<void()> complete) {
+  complete_ = complete;
+}
+
+//------------------Interrupt handlers--------------------------------------
+
+void EchoTimerCapture::irq() {
+  uint32_t status = TIM2->SR;
+
+  // Reading CCR2 also clears CC2IF.
+  uint32_t ticks = TIM2->CCR2;
+  TIM2->SR = ~(TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC2OF);
+
+  if (status & TIM_SR_CC2IF) {
+    instance_->captured(status, ticks);
+  }
+}
+
+void EchoTimerCapture::captured(uint32_t status, uint32_t ticks) {
+  if (echoHigh_) {
+    echoHigh_ = false;
+    sleep_manager_unlock_deep_sleep();
+  }
+
+  // Ignore a fall that belongs to a measurement that already timed out, or
+  // whose rise came before this ping.
+  if (armed_ && (status & TIM_SR_CC1IF)) {
+    timeout_.detach();
+    Trace::point(TRACE_ECHO_FALL, (int)(ticks / ticksPerUs_));
+    finish((int)ticks);
+  }
+}
+
+void EchoTimerCapture::expire() {
+  if (armed_) {
+    // A rise with no fall yet means the sensor is still holding the line.
+    // Stay out of deep sleep until it falls: TIM2 stops with the high speed
+    // clock, and a missed fall would leave the sensor looking busy for good.
+    if (!echoHigh_ && (TIM2->SR & TIM_SR_CC1IF)) {
+      echoHigh_ = true;
+      sleep_manager_lock_deep_sleep();
+    }
+    Trace::point(TRACE_ECHO_TIMEOUT);
+    finish(ECHO_NO_TARGET);
+  }
+}
+
+void EchoTimerCapture::finish(int ticks) {
+  result_ = ticks;
+  armed_ = false;
+  ready_ = true;
+
+  if (complete_) {
+    complete_();
+  }
+}
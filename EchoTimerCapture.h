@@ -0,0 +1,120 @@
+/**
+ * Hardware timer echo capture for the HC-SR04 ultrasonic sensor.
+ *
+ * A drop-in alternative to EchoCapture with the same interface. The echo pin
+ * is routed to channel 1 of TIM2, which runs from the timer clock with no
+ * prescaler and is set up in PWM input mode:
+ *   - the rising edge of the echo resets the counter,
+ *   - the falling edge latches the counter into CCR2 and raises the only
+ *     interrupt of the measurement.
+ * Both edges are caught by the timer itself, so the width is exact to one
+ * timer clock (8.3 ns at 120 MHz), however late the interrupt is served, and
+ * the CPU does nothing while the pulse is in flight.
+ *
+ * TIM2 channel 1 is available on PA_0, PA_5 (D13) and PA_15. There is only
+ * one TIM2, so only one EchoTimerCapture can exist.
+ */
+
+#ifndef ECHO_TIMER_CAPTURE_H
+#define ECHO_TIMER_CAPTURE_H
+
+#include "EchoCapture.h"
+#include "mbed.h"
+
+// Alternate function that connects the echo pin to TIM2 channel 1.
+#define ECHO_TIMER_AF 1
+
+class EchoTimerCapture {
+public:
+  /**
+   * Constructor
+   *
+   * @param trigger   Pin connected to the sensor's trigger input.
+   * @param echo      Pin connected to the sensor's echo output, one of PA_0,
+   *                  PA_5 or PA_15.
+   * @param timeoutUs Time in microseconds after the trigger before a
+   *                  measurement is reported as "no target".
+   */
+  EchoTimerCapture(PinName trigger, PinName echo,
+                   int timeoutUs = ECHO_TIMEOUT_US);
+
+  /**
+   * Start a measurement. Returns immediately; the result becomes available
+   * through ready()/read() once the echo has been captured or timed out.
+   *
+   * @return false if a measurement is still in progress or the echo line is
+   *         still high from a previous ping, true if the trigger was sent.
+   */
+  bool ping();
+
+  /**
+   * @return true if a measurement finished and has not been read yet.
+   */
+  bool ready();
+
+  /**
+   * @return true while a measurement is in progress.
+   */
+  bool busy();
+
+  /**
+   * Collect the result of the last measurement and clear ready().
+   *
+   * @return The echo pulse width in microseconds, or ECHO_NO_TARGET.
+   */
+  int read();
+
+  /**
+   * The width of the last measurement at full resolution. Does not clear
+   * ready().
+   *
+   * @return The echo pulse width in nanoseconds, or ECHO_NO_TARGET.
+   */
+  int readNs();
+
+  /**
+   * Set the time allowed for a complete echo. Takes effect on the next ping.
+   *
+   * @param timeoutUs Timeout in microseconds.
+   */
+  void setTimeout(int timeoutUs);
+
+  /**
+   * Attach a function to call when a measurement finishes. It is called in
+   * interrupt context, so it must not block.
+   *
+   * @param complete Function to call, or nullptr to remove it.
+   */
+  void attach(Callback<void()> complete);
+
+private:
+  static void irq();
+  void captured(uint32_t status, uint32_t ticks);
+  void expire();
+  void finish(int ticks);
+
+  // The object TIM2's interrupt is delivered to.
+  static EchoTimerCapture *instance_;
+
+  DigitalOut trigger_;
+
+  // Ends the measurement if the echo does not complete in time.
+  Timeout timeout_;
+
+  Callback<void()> complete_;
+
+  int timeoutUs_;
+
+  // Timer clocks per microsecond.
+  uint32_t ticksPerUs_;
+
+  volatile int result_;
+  volatile bool armed_;
+  volatile bool ready_;
+
+  // The echo rose but has not fallen since a measurement timed out. A deep
+  // sleep lock is held while it is set.
+  volatile bool echoHigh_;
+};
+
+#endif /* ECHO_TIMER_CAPTURE_H */
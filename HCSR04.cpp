@@ -0,0 +1,26 @@
+#include "HCSR04.h"
+
+HCSR04::HCSR04(PinName trigger, PinName echo, TimeOfFlight &conversion)
+    : echo_(trigger, echo), conversion_(conversion) {
+  width_ = ECHO_NO_TARGET;
+}
+
+// Nothing to set up: the sensor is ready once it has power.
+bool HCSR04::initRange() { return true; }
+
+bool HCSR04::startRange() { return echo_.ping(); }
+
+int HCSR04::readRange() {
+  int width = echo_.read();
+  width_ = width;
+  if (width == ECHO_NO_TARGET) {
+    return RANGE_NO_TARGET;
+  }
+  return conversion_.toMm(width);
+}
+
+int HCSR04::rawRange() { return width_; }
+
+void HCSR04::attachRange(Callback<void()> complete) {
+  echo_.attach(complete);
+}
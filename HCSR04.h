@@ -0,0 +1,61 @@
+/**
+ * RangeSensor driver for the HC-SR04 ultrasonic sensor.
+ *
+ * The echo is measured by EchoSensor, with pin interrupts or TIM2 input
+ * capture as set in mbed_app.json, and the echo width is turned into a
+ * distance by a TimeOfFlight conversion shared by all the ultrasonic sensors,
+ * so setting the temperature or the calibration once applies to every one.
+ *
+ * The sensor is pinged at most once every HCSR04_CYCLE_US, as its datasheet
+ * asks, and a neighbour's echoes are given HCSR04_SETTLE_US to die away.
+ */
+
+#ifndef HCSR04_H
+#define HCSR04_H
+
+#include "EchoSensor.h"
+#include "RangeSensor.h"
+#include "TimeOfFlight.h"
+#include "mbed.h"
+
+// Shortest time in microseconds between two pings of the same sensor.
+#define HCSR04_CYCLE_US 60000
+
+// Wait in microseconds after a neighbour's measurement before pinging.
+#define HCSR04_SETTLE_US 10000
+
+// Longest distance in millimeters the sensor can measure.
+#define HCSR04_MAX_MM 4000
+
+class HCSR04 : public RangeSensor<HCSR04> {
+public:
+  static const int CYCLE_US = HCSR04_CYCLE_US;
+  static const int SETTLE_US = HCSR04_SETTLE_US;
+  static const int MAX_MM = HCSR04_MAX_MM;
+
+  /**
+   * Constructor
+   *
+   * @param trigger    Pin connected to the sensor's trigger input.
+   * @param echo       Pin connected to the sensor's echo output.
+   * @param conversion Echo time to distance conversion.
+   */
+  HCSR04(PinName trigger, PinName echo, TimeOfFlight &conversion);
+
+private:
+  friend class RangeSensor<HCSR04>;
+
+  bool initRange();
+  bool startRange();
+  int readRange();
+  int rawRange();
+  void attachRange(Callback<void()> complete);
+
+  EchoSensor echo_;
+  TimeOfFlight &conversion_;
+
+  // The echo width behind the last result.
+  volatile int width_;
+};
+
+#endif /* HCSR04_H */
@@ -0,0 +1,126 @@
+#include "LCDRenderer.h"
+#include "Trace.h"
+#include <cstring>
+
+LCDRenderer::LCDRenderer(CSE321_LCD &lcd, osPriority priority)
+    : lcd_(lcd), head_(0), tail_(0), pending_(0, 1), thread_(priority) {
+
+  dropped_ = 0;
+  warm_ = false;
+}
+
+void LCDRenderer::start(bool warm) {
+  warm_ = warm;
+  thread_.start(callback(this, &LCDRenderer::run));
+}
+
+bool LCDRenderer::draw(unsigned char col, unsigned char row, const char *text,
+                       unsigned char width) {
+  Command *cmd = reserve();
+  if (cmd == nullptr) {
+    return false;
+  }
+  cmd->op = DRAW;
+  cmd->col = col;
+  cmd->row = row;
+  cmd->width = width;
+  strncpy(cmd->text, text, LCD_TEXT_MAX);
+  cmd->text[LCD_TEXT_MAX] = 0;
+  commit();
+  return true;
+}
+
+bool LCDRenderer::bar(unsigned char col, unsigned char row, int level,
+                      unsigned char width) {
+  Command *cmd = reserve();
+  if (cmd == nullptr) {
+    return false;
+  }
+  cmd->op = BAR;
+  cmd->col = col;
+  cmd->row = row;
+  cmd->width = width;
+  cmd->level = level;
+  commit();
+  return true;
+}
+
+bool LCDRenderer::clear() {
+  Command *cmd = reserve();
+  if (cmd == nullptr) {
+    return false;
+  }
+  cmd->op = CLEAR;
+  commit();
+  return true;
+}
+
+bool LCDRenderer::flush() {
+  Command *cmd = reserve();
+  if (cmd == nullptr) {
+    return false;
+  }
+  cmd->op = FLUSH;
+  commit();
+
+  // Releasing an already released semaphore fails harmlessly, so several
+  // flushes queued before the render thread runs only wake it once.
+  pending_.release();
+  return true;
+}
+
+int LCDRenderer::dropped() { return dropped_; }
+
+void LCDRenderer::attach(Callback<void()> drained) { drained_ = drained; }
+
+// Return the next free slot, or nullptr if the ring is full.
+LCDRenderer::Command *LCDRenderer::reserve() {
+  unsigned int head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) >= LCD_QUEUE_SIZE) {
+    dropped_++;
+    return nullptr;
+  }
+  return &ring_[head % LCD_QUEUE_SIZE];
+}
+
+// Publish the slot returned by reserve() to the render thread.
+void LCDRenderer::commit() {
+  head_.store(head_.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+}
+
+void LCDRenderer::run() {
+  lcd_.begin(warm_);
+  Trace::boot(TRACE_BOOT_LCD);
+
+  while (true) {
+    pending_.acquire();
+
+    unsigned int tail = tail_.load(std::memory_order_relaxed);
+    while (tail != head_.load(std::memory_order_acquire)) {
+      Command &cmd = ring_[tail % LCD_QUEUE_SIZE];
+
+      if (cmd.op == DRAW) {
+        lcd_.draw(cmd.col, cmd.row, cmd.text, cmd.width);
+      } else if (cmd.op == BAR) {
+        lcd_.drawBar(cmd.col, cmd.row, cmd.level, cmd.width);
+      } else if (cmd.op == CLEAR) {
+        lcd_.clearFrame();
+      } else if (cmd.op == FLUSH) {
+        uint32_t begin = Trace::now();
+        int sent = lcd_.flush();
+        Trace::span(TRACE_SPAN_LCD_FLUSH, begin);
+        Trace::point(TRACE_LCD_FLUSH, sent);
+        Trace::boot(TRACE_BOOT_SHOWN);
+      }
+
+      // Hand the slot back to the producer.
+      tail++;
+      tail_.store(tail, std::memory_order_release);
+    }
+
+    if (drained_) {
+      drained_();
+    }
+  }
+}
@@ -0,0 +1,122 @@
+/**
+ * Non-blocking front-end for CSE321_LCD.
+ *
+ * Callers queue draw/clear/flush commands into a fixed-size ring and return
+ * straight away. A low priority render thread owns the display: it runs
+ * begin(), applies the queued commands to the frame buffer and sends the
+ * changes, so the I2C traffic and the LCD's settle times never hold up the
+ * thread that queued them.
+ *
+ * The ring is lock-free with a single producer and a single consumer, so all
+ * commands must be queued from the same thread.
+ */
+
+#ifndef LCD_RENDERER_H
+#define LCD_RENDERER_H
+
+#include "lcd1602.h"
+#include "mbed.h"
+#include <atomic>
+
+// Number of commands the ring holds, must be a power of two.
+#define LCD_QUEUE_SIZE 32
+
+// Longest text a single draw command carries.
+#define LCD_TEXT_MAX LCD_MAX_COLS
+
+class LCDRenderer {
+public:
+  /**
+   * Constructor
+   *
+   * @param lcd      The display to drive. Only the render thread uses it once
+   *                 start() has been called.
+   * @param priority Priority of the render thread.
+   */
+  LCDRenderer(CSE321_LCD &lcd, osPriority priority = osPriorityBelowNormal);
+
+  /**
+   * Start the render thread, which initializes the display with begin().
+   * Commands can be queued before the display is ready.
+   *
+   * @param warm Passed to begin(): the display kept its power through the
+   *             reset, so it is ready in milliseconds instead of a second.
+   */
+  void start(bool warm = false);
+
+  /**
+   * Queue a CSE321_LCD::draw(). Text longer than LCD_TEXT_MAX is cut off.
+   *
+   * @return false if the ring was full and the command was dropped.
+   */
+  bool draw(unsigned char col, unsigned char row, const char *text,
+            unsigned char width = 0);
+
+  /**
+   * Queue a CSE321_LCD::drawBar().
+   *
+   * @return false if the ring was full and the command was dropped.
+   */
+  bool bar(unsigned char col, unsigned char row, int level,
+           unsigned char width);
+
+  /**
+   * Queue a CSE321_LCD::clearFrame().
+   *
+   * @return false if the ring was full and the command was dropped.
+   */
+  bool clear();
+
+  /**
+   * Queue a CSE321_LCD::flush() and wake the render thread to apply
+   * everything queued so far.
+   *
+   * @return false if the ring was full and the command was dropped.
+   */
+  bool flush();
+
+  /**
+   * @return Number of commands dropped because the ring was full.
+   */
+  int dropped();
+
+  /**
+   * Set a function for the render thread to call each time it has applied
+   * everything queued, for a heartbeat. Call before start().
+   */
+  void attach(Callback<void()> drained);
+
+private:
+  enum Op { DRAW, BAR, CLEAR, FLUSH };
+
+  struct Command {
+    unsigned char op;
+    unsigned char col;
+    unsigned char row;
+    unsigned char width;
+    // Columns of dots lit, for BAR.
+    short level;
+    char text[LCD_TEXT_MAX + 1];
+  };
+
+  Command *reserve();
+  void commit();
+  void run();
+
+  CSE321_LCD &lcd_;
+  bool warm_;
+
+  Command ring_[LCD_QUEUE_SIZE];
+
+  // head_ is only written by the producer, tail_ only by the render thread.
+  std::atomic<unsigned int> head_;
+  std::atomic<unsigned int> tail_;
+
+  volatile int dropped_;
+  Callback<void()> drained_;
+
+  Semaphore pending_;
+  Thread thread_;
+};
+
+#endif /* LCD_RENDERER_H */
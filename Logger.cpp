@@ -0,0 +1,102 @@
+#include "Logger.h"
+#include <cstdio>
+
+Logger::Logger(osPriority priority)
+    : head_(0), tail_(0), dropped_(0), waiting_(false), wake_(0, 1),
+      thread_(priority) {
+
+  for (unsigned int i = 0; i < LOG_QUEUE_SIZE; i++) {
+    ring_[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+void Logger::start() { thread_.start(callback(this, &Logger::run)); }
+
+unsigned int Logger::dropped() {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+// Claim the slot at head_, fill it in and hand it to the thread.
+bool Logger::push(const char *format, Emit emit, const uintptr_t *args,
+                  int count) {
+  unsigned int pos = head_.load(std::memory_order_relaxed);
+  Record *record;
+  while (true) {
+    record = &ring_[pos % LOG_QUEUE_SIZE];
+    int diff = (int)(record->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      // The slot is free; take it unless another producer got there first,
+      // in which case pos now holds the new head.
+      if (head_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The thread has not printed this slot's last record yet: full.
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+
+  record->format = format;
+  record->emit = emit;
+  for (int i = 0; i < count; i++) {
+    record->args[i] = args[i];
+  }
+  record->seq.store(pos + 1, std::memory_order_release);
+
+  // Pairs with the fence in run(): either the thread sees this record before
+  // it sleeps, or this sees that it is going to sleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_.load(std::memory_order_relaxed) &&
+      waiting_.exchange(false, std::memory_order_acq_rel)) {
+    wake_.release();
+  }
+  return true;
+}
+
+// Take the oldest record, if it has been published.
+bool Logger::pop(Record &out) {
+  Record &record = ring_[tail_ % LOG_QUEUE_SIZE];
+  if (record.seq.load(std::memory_order_acquire) != tail_ + 1) {
+    return false;
+  }
+  out.format = record.format;
+  out.emit = record.emit;
+  for (int i = 0; i < LOG_MAX_ARGS; i++) {
+    out.args[i] = record.args[i];
+  }
+  record.seq.store(tail_ + LOG_QUEUE_SIZE, std::memory_order_release);
+  tail_++;
+  return true;
+}
+
+void Logger::run() {
+  unsigned int reported = 0;
+  Record record;
+
+  while (true) {
+    while (pop(record)) {
+      record.emit(record.format, record.args);
+    }
+
+    unsigned int dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported) {
+      printf("log: %u records dropped\n", dropped - reported);
+      reported = dropped;
+    }
+
+    // Sleep until the next record, checking again after saying so in case
+    // one arrived in between.
+    waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring_[tail_ % LOG_QUEUE_SIZE].seq.load(std::memory_order_acquire) ==
+        tail_ + 1) {
+      waiting_.store(false, std::memory_order_relaxed);
+      continue;
+    }
+    wake_.acquire();
+  }
+}
@@ -0,0 +1,118 @@
+/**
+ * Deferred console logging.
+ *
+ * print() does not format anything. It stores the format string's address
+ * and up to LOG_MAX_ARGS raw arguments in a fixed-size ring and returns, so
+ * logging from the main loop, the event queue or an interrupt costs a few
+ * dozen cycles instead of the whole UART transfer. A low priority thread
+ * formats the records with printf() when nothing more important is running.
+ *
+ * The ring is lock-free for any number of producers: each record slot has
+ * its own sequence number, so a producer claims a slot with one
+ * compare-and-swap and publishes it with one store, and never waits. When
+ * the ring is full the record is dropped and counted, and the thread reports
+ * how many were lost.
+ *
+ * Because the formatting happens later, the format string and any %s
+ * argument must still exist then, which string literals always do. Arguments
+ * are stored as machine words, so only integers of at most 32 bits, chars
+ * and pointers can be logged. Each record also keeps a function made for the
+ * types of its arguments, which turns the words back into those types for
+ * printf(), so every argument reaches it as what was passed.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "mbed.h"
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <utility>
+
+// Number of records the ring holds, must be a power of two.
+#define LOG_QUEUE_SIZE 32
+
+// Most arguments one record carries.
+#define LOG_MAX_ARGS 4
+
+class Logger {
+public:
+  /**
+   * Constructor
+   *
+   * @param priority Priority of the thread that prints the records.
+   */
+  Logger(osPriority priority = osPriorityLow);
+
+  /**
+   * Start the thread that prints the records. Records can be queued before.
+   */
+  void start();
+
+  /**
+   * Queue a printf() style message. Safe from any thread or interrupt.
+   *
+   * @param format Format string, which must outlive the record.
+   * @param args   At most LOG_MAX_ARGS integers, chars or pointers.
+   * @return false if the ring was full and the record was dropped.
+   */
+  template <typename... Args> bool print(const char *format, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    uintptr_t words[LOG_MAX_ARGS] = {word(args)...};
+    return push(format, &emit<Args...>, words, sizeof...(Args));
+  }
+
+  /**
+   * @return Number of records dropped because the ring was full.
+   */
+  unsigned int dropped();
+
+private:
+  // Prints a record whose arguments have the types it was made for.
+  typedef void (*Emit)(const char *format, const uintptr_t *args);
+
+  struct Record {
+    // LOG_QUEUE_SIZE ahead of the slot's position when it is free, one ahead
+    // when it holds a record for that position.
+    std::atomic<unsigned int> seq;
+    const char *format;
+    Emit emit;
+    uintptr_t args[LOG_MAX_ARGS];
+  };
+
+  template <typename T> static uintptr_t word(T value) {
+    static_assert(sizeof(T) <= sizeof(uintptr_t), "log argument too wide");
+    return (uintptr_t)value;
+  }
+
+  template <typename... Args>
+  static void emit(const char *format, const uintptr_t *args) {
+    emitWords<Args...>(format, args, std::index_sequence_for<Args...>());
+  }
+
+  template <typename... Args, size_t... I>
+  static void emitWords(const char *format, const uintptr_t *args,
+                        std::index_sequence<I...>) {
+    printf(format, (Args)args[I]...);
+  }
+
+  bool push(const char *format, Emit emit, const uintptr_t *args, int count);
+  bool pop(Record &out);
+  void run();
+
+  Record ring_[LOG_QUEUE_SIZE];
+  std::atomic<unsigned int> head_;
+  unsigned int tail_;
+
+  std::atomic<unsigned int> dropped_;
+
+  // Set while the thread is about to sleep, so only the first record after
+  // that pays for waking it.
+  std::atomic<bool> waiting_;
+  Semaphore wake_;
+
+  Thread thread_;
+};
+
+#endif /* LOGGER_H */
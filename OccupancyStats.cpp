@@ -0,0 +1,132 @@
+#include "OccupancyStats.h"
+#include <cstdio>
+
+void OccupancyStats::Bucket::clear() {
+  approaches = 0;
+  violations = 0;
+  violationMs = 0;
+  dwellMs = 0;
+  closest = -1;
+}
+
+void OccupancyStats::Bucket::add(const Bucket &other) {
+  approaches += other.approaches;
+  violations += other.violations;
+  violationMs += other.violationMs;
+  dwellMs += other.dwellMs;
+  if (other.closest >= 0 && (closest < 0 || other.closest < closest)) {
+    closest = other.closest;
+  }
+}
+
+OccupancyStats::OccupancyStats() {
+  started_ = false;
+  paused_ = false;
+  last_ = 0;
+  present_ = false;
+  violating_ = false;
+}
+
+void OccupancyStats::update(uint64_t ms, int cm, bool violation) {
+  if (!started_) {
+    started_ = true;
+    last_ = ms;
+    minutes_.begin(ms);
+    hours_.begin(ms);
+    days_.begin(ms);
+  }
+
+  // Credit the time since the last sample to what that sample saw.
+  uint32_t time = elapsed(ms);
+  uint32_t presentMs = present_ ? time : 0;
+  uint32_t violationMs = violating_ ? time : 0;
+
+  bool present = cm >= 0;
+  bool approach = present && !present_;
+  bool started = violation && !violating_;
+
+  count(minutes_.now(), presentMs, violationMs, approach, started, cm);
+  count(hours_.now(), presentMs, violationMs, approach, started, cm);
+  count(days_.now(), presentMs, violationMs, approach, started, cm);
+
+  last_ = ms;
+  present_ = present;
+  violating_ = violation;
+}
+
+void OccupancyStats::pause(uint64_t ms) {
+  if (!started_ || paused_) {
+    return;
+  }
+
+  uint32_t time = elapsed(ms);
+  uint32_t presentMs = present_ ? time : 0;
+  uint32_t violationMs = violating_ ? time : 0;
+
+  count(minutes_.now(), presentMs, violationMs, false, false, -1);
+  count(hours_.now(), presentMs, violationMs, false, false, -1);
+  count(days_.now(), presentMs, violationMs, false, false, -1);
+
+  last_ = ms;
+  paused_ = true;
+}
+
+// Move the windows on to ms and return the time to credit since the last
+// sample, which is none after a pause.
+uint32_t OccupancyStats::elapsed(uint64_t ms) {
+  minutes_.roll(ms);
+  hours_.roll(ms);
+  days_.roll(ms);
+
+  uint64_t gap = paused_ ? 0 : ms - last_;
+  paused_ = false;
+  return gap > STATS_MAX_GAP_MS ? STATS_MAX_GAP_MS : (uint32_t)gap;
+}
+
+void OccupancyStats::count(Bucket &bucket, uint32_t presentMs,
+                           uint32_t violationMs, bool approach, bool violation,
+                           int cm) {
+  bucket.dwellMs += presentMs;
+  bucket.violationMs += violationMs;
+  if (approach) {
+    bucket.approaches++;
+  }
+  if (violation) {
+    bucket.violations++;
+  }
+  if (cm >= 0 && (bucket.closest < 0 || cm < bucket.closest)) {
+    bucket.closest = cm;
+  }
+}
+
+// Print one line of counts, with times in seconds.
+static void printBucket(const char *label, const OccupancyStats::Bucket &b) {
+  printf("stats: %-9s %8lu %8lu %8lu %8lu", label,
+         (unsigned long)b.approaches, (unsigned long)b.violations,
+         (unsigned long)(b.violationMs / 1000),
+         (unsigned long)(b.dwellMs / 1000));
+  if (b.closest >= 0) {
+    printf(" %7ld\n", (long)b.closest);
+  } else {
+    printf("       -\n");
+  }
+}
+
+void OccupancyStats::print() const {
+  printf("stats:           approach violated   viol s  dwell s closest\n");
+  printBucket("this min", minute(0));
+  printBucket("last 60m", lastHour());
+  printBucket("last 24h", lastDay());
+  printBucket("last 7d", lastWeek());
+
+  // The hours of the last day that saw anything, newest first.
+  char label[12];
+  for (int i = 0; i < STATS_HOURS; i++) {
+    const Bucket &b = hour(i);
+    if (b.approaches == 0 && b.dwellMs == 0 && b.closest < 0) {
+      continue;
+    }
+    snprintf(label, sizeof(label), "%dh ago", i);
+    printBucket(label, b);
+  }
+}
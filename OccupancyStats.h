@@ -0,0 +1,182 @@
+/**
+ * Occupancy and violation statistics over rolling windows.
+ *
+ * Fed with the closest distance and the alarm state after every sample, it
+ * counts for each minute, hour and day:
+ *   - approaches: a target coming into range when there was none,
+ *   - violations: the alarm going on,
+ *   - violation time: how long the alarm was on,
+ *   - dwell time: how long a target was in range,
+ *   - the closest approach.
+ * The last STATS_MINUTES minutes, STATS_HOURS hours and STATS_DAYS days are
+ * kept in three rings of buckets. Each sample only adds to the current
+ * bucket of each ring, and a new bucket is only cleared when its period
+ * starts, so an update takes the same short time however long it has run.
+ *
+ * Periods count from the first sample, as there is no real time clock. Time
+ * between two samples is credited to the state of the first, up to
+ * STATS_MAX_GAP_MS in case the samples stall. pause() stops the crediting
+ * until the next sample, so the time spent in the settings menu, where
+ * nothing is sampled, is not counted.
+ *
+ * Only one thread may call update(). Readers on other threads see each
+ * counter either before or after an update, but may see different counters
+ * of a bucket from different samples.
+ */
+
+#ifndef OCCUPANCY_STATS_H
+#define OCCUPANCY_STATS_H
+
+#include <stdint.h>
+
+// Number of buckets in each ring.
+#define STATS_MINUTES 60
+#define STATS_HOURS 24
+#define STATS_DAYS 7
+
+// Longest time in milliseconds credited between two samples.
+#define STATS_MAX_GAP_MS 5000
+
+class OccupancyStats {
+public:
+  /**
+   * Counts for one period, or for several added together.
+   */
+  struct Bucket {
+    uint32_t approaches;
+    uint32_t violations;
+    uint32_t violationMs;
+    uint32_t dwellMs;
+    // Closest distance in centimeters, or -1 if nothing was in range.
+    int32_t closest;
+
+    void clear();
+    void add(const Bucket &other);
+  };
+
+  OccupancyStats();
+
+  /**
+   * Count a sample.
+   *
+   * @param ms        Time of the sample in milliseconds.
+   * @param cm        Closest distance in centimeters, or -1 for no target.
+   * @param violation Whether the alarm is on.
+   */
+  void update(uint64_t ms, int cm, bool violation);
+
+  /**
+   * Credit the time up to ms to the last sample, then count nothing until
+   * the next update().
+   *
+   * @param ms Time sampling stopped in milliseconds.
+   */
+  void pause(uint64_t ms);
+
+  /**
+   * @param ago 0 for the current minute, 1 for the one before and so on, up
+   *            to STATS_MINUTES - 1.
+   */
+  const Bucket &minute(int ago) const { return minutes_.ago(ago); }
+
+  /**
+   * @param ago 0 for the current hour, up to STATS_HOURS - 1.
+   */
+  const Bucket &hour(int ago) const { return hours_.ago(ago); }
+
+  /**
+   * @param ago 0 for the current day, up to STATS_DAYS - 1.
+   */
+  const Bucket &day(int ago) const { return days_.ago(ago); }
+
+  /**
+   * @return Totals of the last STATS_MINUTES minutes.
+   */
+  Bucket lastHour() const { return minutes_.total(); }
+
+  /**
+   * @return Totals of the last STATS_HOURS hours.
+   */
+  Bucket lastDay() const { return hours_.total(); }
+
+  /**
+   * @return Totals of the last STATS_DAYS days.
+   */
+  Bucket lastWeek() const { return days_.total(); }
+
+  /**
+   * Print the totals and the per-hour counts of the last day to the console.
+   */
+  void print() const;
+
+private:
+  /**
+   * A ring of buckets for the last N periods of periodMs each.
+   */
+  template <int N, uint32_t periodMs> class Window {
+  public:
+    Window() : current_(0), end_(0) {
+      for (int i = 0; i < N; i++) {
+        buckets_[i].clear();
+      }
+    }
+
+    // Start the current period at ms.
+    void begin(uint64_t ms) { end_ = ms + periodMs; }
+
+    // Move on to the period ms falls in, clearing the buckets passed.
+    void roll(uint64_t ms) {
+      if (ms < end_) {
+        return;
+      }
+      uint64_t periods = (ms - end_) / periodMs + 1;
+      end_ += periods * periodMs;
+
+      // After a gap longer than the ring, every bucket is stale.
+      if (periods > N) {
+        periods = N;
+      }
+      for (uint64_t i = 0; i < periods; i++) {
+        current_ = (current_ + 1) % N;
+        buckets_[current_].clear();
+      }
+    }
+
+    Bucket &now() { return buckets_[current_]; }
+
+    const Bucket &ago(int periods) const {
+      return buckets_[(current_ - periods % N + N) % N];
+    }
+
+    Bucket total() const {
+      Bucket sum;
+      sum.clear();
+      for (int i = 0; i < N; i++) {
+        sum.add(buckets_[i]);
+      }
+      return sum;
+    }
+
+  private:
+    Bucket buckets_[N];
+    int current_;
+    // When the current period ends.
+    uint64_t end_;
+  };
+
+  uint32_t elapsed(uint64_t ms);
+  static void count(Bucket &bucket, uint32_t presentMs, uint32_t violationMs,
+                    bool approach, bool violation, int cm);
+
+  Window<STATS_MINUTES, 60000> minutes_;
+  Window<STATS_HOURS, 3600000> hours_;
+  Window<STATS_DAYS, 86400000> days_;
+
+  bool started_;
+  bool paused_;
+  uint64_t last_;
+  bool present_;
+  bool violating_;
+};
+
+#endif /* OCCUPANCY_STATS_H */
@@ -0,0 +1,80 @@
+#include "PowerManager.h"
+#include <cstdio>
+
+PowerManager::PowerManager(uint32_t listenMs)
+    : listenMs_(listenMs), woken_(false), listening_(true) {
+
+  until_ = listenMs;
+  last_.upUs = 0;
+  last_.runUs = 0;
+  last_.sleepUs = 0;
+  last_.deepSleepUs = 0;
+}
+
+void PowerManager::wake() { woken_.store(true, std::memory_order_relaxed); }
+
+void PowerManager::update(uint64_t ms) {
+  if (listenMs_ == 0) {
+    return;
+  }
+  if (woken_.exchange(false, std::memory_order_relaxed)) {
+    until_ = ms + listenMs_;
+  }
+
+  bool listen = ms < until_;
+  if (listen != listening_) {
+    mbed_file_handle(STDIN_FILENO)->enable_input(listen);
+    listening_ = listen;
+  }
+}
+
+PowerManager::Duty PowerManager::duty() {
+  mbed_stats_cpu_t stats;
+  mbed_stats_cpu_get(&stats);
+
+  Duty duty;
+  duty.upUs = stats.uptime;
+  duty.sleepUs = stats.sleep_time;
+  duty.deepSleepUs = stats.deep_sleep_time;
+  duty.runUs = stats.uptime - stats.idle_time;
+  return duty;
+}
+
+// Print a share of a time span in percent with one decimal, without floating
+// point.
+static void printShare(uint64_t us, uint64_t totalUs) {
+  unsigned long tenths =
+      totalUs > 0 ? (unsigned long)(us * 1000 / totalUs) : 0;
+  printf(" %5lu.%lu", tenths / 10, tenths % 10);
+}
+
+// Print one line of the report.
+static void printDuty(const char *label, const PowerManager::Duty &d) {
+  printf("power: %-10s %8lu.%lu", label, (unsigned long)(d.upUs / 1000000),
+         (unsigned long)(d.upUs / 100000 % 10));
+  printShare(d.runUs, d.upUs);
+  printShare(d.sleepUs, d.upUs);
+  printShare(d.deepSleepUs, d.upUs);
+  printf("\n");
+}
+
+void PowerManager::report() {
+  Duty total = duty();
+  Duty recent;
+  recent.upUs = total.upUs - last_.upUs;
+  recent.runUs = total.runUs - last_.runUs;
+  recent.sleepUs = total.sleepUs - last_.sleepUs;
+  recent.deepSleepUs = total.deepSleepUs - last_.deepSleepUs;
+  last_ = total;
+
+  printf("power: since               s   run %% sleep %%  deep %%\n");
+  printDuty("startup", total);
+  printDuty("last", recent);
+  if (listenMs_ == 0) {
+    printf("power: console always listening, so never in deep sleep\n");
+  } else {
+    printf("power: console stops listening %lu s after a command or a button "
+           "press\n",
+           (unsigned long)(listenMs_ / 1000));
+  }
+}
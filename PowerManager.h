@@ -0,0 +1,91 @@
+/**
+ * Deep sleep housekeeping and duty cycle accounting.
+ *
+ * Mbed OS puts the core to sleep whenever every thread is waiting. With
+ * tickless idle the next kernel or low power timer event is programmed into
+ * LPTIM1, and the core goes into stop mode until that event, or an EXTI line
+ * such as the user button or the encoder channels, wakes it. It only sleeps
+ * lightly, with the high speed clocks running, while some driver holds a deep
+ * sleep lock because it needs the microsecond ticker or a peripheral clock.
+ * The drivers in this project only hold one while an echo is being measured,
+ * an I2C transfer or telemetry frame is going out, or the buzzer is beeping.
+ *
+ * The buffered console is the exception: its receive interrupt holds the lock
+ * for as long as input is enabled. PowerManager keeps input enabled for
+ * listenMs after startup, after a button press and after each command, and
+ * turns it off after that, so an idle system can stop between pings.
+ * Characters typed while input is off are lost; hold the button for a second
+ * to wake the console without switching the menu, then type.
+ *
+ * The time spent running, sleeping and in deep sleep comes from the Mbed CPU
+ * statistics (platform.cpu-stats-enabled in mbed_app.json). report() prints
+ * the split since startup and since the previous report.
+ */
+
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include "mbed.h"
+#include <atomic>
+#include <stdint.h>
+
+class PowerManager {
+public:
+  /**
+   * Time spent in each power state, in microseconds.
+   */
+  struct Duty {
+    uint64_t upUs;
+    uint64_t runUs;
+    uint64_t sleepUs;
+    uint64_t deepSleepUs;
+  };
+
+  /**
+   * Constructor. The console starts out listening.
+   *
+   * @param listenMs How long in milliseconds the console listens after being
+   *                 woken, or 0 to always listen and never deep sleep.
+   */
+  PowerManager(uint32_t listenMs);
+
+  /**
+   * Keep the console listening for another listenMs, from the next update().
+   * Safe to call from any thread.
+   */
+  void wake();
+
+  /**
+   * Turn the console input on or off as its listening time starts and runs
+   * out. Only one thread may call this.
+   *
+   * @param ms The current time in milliseconds.
+   */
+  void update(uint64_t ms);
+
+  /**
+   * @return Time spent in each power state since startup.
+   */
+  static Duty duty();
+
+  /**
+   * Print the time in each power state since startup and since the previous
+   * report to the console. Only one thread may call this.
+   */
+  void report();
+
+private:
+  uint32_t listenMs_;
+
+  // Set by wake(), taken by update().
+  std::atomic<bool> woken_;
+
+  // When the console stops listening, and whether it is, for update().
+  uint64_t until_;
+  bool listening_;
+
+  // The totals at the previous report.
+  Duty last_;
+};
+
+#endif /* POWER_MANAGER_H */
@@ -137,8 +137,17 @@ QEI::QEI(PinName channelA,
 
     pulses_       = 0;
     revolutions_  = 0;
+    invalid_      = 0;
     pulsesPerRev_ = pulsesPerRev;
     encoding_     = encoding;
+    lastEdgeUs_   = 0;
+    snapVelocity_ = 0;
+
+    //No edge yet, so the first one after a stop has no period.
+    Edge none = {0, 0, QEI_STOP_US};
+    edges_.write(none);
+    snapEdge_ = none;
+    timer_.start();
 
     //Workout what the current state is.
     int chanA = channelA_.read();
@@ -168,8 +177,17 @@ QEI::QEI(PinName channelA,
 
 void QEI::reset(void) {
 
+    //encode() is the only other writer of edges_, keep it out.
+    CriticalSectionLock lock;
+
     pulses_      = 0;
     revolutions_ = 0;
+    invalid_     = 0;
+
+    Edge none = {0, lastEdgeUs_, QEI_STOP_US};
+    edges_.write(none);
+    snapEdge_     = none;
+    snapVelocity_ = 0;
 
 }
 
@@ -191,6 +209,53 @@ int QEI::getRevolutions(void) {
 
 }
 
+int QEI::getInvalid(void) {
+
+    return invalid_;
+
+}
+
+QEI::Snapshot QEI::getSnapshot(void) {
+
+    Edge         edge = edges_.read();
+    unsigned int now  = timer_.read_us();
+    int          moved = edge.pulses - snapEdge_.pulses;
+    int          velocity = 0;
+
+    if (moved != 0) {
+        //M/T: with a recent edge to measure from, the pulses since then over
+        //the time they took. After a stop there is none, so fall back to the
+        //time between the last two edges.
+        unsigned int span = edge.us - snapEdge_.us;
+        if (span >= QEI_STOP_US) {
+            span  = edge.period * (moved < 0 ? -moved : moved);
+        }
+        if (span < QEI_STOP_US) {
+            velocity = (int)((long long)moved * 1000000 / (int)span);
+        }
+    } else if (snapVelocity_ != 0) {
+        //No new edge: the encoder is at most as fast as one pulse in the
+        //time since the last edge.
+        unsigned int idle = now - edge.us;
+        if (idle < QEI_STOP_US) {
+            int bound = 1000000 / (int)(idle > 0 ? idle : 1);
+            velocity = snapVelocity_;
+            if (velocity > bound) {
+                velocity = bound;
+            } else if (velocity < -bound) {
+                velocity = -bound;
+            }
+        }
+    }
+
+    snapEdge_     = edge;
+    snapVelocity_ = velocity;
+
+    Snapshot snapshot = {edge.pulses, velocity};
+    return snapshot;
+
+}
+
 // +-------------+
 // | X2 Encoding |
 // +-------------+
@@ -235,6 +300,7 @@ int QEI::getRevolutions(void) {
 // We might enter an invalid state for a number of reasons which are hard to
 // predict - if this is the case, it is generally safe to ignore it, update
 // the state and carry on, with the error correcting itself shortly after.
+// Invalid transitions are counted so that missed edges can be detected.
 void QEI::encode(void) {
 
     int change = 0;
@@ -250,15 +316,19 @@ void QEI::encode(void) {
         if ((prevState_ == 0x3 && currState_ == 0x0) ||
                 (prevState_ == 0x0 && currState_ == 0x3)) {
 
-            pulses_++;
+            change = 1;
 
         }
         //10->01->10->01 is clockwise rotation or "backward".
         else if ((prevState_ == 0x2 && currState_ == 0x1) ||
                  (prevState_ == 0x1 && currState_ == 0x2)) {
 
-            pulses_--;
+            change = -1;
+        }
+        //Channel A did not change, so one of its edges was missed.
+        else if (((currState_ ^ prevState_) & CURR_MASK) == 0) {
 
+            invalid_++;
         }
 
     } else if (encoding_ == X4_ENCODING) {
@@ -273,13 +343,29 @@ void QEI::encode(void) {
                 change = -1;
             }
 
-            pulses_ -= change;
+            //A 1 counts down and a -1 counts up.
+            change = -change;
+        }
+        //Both channels changed, so an edge was missed.
+        else if ((currState_ ^ prevState_) == INVALID) {
+
+            invalid_++;
         }
 
     }
 
+    pulses_ += change;
+
     prevState_ = currState_;
 
+    //Timestamp counted edges and publish them with the count.
+    if (change != 0) {
+        unsigned int now = timer_.read_us();
+        Edge edge = {pulses_, now, now - lastEdgeUs_};
+        lastEdgeUs_ = now;
+        edges_.write(edge);
+    }
+
 }
 
 void QEI::index(void) {
@@ -130,6 +130,7 @@
  * Includes
  */
 #include "mbed.h"
+#include "SeqLock.h"
 
 /**
  * Defines
@@ -140,6 +141,9 @@
 //of rotation.
 #define INVALID   0x3 //XORing two states where both bits have changed.
 
+#define QEI_STOP_US 500000 //Time without a pulse after which the encoder
+//is considered stopped.
+
 /**
  * Quadrature Encoder Interface.
  */
@@ -154,6 +158,16 @@ public:
 
     } Encoding;
 
+    /**
+     * Position and speed of the encoder at one moment.
+     */
+    typedef struct Snapshot {
+
+        int pulses;   //Pulse count.
+        int velocity; //Pulses per second, negative when going backward.
+
+    } Snapshot;
+
     /**
      * Constructor.
      *
@@ -208,6 +222,36 @@ public:
      */
     int getRevolutions(void);
 
+    /**
+     * Read the number of invalid state transitions seen by the encoder.
+     *
+     * With X4 encoding a transition is invalid when both channels changed
+     * at once. With X2 encoding it is invalid when channel A did not change
+     * between two of its own interrupts. Either way an edge was missed.
+     *
+     * @return Number of invalid transitions which have occured.
+     */
+    int getInvalid(void);
+
+    /**
+     * Read the pulse count and velocity together.
+     *
+     * Every counted edge is timestamped in the interrupt, and the count and
+     * timestamp are published as one consistent pair. The velocity uses an
+     * M/T estimate: the pulses counted since the previous call, over the
+     * exact time between the last edge seen then and the last edge now. This
+     * stays accurate at high speed, where many pulses fall in each call, and
+     * at low speed, where the time between edges is long. Once the encoder
+     * stops, the velocity decays as the time since the last edge grows, and
+     * reaches zero after QEI_STOP_US.
+     *
+     * Each call starts the next measurement window, so only one thread
+     * should call it, and at a steady rate.
+     *
+     * @return The pulse count and the velocity in pulses per second.
+     */
+    Snapshot getSnapshot(void);
+
 private:
 
     /**
@@ -226,6 +270,15 @@ private:
      */
     void index(void);
 
+    //A counted edge, as published by encode().
+    typedef struct Edge {
+
+        int          pulses; //Pulse count after the edge.
+        unsigned int us;     //When the edge came, from timer_.
+        unsigned int period; //Time since the previous counted edge.
+
+    } Edge;
+
     Encoding encoding_;
 
     InterruptIn channelA_;
@@ -238,6 +291,17 @@ private:
 
     volatile int pulses_;
     volatile int revolutions_;
+    volatile int invalid_;
+
+    //Timestamps the edges. It runs from the low power ticker, so counting
+    //does not keep the core out of deep sleep.
+    LowPowerTimer timer_;
+    unsigned int  lastEdgeUs_;
+    SeqLock<Edge> edges_;
+
+    //The last edge seen by the previous getSnapshot() call, and its result.
+    Edge snapEdge_;
+    int  snapVelocity_;
 
 };
 
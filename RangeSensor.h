@@ -0,0 +1,104 @@
+/**
+ * Compile time interface of a distance sensor.
+ *
+ * A sensor driver derives from RangeSensor<Driver> and implements the
+ * private hooks below; RangeSensor forwards each call of the interface to
+ * its hook with a static_cast, so code that is templated on the driver, such
+ * as SonarArray, calls straight into it without any virtual dispatch. A hook
+ * that is missing fails to compile.
+ *
+ *   bool initRange();              set the sensor up, from a thread
+ *   bool startRange();             start a measurement, see ping()
+ *   int readRange();               distance in mm or RANGE_NO_TARGET
+ *   int rawRange();                the sensor's own reading, or -1
+ *   void attachRange(Callback<void()> complete);
+ *
+ * Each driver also gives its timing as constants, which the scheduler uses
+ * to space out the pings, and its range, which limits the threshold:
+ *
+ *   static const int CYCLE_US;     shortest time between two measurements
+ *   static const int SETTLE_US;    wait after a neighbour's measurement, 0 if
+ *                                  neighbours cannot disturb each other
+ *   static const int MAX_MM;       longest distance it reports in mm
+ *
+ * Measurements never block. ping() returns straight away and the completion
+ * callback is called once the result is in, from interrupt context or from a
+ * driver thread, so it must not block either.
+ */
+
+#ifndef RANGE_SENSOR_H
+#define RANGE_SENSOR_H
+
+#include "mbed.h"
+
+// Distance reported for a measurement that found no target.
+#define RANGE_NO_TARGET -1
+
+template <typename Sensor> class RangeSensor {
+public:
+  /**
+   * Set the sensor up. Call once from a thread before the first ping; it may
+   * take a while, and a sensor that fails to start reports no target.
+   *
+   * @return false if the sensor did not answer.
+   */
+  bool init() { return self().initRange(); }
+
+  /**
+   * Start a measurement. Returns immediately; the result becomes available
+   * through read() once the measurement has finished.
+   *
+   * @return false if the sensor is not ready for another measurement yet.
+   */
+  bool ping() { return self().startRange(); }
+
+  /**
+   * Collect the result of the last measurement.
+   *
+   * @return The distance in millimeters, or RANGE_NO_TARGET.
+   */
+  int read() { return self().readRange(); }
+
+  /**
+   * Collect the result of the last measurement in centimeters, rounded.
+   *
+   * @return The distance in centimeters, or RANGE_NO_TARGET.
+   */
+  int readCm() {
+    int mm = read();
+    return mm == RANGE_NO_TARGET ? RANGE_NO_TARGET : (mm + 5) / 10;
+  }
+
+  /**
+   * @return The reading behind the last result in the sensor's own unit,
+   *         such as the echo width in microseconds, or -1 if it has none.
+   */
+  int raw() { return self().rawRange(); }
+
+  /**
+   * Attach a function to call when a measurement finishes.
+   *
+   * @param complete Function to call, or nullptr to remove it.
+   */
+  void attach(Callback<void()> complete) { self().attachRange(complete); }
+
+  /**
+   * @return Shortest time in microseconds between two measurements.
+   */
+  static int cycleUs() { return Sensor::CYCLE_US; }
+
+  /**
+   * @return Time in microseconds to wait after a neighbour's measurement.
+   */
+  static int settleUs() { return Sensor::SETTLE_US; }
+
+  /**
+   * @return Longest distance in millimeters the sensor reports.
+   */
+  static int maxMm() { return Sensor::MAX_MM; }
+
+private:
+  Sensor &self() { return *static_cast<Sensor *>(this); }
+};
+
+#endif /* RANGE_SENSOR_H */
@@ -0,0 +1,96 @@
+/**
+ * Sequence lock for publishing a small struct to any number of readers.
+ *
+ * The writer bumps the sequence number to an odd value, stores the struct
+ * and bumps it back to even. A reader copies the struct between two loads of
+ * the sequence number and retries if they differ or are odd, so it always
+ * ends up with a copy from a single write. Neither side ever blocks or takes
+ * a lock: the writer always finishes in constant time, and a reader only
+ * repeats its copy when a write overlapped it.
+ *
+ * There must only be one writer at a time. Readers must not run at a higher
+ * priority than the writer, as in an interrupt, where they could spin forever
+ * on a write they preempted; tryRead() is for those.
+ *
+ * The struct is stored as words with relaxed atomic accesses, so it must be
+ * trivially copyable.
+ */
+
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+template <typename T> class SeqLock {
+public:
+  SeqLock() : seq_(0) {
+    for (int i = 0; i < WORDS; i++) {
+      data_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Publish a new value.
+   */
+  void write(const T &value) {
+    uint32_t words[WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+
+    unsigned int seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < WORDS; i++) {
+      data_[i].store(words[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  /**
+   * @return A consistent copy of the latest value.
+   */
+  T read() const {
+    T value;
+    while (!tryRead(value)) {
+    }
+    return value;
+  }
+
+  /**
+   * Copy the latest value once, without retrying.
+   *
+   * @return false if a write overlapped the copy, leaving value unchanged.
+   */
+  bool tryRead(T &value) const {
+    uint32_t words[WORDS];
+    unsigned int before = seq_.load(std::memory_order_acquire);
+    if (before & 1) {
+      return false;
+    }
+    for (int i = 0; i < WORDS; i++) {
+      words[i] = data_[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq_.load(std::memory_order_relaxed) != before) {
+      return false;
+    }
+    memcpy(&value, words, sizeof(T));
+    return true;
+  }
+
+  /**
+   * @return Number of writes so far, which readers can use to spot a change.
+   */
+  unsigned int version() const {
+    return seq_.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  enum { WORDS = (sizeof(T) + 3) / 4 };
+
+  std::atomic<unsigned int> seq_;
+  std::atomic<uint32_t> data_[WORDS];
+};
+
+#endif /* SEQ_LOCK_H */
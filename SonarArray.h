@@ -0,0 +1,563 @@
+/**
+ * Round-robin scheduler for several distance sensors.
+ *
+ * The array owns the timing of a set of sensors of one RangeSensor driver
+ * type, listed in physical order (sensor i sits next to sensors i - 1 and
+ * i + 1). It is a template on the driver, so every call into the driver is
+ * resolved at compile time. Only one sensor is pinged at a time, and the next
+ * ping is fired from the completion callback of the previous one, so the
+ * array runs by itself once started.
+ *
+ * Pings are staggered so that sensors do not hear each other's echoes:
+ *   - a sensor is never pinged while another measurement is in flight,
+ *   - after a neighbour's measurement, the next ping waits the driver's
+ *     settle time for the neighbour's residual echoes to die away,
+ *   - each sensor is pinged at most once every cycle of the driver, such as
+ *     the 60 ms the HC-SR04 datasheet asks for.
+ * The round-robin order visits every other sensor first (0, 2, 4, ..., 1, 3,
+ * ...), so consecutive pings are usually not neighbours and need no settle
+ * time. A non-neighbour can fire as soon as the previous echo has been
+ * captured, which keeps the total sample rate as high as the sound allows.
+ *
+ * The ping rate adapts to what the sensors see. While a target is within
+ * SONAR_NEAR_CM of a threshold or closing in faster than SONAR_CLOSING_CM_S,
+ * each sensor is pinged as often as its cycle allows. With a target in range
+ * the array slows down to one round every SONAR_NORMAL_US, and with nothing
+ * in range to one every SONAR_IDLE_US. Speeding up is immediate; slowing down
+ * goes one step at a time, each after SONAR_HOLD_US without a reason to stay.
+ *
+ * Every sample is passed through the sensor's SonarFilter as it arrives. The
+ * result is a table holding the latest raw distance and filtered estimate of
+ * each sensor, which the alarm logic reads along with each sensor's own
+ * threshold.
+ */
+
+#ifndef SONAR_ARRAY_H
+#define SONAR_ARRAY_H
+
+#include "DistanceFilter.h"
+#include "RangeSensor.h"
+#include "Trace.h"
+#include "mbed.h"
+
+// Most sensors one array can drive.
+#define SONAR_MAX_SENSORS 8
+
+// Wait in microseconds before trying again a sensor that was not ready.
+#define SONAR_RETRY_US 10000
+
+// Interval in microseconds between pings of one sensor at the slower rates.
+// The fast rate is the driver's cycle.
+#define SONAR_NORMAL_US 250000
+#define SONAR_IDLE_US 2000000
+
+// How far in centimeters beyond a threshold a target still counts as near.
+#define SONAR_NEAR_CM 50
+
+// Speed in centimeters per second above which a target counts as closing in.
+#define SONAR_CLOSING_CM_S 30
+
+// How long in microseconds a rate is kept after it was last needed.
+#define SONAR_HOLD_US 2000000
+
+// Distance reported for a sensor with no target in range.
+#define SONAR_NO_TARGET RANGE_NO_TARGET
+
+// Estimates beyond this many centimeters count as no target.
+#define SONAR_RANGE_CM 400
+
+// Value in centimeters a missing echo is filtered as.
+#define SONAR_FAR_CM 450
+
+// Number of samples the median is taken over.
+#define SONAR_MEDIAN_SIZE 5
+
+/**
+ * Filter pipeline for one sensor: a spike gate that drops single jumps of
+ * more than 50 cm, a median over SONAR_MEDIAN_SIZE samples and an alpha-beta
+ * tracker that smooths the result.
+ */
+class SonarFilter
+    : public FilterChain<
+          float, SpikeGate<float>,
+          FilterChain<float, SlidingMedian<float, SONAR_MEDIAN_SIZE>,
+                      AlphaBeta<float> > > {
+public:
+  SonarFilter()
+      : FilterChain(SpikeGate<float>(2.0f, SONAR_FAR_CM, 50.0f, 2),
+                    FilterChain<float, SlidingMedian<float, SONAR_MEDIAN_SIZE>,
+                                AlphaBeta<float> >(
+                        SlidingMedian<float, SONAR_MEDIAN_SIZE>(),
+                        AlphaBeta<float>(0.6f, 0.2f))) {}
+};
+
+template <typename Sensor> class SonarArray {
+public:
+  // Ping rates, fastest first.
+  enum Rate { FAST, NORMAL, IDLE };
+
+  /**
+   * Constructor
+   *
+   * @param sensors Sensors in physical order, neighbours next to each other.
+   * @param count   Number of sensors, at most SONAR_MAX_SENSORS.
+   */
+  SonarArray(Sensor *sensors[], int count);
+
+  /**
+   * Start pinging the sensors. Returns immediately; the array keeps itself
+   * running from interrupts until stop() is called.
+   */
+  void start();
+
+  /**
+   * Stop pinging once the measurement in flight, if any, has finished.
+   */
+  void stop();
+
+  /**
+   * @return Number of sensors in the array.
+   */
+  int count();
+
+  /**
+   * @param sensor Index of the sensor.
+   * @return The sensor's own reading behind the latest distance, such as the
+   *         echo width in microseconds, or -1.
+   */
+  int echo(int sensor);
+
+  /**
+   * @param sensor Index of the sensor.
+   * @return The latest distance in centimeters, or SONAR_NO_TARGET.
+   */
+  int distance(int sensor);
+
+  /**
+   * @param sensor Index of the sensor.
+   * @return The filtered distance in centimeters, or SONAR_NO_TARGET.
+   */
+  int estimate(int sensor);
+
+  /**
+   * @param sensor Index of the sensor.
+   * @return Number of measurements the sensor has completed.
+   */
+  unsigned int samples(int sensor);
+
+  /**
+   * Set the distance below which a sensor reports a violation.
+   *
+   * @param sensor Index of the sensor.
+   * @param cm     Threshold in centimeters.
+   */
+  void setThreshold(int sensor, int cm);
+
+  /**
+   * Set the same threshold on every sensor.
+   *
+   * @param cm Threshold in centimeters.
+   */
+  void setThresholds(int cm);
+
+  /**
+   * @param sensor Index of the sensor.
+   * @return The sensor's threshold in centimeters.
+   */
+  int threshold(int sensor);
+
+  /**
+   * @param sensor Index of the sensor.
+   * @return true if the sensor's estimate is closer than its threshold.
+   */
+  bool violation(int sensor);
+
+  /**
+   * @return true if any sensor's estimate is closer than its threshold.
+   */
+  bool anyViolation();
+
+  /**
+   * @param sensor If not NULL, set to the index of the closest sensor.
+   * @return The smallest estimate in the table, or SONAR_NO_TARGET.
+   */
+  int closest(int *sensor = NULL);
+
+  /**
+   * @return The current ping rate.
+   */
+  Rate rate();
+
+  /**
+   * @return Interval in milliseconds between pings of one sensor at the
+   *         current rate.
+   */
+  int interval();
+
+  /**
+   * @return Number of times the rate has changed since construction.
+   */
+  unsigned int rateChanges();
+
+  /**
+   * @return Trace::now() when the ping behind the newest sample was
+   *         triggered, to time what the sample leads to.
+   */
+  uint32_t sampledAt();
+
+  /**
+   * Block the calling thread until a sensor completes a measurement.
+   *
+   * @param ms Longest time to wait in milliseconds.
+   * @return true if a measurement completed, false on timeout.
+   */
+  bool wait(int ms);
+
+private:
+  void fire();
+  void complete();
+  void scheduleNext();
+  bool neighbours(int a, int b);
+  void adapt(int sensor);
+
+  Sensor *sensors_[SONAR_MAX_SENSORS];
+  int count_;
+
+  // Ping order, every other sensor first.
+  int order_[SONAR_MAX_SENSORS];
+  int position_;
+
+  // The sensor whose measurement is in flight, or was the last one.
+  volatile int current_;
+  volatile bool running_;
+
+  int threshold_[SONAR_MAX_SENSORS];
+  volatile int echo_[SONAR_MAX_SENSORS];
+  volatile int distance_[SONAR_MAX_SENSORS];
+  volatile int estimate_[SONAR_MAX_SENSORS];
+  SonarFilter filter_[SONAR_MAX_SENSORS];
+  volatile unsigned int samples_[SONAR_MAX_SENSORS];
+
+  // When each sensor was last pinged, from timer_.
+  unsigned int lastPing_[SONAR_MAX_SENSORS];
+  bool pinged_[SONAR_MAX_SENSORS];
+
+  // Trace::now() when each sensor was last triggered, and the stamp of the
+  // trigger behind the newest sample.
+  uint32_t triggered_[SONAR_MAX_SENSORS];
+  volatile uint32_t sampledAt_;
+
+  // Each sensor's previous estimate and when it was taken, for its speed.
+  int previous_[SONAR_MAX_SENSORS];
+  unsigned int previousAt_[SONAR_MAX_SENSORS];
+  bool closing_[SONAR_MAX_SENSORS];
+
+  volatile Rate rate_;
+  // When the current rate was last needed.
+  unsigned int rateSince_;
+  volatile unsigned int rateChanges_;
+
+  EventFlags sampled_;
+
+  // Both run from the low power ticker, so the core can stay in deep sleep
+  // while it waits for the next ping.
+  LowPowerTimer timer_;
+  LowPowerTimeout next_;
+};
+
+//------------------Implementation----------------------------------------------
+
+template <typename Sensor>
+SonarArray<Sensor>::SonarArray(Sensor *sensors[], int count) {
+  count_ = count > SONAR_MAX_SENSORS ? SONAR_MAX_SENSORS : count;
+  position_ = 0;
+  current_ = -1;
+  running_ = false;
+  rate_ = FAST;
+  rateSince_ = 0;
+  rateChanges_ = 0;
+  sampledAt_ = 0;
+
+  for (int i = 0; i < count_; i++) {
+    sensors_[i] = sensors[i];
+    threshold_[i] = 0;
+    echo_[i] = -1;
+    distance_[i] = SONAR_NO_TARGET;
+    estimate_[i] = SONAR_NO_TARGET;
+    samples_[i] = 0;
+    lastPing_[i] = 0;
+    pinged_[i] = false;
+    triggered_[i] = 0;
+    previous_[i] = SONAR_NO_TARGET;
+    previousAt_[i] = 0;
+    closing_[i] = false;
+
+    sensors_[i]->attach(callback(this, &SonarArray<Sensor>::complete));
+  }
+
+  // Visit every other sensor first so consecutive pings are rarely neighbours.
+  int n = 0;
+  for (int i = 0; i < count_; i += 2) {
+    order_[n++] = i;
+  }
+  for (int i = 1; i < count_; i += 2) {
+    order_[n++] = i;
+  }
+}
+
+template <typename Sensor>
+void SonarArray<Sensor>::start() {
+  if (running_ || count_ == 0) {
+    return;
+  }
+  running_ = true;
+  timer_.start();
+  fire();
+}
+
+template <typename Sensor>
+void SonarArray<Sensor>::stop() {
+  running_ = false;
+  next_.detach();
+}
+
+template <typename Sensor>
+int SonarArray<Sensor>::count() { return count_; }
+
+template <typename Sensor>
+int SonarArray<Sensor>::echo(int sensor) { return echo_[sensor]; }
+
+template <typename Sensor>
+int SonarArray<Sensor>::distance(int sensor) { return distance_[sensor]; }
+
+template <typename Sensor>
+int SonarArray<Sensor>::estimate(int sensor) { return estimate_[sensor]; }
+
+template <typename Sensor>
+unsigned int SonarArray<Sensor>::samples(int sensor) {
+  return samples_[sensor];
+}
+
+template <typename Sensor>
+void SonarArray<Sensor>::setThreshold(int sensor, int cm) {
+  threshold_[sensor] = cm;
+}
+
+template <typename Sensor>
+void SonarArray<Sensor>::setThresholds(int cm) {
+  for (int i = 0; i < count_; i++) {
+    threshold_[i] = cm;
+  }
+}
+
+template <typename Sensor>
+int SonarArray<Sensor>::threshold(int sensor) { return threshold_[sensor]; }
+
+template <typename Sensor>
+bool SonarArray<Sensor>::violation(int sensor) {
+  int cm = estimate_[sensor];
+  return cm != SONAR_NO_TARGET && cm < threshold_[sensor];
+}
+
+template <typename Sensor>
+bool SonarArray<Sensor>::anyViolation() {
+  for (int i = 0; i < count_; i++) {
+    if (violation(i)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Sensor>
+int SonarArray<Sensor>::closest(int *sensor) {
+  int best = SONAR_NO_TARGET;
+  int index = -1;
+  for (int i = 0; i < count_; i++) {
+    int cm = estimate_[i];
+    if (cm != SONAR_NO_TARGET && (best == SONAR_NO_TARGET || cm < best)) {
+      best = cm;
+      index = i;
+    }
+  }
+  if (sensor != NULL) {
+    *sensor = index;
+  }
+  return best;
+}
+
+template <typename Sensor>
+typename SonarArray<Sensor>::Rate SonarArray<Sensor>::rate() {
+  return rate_;
+}
+
+template <typename Sensor>
+int SonarArray<Sensor>::interval() {
+  if (rate_ == FAST) {
+    return Sensor::cycleUs() / 1000;
+  } else if (rate_ == NORMAL) {
+    return SONAR_NORMAL_US / 1000;
+  }
+  return SONAR_IDLE_US / 1000;
+}
+
+template <typename Sensor>
+unsigned int SonarArray<Sensor>::rateChanges() {
+  return rateChanges_;
+}
+
+template <typename Sensor>
+uint32_t SonarArray<Sensor>::sampledAt() { return sampledAt_; }
+
+template <typename Sensor>
+bool SonarArray<Sensor>::wait(int ms) {
+  return (sampled_.wait_any(1, ms) & osFlagsError) == 0;
+}
+
+//------------------Scheduling (interrupt context or driver thread)----------
+
+template <typename Sensor>
+bool SonarArray<Sensor>::neighbours(int a, int b) {
+  return a >= 0 && (a - b == 1 || b - a == 1);
+}
+
+// Ping the next sensor in the round-robin order.
+template <typename Sensor>
+void SonarArray<Sensor>::fire() {
+  if (!running_) {
+    return;
+  }
+
+  int sensor = order_[position_];
+  position_ = (position_ + 1) % count_;
+
+  current_ = sensor;
+  lastPing_[sensor] = timer_.read_us();
+  pinged_[sensor] = true;
+  triggered_[sensor] = Trace::now();
+  Trace::point(TRACE_TRIGGER, sensor);
+  Trace::boot(TRACE_BOOT_SONARS);
+
+  // The sensor is not ready, such as an HC-SR04 still holding its echo line
+  // high from an earlier ping, so skip it this round and give it time to
+  // recover.
+  if (!sensors_[sensor]->ping()) {
+    next_.attach(callback(this, &SonarArray<Sensor>::fire),
+                 std::chrono::microseconds(SONAR_RETRY_US));
+  }
+}
+
+// Called by the driver of the sensor in flight when it has a result.
+template <typename Sensor>
+void SonarArray<Sensor>::complete() {
+  int sensor = current_;
+  int cm = sensors_[sensor]->readCm();
+  uint32_t begin = Trace::now();
+  Trace::span(TRACE_SPAN_ECHO, triggered_[sensor]);
+
+  echo_[sensor] = sensors_[sensor]->raw();
+  distance_[sensor] = cm;
+  samples_[sensor]++;
+
+  // A missing echo is filtered as a far target, so a single dropout does not
+  // clear a real one.
+  float value = cm == SONAR_NO_TARGET ? SONAR_FAR_CM : cm;
+  if (filter_[sensor].update(value)) {
+    estimate_[sensor] = value > SONAR_RANGE_CM ? SONAR_NO_TARGET : (int)value;
+  }
+
+  adapt(sensor);
+  Trace::point(TRACE_FILTER, estimate_[sensor]);
+  Trace::span(TRACE_SPAN_FILTER, begin);
+
+  sampledAt_ = triggered_[sensor];
+  sampled_.set(1);
+
+  scheduleNext();
+}
+
+// Fire the next sensor as soon as it is allowed to, right away if possible.
+template <typename Sensor>
+void SonarArray<Sensor>::scheduleNext() {
+  if (!running_) {
+    return;
+  }
+
+  int next = order_[position_];
+  unsigned int wait = 0;
+
+  // Let a neighbour's residual echoes die away first.
+  if (neighbours(current_, next)) {
+    wait = Sensor::settleUs();
+  }
+
+  // Ping each sensor once per interval of the current rate.
+  unsigned int cycle = interval() * 1000;
+  if (pinged_[next]) {
+    unsigned int since = (unsigned int)timer_.read_us() - lastPing_[next];
+    if (since < cycle && cycle - since > wait) {
+      wait = cycle - since;
+    }
+  }
+
+  if (wait == 0) {
+    fire();
+  } else {
+    next_.attach(callback(this, &SonarArray<Sensor>::fire),
+                 std::chrono::microseconds(wait));
+  }
+}
+
+// Pick the ping rate after a sample from sensor.
+template <typename Sensor>
+void SonarArray<Sensor>::adapt(int sensor) {
+  unsigned int now = timer_.read_us();
+
+  // Work out how fast this sensor's target is approaching.
+  int cm = estimate_[sensor];
+  closing_[sensor] = false;
+  if (cm != SONAR_NO_TARGET && previous_[sensor] != SONAR_NO_TARGET) {
+    long long approach = (previous_[sensor] - cm) * 1000000LL;
+    long long elapsed = now - previousAt_[sensor];
+    closing_[sensor] = approach > SONAR_CLOSING_CM_S * elapsed;
+  }
+  previous_[sensor] = cm;
+  previousAt_[sensor] = now;
+
+  // The fastest rate any sensor needs. Raw distances count too, so a new
+  // target the filters have not confirmed yet is confirmed quickly.
+  Rate want = IDLE;
+  for (int i = 0; i < count_; i++) {
+    int nearest = estimate_[i];
+    if (nearest == SONAR_NO_TARGET ||
+        (distance_[i] != SONAR_NO_TARGET && distance_[i] < nearest)) {
+      nearest = distance_[i];
+    }
+    if (nearest == SONAR_NO_TARGET) {
+      continue;
+    }
+    if (closing_[i] || nearest < threshold_[i] + SONAR_NEAR_CM) {
+      want = FAST;
+      break;
+    }
+    want = NORMAL;
+  }
+
+  Rate rate = rate_;
+  if (want <= rate) {
+    // Speed up straight away, and keep the current rate while it is needed.
+    rate = want;
+    rateSince_ = now;
+  } else if (now - rateSince_ >= SONAR_HOLD_US) {
+    // Not needed for a while, so slow down one step.
+    rate = (Rate)(rate + 1);
+    rateSince_ = now;
+  }
+
+  if (rate != rate_) {
+    rate_ = rate;
+    rateChanges_++;
+  }
+}
+
+#endif /* SONAR_ARRAY_H */
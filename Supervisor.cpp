@@ -0,0 +1,134 @@
+#include "Supervisor.h"
+#include <cstddef>
+#include <cstring>
+
+// Marks a valid record of a miss.
+#define SUPERVISOR_MAGIC 0x48425431
+
+// The record of a miss.
+struct MissRecord {
+  uint32_t magic;
+  Supervisor::Miss miss;
+  uint32_t checksum;
+};
+
+// The crash data RAM the Mbed GCC linker scripts reserve for the platform's
+// crash capture. The startup code neither copies nor clears it.
+extern "C" uint32_t __CRASH_DATA_RAM_START__[];
+extern "C" uint32_t __CRASH_DATA_RAM_END__[];
+
+// The record goes at the end of the crash data RAM, clear of the fault and
+// error context the crash capture writes from its start, so the two can be
+// enabled together.
+static MissRecord &record() {
+  return *(MissRecord *)((uintptr_t)__CRASH_DATA_RAM_END__ -
+                         sizeof(MissRecord));
+}
+
+// Whether the linker script reserved room for the record.
+static bool recordFits() {
+  return (uintptr_t)__CRASH_DATA_RAM_END__ -
+             (uintptr_t)__CRASH_DATA_RAM_START__ >=
+         sizeof(MissRecord);
+}
+
+// Rotating sum of the record's words before the checksum, inverted so that
+// all zeros does not check out.
+static uint32_t checksum(const MissRecord &r) {
+  const uint32_t *words = (const uint32_t *)&r;
+  uint32_t sum = 0;
+  for (size_t i = 0; i < offsetof(MissRecord, checksum) / 4; i++) {
+    sum = (sum << 1 | sum >> 31) + words[i];
+  }
+  return ~sum;
+}
+
+Supervisor::Supervisor(Watchdog &dog) : dog_(dog) {
+  count_ = 0;
+  late_ = -1;
+  elapsedMs_ = 0;
+}
+
+int Supervisor::add(const char *name, uint32_t deadlineMs) {
+  if (count_ == SUPERVISOR_MAX_TASKS) {
+    return -1;
+  }
+  Task &task = tasks_[count_];
+  task.name = name;
+  task.deadlineMs = deadlineMs;
+  task.beaten.store(false, std::memory_order_relaxed);
+  task.ageMs = 0;
+  return count_++;
+}
+
+void Supervisor::start(uint32_t timeoutMs) {
+  dog_.start(timeoutMs);
+  ticker_.attach(callback(this, &Supervisor::check),
+                 std::chrono::milliseconds(SUPERVISOR_CHECK_MS));
+}
+
+void Supervisor::beat(int task) {
+  tasks_[task].beaten.store(true, std::memory_order_relaxed);
+}
+
+int Supervisor::late() { return late_; }
+
+bool Supervisor::missed(Miss &miss) {
+  if (!recordFits()) {
+    return false;
+  }
+  MissRecord &r = record();
+  if (r.magic != SUPERVISOR_MAGIC || r.checksum != checksum(r)) {
+    return false;
+  }
+  miss = r.miss;
+  miss.task[SUPERVISOR_NAME_MAX - 1] = 0;
+  r.magic = 0;
+  return true;
+}
+
+//------------------Checks (interrupt context)--------------------------------
+
+void Supervisor::check() {
+  // Once a task has missed, let the watchdog reset the system.
+  if (late_ >= 0) {
+    return;
+  }
+
+  elapsedMs_ += SUPERVISOR_CHECK_MS;
+
+  // Age every task that has not beaten since the last check, and find the
+  // one furthest past its deadline, if any.
+  int worst = -1;
+  uint32_t worstLate = 0;
+  for (int i = 0; i < count_; i++) {
+    Task &task = tasks_[i];
+    if (task.beaten.exchange(false, std::memory_order_relaxed)) {
+      task.ageMs = 0;
+    } else {
+      task.ageMs += SUPERVISOR_CHECK_MS;
+    }
+    if (task.ageMs > task.deadlineMs &&
+        task.ageMs - task.deadlineMs >= worstLate) {
+      worst = i;
+      worstLate = task.ageMs - task.deadlineMs;
+    }
+  }
+
+  if (worst < 0) {
+    dog_.kick();
+    return;
+  }
+
+  late_ = worst;
+  if (!recordFits()) {
+    return;
+  }
+  MissRecord &r = record();
+  r.magic = SUPERVISOR_MAGIC;
+  strncpy(r.miss.task, tasks_[worst].name, SUPERVISOR_NAME_MAX - 1);
+  r.miss.task[SUPERVISOR_NAME_MAX - 1] = 0;
+  r.miss.lateMs = worstLate;
+  r.miss.atMs = elapsedMs_;
+  r.checksum = checksum(r);
+}
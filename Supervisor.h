@@ -0,0 +1,123 @@
+/**
+ * Heartbeat supervisor in front of the hardware watchdog.
+ *
+ * Each task the system depends on is added with a deadline and posts a
+ * heartbeat with beat() whenever it has done its work. A low power ticker
+ * checks every SUPERVISOR_CHECK_MS that every task has beaten within its
+ * deadline, and only then kicks the watchdog. A beat only sets a flag and the
+ * checks count the time since each task's last beat themselves, so a beat is
+ * cheap from anywhere and the times are accurate to SUPERVISOR_CHECK_MS.
+ *
+ * Once a task misses, the watchdog is never kicked again, so the system resets
+ * within the watchdog timeout even if the task recovers.
+ *
+ * Tasks that only run when another task drives them should be given longer
+ * deadlines than the task driving them, so that when the driver gets stuck it
+ * is the first one to miss.
+ *
+ * The first miss is recorded, with the task's name and how late it was, at the
+ * end of the crash data RAM that the Mbed GCC linker scripts reserve and the
+ * startup code neither copies nor clears, so it survives the reset. missed()
+ * reads it back after the next startup. A magic number and a checksum tell a
+ * record apart from whatever RAM held at power on. With no crash data RAM in
+ * the linker script, nothing is recorded.
+ */
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "mbed.h"
+#include <atomic>
+#include <stdint.h>
+
+// Most tasks one supervisor can watch.
+#define SUPERVISOR_MAX_TASKS 8
+
+// Interval in milliseconds between checks, and so between watchdog kicks.
+#define SUPERVISOR_CHECK_MS 1000
+
+// Characters of a task's name kept in the record of a miss.
+#define SUPERVISOR_NAME_MAX 12
+
+class Supervisor {
+public:
+  /**
+   * A missed heartbeat, as recorded before a reset.
+   */
+  struct Miss {
+    char task[SUPERVISOR_NAME_MAX];
+    // How much longer than its deadline the task had gone without a beat.
+    uint32_t lateMs;
+    // Milliseconds from start() to the miss.
+    uint32_t atMs;
+  };
+
+  /**
+   * Constructor
+   *
+   * @param dog The watchdog to kick while every task is healthy.
+   */
+  Supervisor(Watchdog &dog);
+
+  /**
+   * Add a task. Its deadline starts counting at start(). Only call this
+   * before start().
+   *
+   * @param name       Name for the record of a miss, kept as a pointer.
+   * @param deadlineMs Longest time in milliseconds between two beats.
+   * @return The task's index for beat(), or -1 if there is no room.
+   */
+  int add(const char *name, uint32_t deadlineMs);
+
+  /**
+   * Start the watchdog and the checks.
+   *
+   * @param timeoutMs Watchdog timeout in milliseconds, longer than
+   *                  SUPERVISOR_CHECK_MS.
+   */
+  void start(uint32_t timeoutMs);
+
+  /**
+   * Post a heartbeat for a task. Safe to call from any thread or interrupt.
+   *
+   * @param task Index returned by add().
+   */
+  void beat(int task);
+
+  /**
+   * @return Index of the task that missed, or -1 while all are healthy.
+   */
+  int late();
+
+  /**
+   * Read the miss recorded before the last reset, if any, and forget it.
+   *
+   * @param miss Set to the record if there is one.
+   * @return true if a miss was recorded.
+   */
+  static bool missed(Miss &miss);
+
+private:
+  void check();
+
+  struct Task {
+    const char *name;
+    uint32_t deadlineMs;
+    // Set by beat(), taken by check().
+    std::atomic<bool> beaten;
+    // Time since the last beat, counted by check().
+    uint32_t ageMs;
+  };
+
+  Watchdog &dog_;
+  Task tasks_[SUPERVISOR_MAX_TASKS];
+  int count_;
+  volatile int late_;
+
+  // Time since start(), counted by check().
+  uint32_t elapsedMs_;
+
+  LowPowerTicker ticker_;
+};
+
+#endif /* SUPERVISOR_H */
@@ -0,0 +1,33 @@
+#include "SystemState.h"
+
+SystemState::SystemState() : word_(0) {}
+
+int SystemState::toggleMode() {
+  uint32_t old = word_.load(std::memory_order_relaxed);
+  uint32_t next;
+  do {
+    next = ((old ^ MODE_BIT) | REDRAW_BIT) + PRESS_ONE;
+  } while (!word_.compare_exchange_weak(old, next, std::memory_order_acq_rel,
+                                        std::memory_order_relaxed));
+  return next & MODE_BIT ? MODE_SETTINGS : MODE_DEFAULT;
+}
+
+int SystemState::mode() const {
+  return word_.load(std::memory_order_acquire) & MODE_BIT ? MODE_SETTINGS
+                                                          : MODE_DEFAULT;
+}
+
+bool SystemState::settings() const { return mode() == MODE_SETTINGS; }
+
+void SystemState::requestRedraw() {
+  word_.fetch_or(REDRAW_BIT, std::memory_order_release);
+}
+
+bool SystemState::takeRedraw() {
+  return word_.fetch_and(~(uint32_t)REDRAW_BIT, std::memory_order_acq_rel) &
+         REDRAW_BIT;
+}
+
+unsigned int SystemState::presses() const {
+  return word_.load(std::memory_order_acquire) >> PRESS_SHIFT;
+}
@@ -0,0 +1,89 @@
+/**
+ * State shared between the user button, the menu logic and the sensing loop.
+ *
+ * The menu mode, the "top line needs redrawing" flag and a count of button
+ * presses live together in one atomic word. Every change is a single atomic
+ * read-modify-write, so the button handler and the main loop can both change
+ * it at any time without a mutex, and a reader always sees the three fields
+ * as they were after one complete change.
+ *
+ * The settings the sensing loop works from are published separately as a
+ * Config snapshot through a SeqLock.
+ */
+
+#ifndef SYSTEM_STATE_H
+#define SYSTEM_STATE_H
+
+#include "SeqLock.h"
+#include <atomic>
+#include <stdint.h>
+
+// Menu modes.
+#define MODE_DEFAULT 0
+#define MODE_SETTINGS 1
+
+/**
+ * Settings the sensing loop works from.
+ */
+struct Config {
+  // Alarm threshold in centimeters.
+  int32_t minDistance;
+
+  // Current interval between pings of one sensor, in milliseconds.
+  int32_t interval;
+
+  // MODE_DEFAULT or MODE_SETTINGS.
+  int32_t mode;
+};
+
+class SystemState {
+public:
+  SystemState();
+
+  /**
+   * Switch between the default and settings menus, ask for the top line to
+   * be redrawn and count the press, all in one step.
+   *
+   * @return The new mode.
+   */
+  int toggleMode();
+
+  /**
+   * @return MODE_DEFAULT or MODE_SETTINGS.
+   */
+  int mode() const;
+
+  /**
+   * @return true in the settings menu.
+   */
+  bool settings() const;
+
+  /**
+   * Ask for the top line of the LCD to be redrawn.
+   */
+  void requestRedraw();
+
+  /**
+   * Claim a pending redraw request.
+   *
+   * @return true if a redraw was requested, which is now cleared.
+   */
+  bool takeRedraw();
+
+  /**
+   * @return Number of button presses since startup.
+   */
+  unsigned int presses() const;
+
+private:
+  enum {
+    MODE_BIT = 1U << 0,
+    REDRAW_BIT = 1U << 1,
+    PRESS_SHIFT = 8,
+    PRESS_ONE = 1U << PRESS_SHIFT
+  };
+
+  std::atomic<uint32_t> word_;
+};
+
+#endif /* SYSTEM_STATE_H */
@@ -0,0 +1,164 @@
+#include "Telemetry.h"
+
+Telemetry::Telemetry(PinName tx, int baud)
+    : serial_(tx, NC, baud), head_(0), tail_(0) {
+
+  sending_ = false;
+  seq_ = 0;
+  frames_ = 0;
+  dropped_ = 0;
+  bytes_ = 0;
+  forget();
+
+  // Start with a delimiter, so the first frame decodes even if the reader
+  // saw noise while the pin was set up. It goes out with the first frame.
+  ring_[0] = 0;
+  head_.store(1, std::memory_order_release);
+}
+
+bool Telemetry::sample(int sensor, uint32_t ms, int echoUs, int cm,
+                       int threshold, bool alarm) {
+  if (sensor < 0 || sensor >= TLM_MAX_SENSORS) {
+    return false;
+  }
+
+  bool key = stale_ || untilKey_[sensor] == 0 || threshold != threshold_;
+
+  // The reader already knows an unchanged sample, so it is left out.
+  if (!key && cm == cm_[sensor] && alarm == alarm_[sensor]) {
+    untilKey_[sensor]--;
+    return true;
+  }
+
+  uint8_t frame[TLM_MAX_FRAME];
+  int n = 0;
+  frame[n++] = TLM_TYPE_SAMPLE | (key ? TLM_KEY : 0) |
+               (alarm ? TLM_ALARM : 0) | (sensor << TLM_SENSOR_SHIFT);
+  frame[n++] = seq_;
+  if (key) {
+    n += tlmPutVarint(frame + n, ms);
+    n += tlmPutVarint(frame + n, tlmZigzag(echoUs));
+    n += tlmPutVarint(frame + n, tlmZigzag(cm));
+    n += tlmPutVarint(frame + n, tlmZigzag(threshold));
+  } else {
+    n += tlmPutVarint(frame + n, ms - lastMs_);
+    n += tlmPutVarint(frame + n, tlmZigzag(echoUs - echo_[sensor]));
+    n += tlmPutVarint(frame + n, tlmZigzag(cm - cm_[sensor]));
+  }
+
+  if (!send(frame, n)) {
+    return false;
+  }
+
+  // Only what the reader has been sent becomes the base for the next delta.
+  lastMs_ = ms;
+  threshold_ = threshold;
+  echo_[sensor] = echoUs;
+  cm_[sensor] = cm;
+  alarm_[sensor] = alarm;
+  stale_ = false;
+  untilKey_[sensor] = key ? TELEMETRY_KEY_EVERY - 1 : untilKey_[sensor] - 1;
+  return true;
+}
+
+bool Telemetry::config(uint32_t ms, int threshold, int interval, int mode) {
+  uint8_t frame[TLM_MAX_FRAME];
+  int n = 0;
+  frame[n++] = TLM_TYPE_CONFIG | TLM_KEY;
+  frame[n++] = seq_;
+  n += tlmPutVarint(frame + n, ms);
+  n += tlmPutVarint(frame + n, tlmZigzag(threshold));
+  n += tlmPutVarint(frame + n, interval);
+  n += tlmPutVarint(frame + n, mode);
+
+  if (!send(frame, n)) {
+    return false;
+  }
+
+  lastMs_ = ms;
+  threshold_ = threshold;
+  stale_ = false;
+  return true;
+}
+
+unsigned int Telemetry::frames() { return frames_; }
+
+unsigned int Telemetry::dropped() { return dropped_; }
+
+unsigned int Telemetry::bytes() { return bytes_; }
+
+unsigned int Telemetry::sent() {
+  return tail_.load(std::memory_order_acquire);
+}
+
+unsigned int Telemetry::pending() {
+  return head_.load(std::memory_order_relaxed) -
+         tail_.load(std::memory_order_acquire);
+}
+
+// Add the CRC, encode the frame into the ring and start sending it.
+bool Telemetry::send(const uint8_t *frame, int length) {
+  uint8_t raw[TLM_MAX_FRAME];
+  memcpy(raw, frame, length);
+  uint16_t crc = tlmCrc16(raw, length);
+  raw[length++] = crc >> 8;
+  raw[length++] = crc & 0xFF;
+
+  uint8_t encoded[TLM_MAX_ENCODED];
+  int size = tlmCobsEncode(raw, length, encoded);
+  encoded[size++] = 0;
+
+  // The sequence number counts dropped frames too, so the reader sees a gap.
+  seq_++;
+
+  unsigned int head = head_.load(std::memory_order_relaxed);
+  if (TELEMETRY_RING_SIZE - (head - tail_.load(std::memory_order_acquire)) <
+      (unsigned int)size) {
+    dropped_++;
+    forget();
+    return false;
+  }
+
+  for (int i = 0; i < size; i++) {
+    ring_[(head + i) % TELEMETRY_RING_SIZE] = encoded[i];
+  }
+  head_.store(head + size, std::memory_order_release);
+  frames_++;
+  bytes_ += size;
+
+  kick();
+  return true;
+}
+
+// After a drop, the reader has lost track, so start again from key frames.
+void Telemetry::forget() {
+  stale_ = true;
+  for (int i = 0; i < TLM_MAX_SENSORS; i++) {
+    untilKey_[i] = 0;
+  }
+}
+
+// Attach the transmit interrupt if it is not already draining the ring.
+void Telemetry::kick() {
+  CriticalSectionLock lock;
+  if (!sending_) {
+    sending_ = true;
+    serial_.attach(callback(this, &Telemetry::txReady), SerialBase::TxIrq);
+  }
+}
+
+//------------------Interrupt handler---------------------------------------
+
+// The UART can take another byte.
+void Telemetry::txReady() {
+  unsigned int tail = tail_.load(std::memory_order_relaxed);
+  if (tail == head_.load(std::memory_order_acquire)) {
+    // Nothing left, so stop the interrupt until the next frame.
+    serial_.attach(nullptr, SerialBase::TxIrq);
+    sending_ = false;
+    return;
+  }
+
+  serial_.write(&ring_[tail % TELEMETRY_RING_SIZE], 1);
+  tail_.store(tail + 1, std::memory_order_release);
+}
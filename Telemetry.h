@@ -0,0 +1,129 @@
+/**
+ * Binary telemetry stream on a spare UART.
+ *
+ * Each settings change and each sample that changed the distance or the
+ * alarm becomes a small frame, delta and varint encoded with a CRC (see
+ * TelemetryFormat.h), instead of a line of printf. Unchanged samples only
+ * count towards the next key frame.
+ * Frames are encoded into a fixed-size ring and sent by the UART's transmit
+ * interrupt one byte at a time, so sending never blocks: when the ring has no
+ * room for a whole frame, the frame is dropped and counted, and the next
+ * frames are key frames so the reader can resync.
+ *
+ * The ring is lock-free with a single producer and a single consumer, so all
+ * frames must be sent from the same thread. tools/telemetry_decode turns the
+ * stream into CSV.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "TelemetryFormat.h"
+#include "mbed.h"
+#include <atomic>
+
+// Default baud rate of the telemetry UART.
+#define TELEMETRY_BAUD 115200
+
+// Bytes the ring holds, must be a power of two.
+#define TELEMETRY_RING_SIZE 256
+
+// A sensor's samples get a key frame at least this often.
+#define TELEMETRY_KEY_EVERY 16
+
+class Telemetry {
+public:
+  /**
+   * Constructor
+   *
+   * @param tx   Transmit pin of the UART.
+   * @param baud Baud rate, 8 data bits, no parity, 1 stop bit.
+   */
+  Telemetry(PinName tx, int baud = TELEMETRY_BAUD);
+
+  /**
+   * Queue a sample frame, unless the sample can be left out.
+   *
+   * @param sensor    Index of the sensor.
+   * @param ms        Time of the sample in milliseconds.
+   * @param echoUs    Raw echo width in microseconds, or -1 for none.
+   * @param cm        Filtered distance in centimeters, or -1 for no target.
+   * @param threshold Alarm threshold in centimeters.
+   * @param alarm     Whether the sensor is in violation.
+   * @return false if the frame was dropped for lack of room; true if it was
+   *         queued or left out.
+   */
+  bool sample(int sensor, uint32_t ms, int echoUs, int cm, int threshold,
+              bool alarm);
+
+  /**
+   * Queue a config frame.
+   *
+   * @param ms        Time of the change in milliseconds.
+   * @param threshold Alarm threshold in centimeters.
+   * @param interval  Ping interval in milliseconds.
+   * @param mode      Menu mode.
+   * @return false if the frame was dropped for lack of room.
+   */
+  bool config(uint32_t ms, int threshold, int interval, int mode);
+
+  /**
+   * @return Number of frames queued since startup.
+   */
+  unsigned int frames();
+
+  /**
+   * @return Number of frames dropped because the ring was full.
+   */
+  unsigned int dropped();
+
+  /**
+   * @return Number of bytes queued since startup, delimiters included.
+   */
+  unsigned int bytes();
+
+  /**
+   * @return Number of bytes handed to the UART since startup.
+   */
+  unsigned int sent();
+
+  /**
+   * @return Number of bytes in the ring waiting to be sent.
+   */
+  unsigned int pending();
+
+private:
+  bool send(const uint8_t *frame, int length);
+  void forget();
+  void kick();
+  void txReady();
+
+  UnbufferedSerial serial_;
+
+  uint8_t ring_[TELEMETRY_RING_SIZE];
+  std::atomic<unsigned int> head_;
+  std::atomic<unsigned int> tail_;
+
+  // The transmit interrupt is attached and will drain the ring.
+  volatile bool sending_;
+
+  // What the reader was last told, for delta encoding.
+  uint8_t seq_;
+  uint32_t lastMs_;
+  int32_t threshold_;
+  int32_t echo_[TLM_MAX_SENSORS];
+  int32_t cm_[TLM_MAX_SENSORS];
+  bool alarm_[TLM_MAX_SENSORS];
+
+  // Samples left until each sensor's next key frame; 0 forces one.
+  int untilKey_[TLM_MAX_SENSORS];
+
+  // A frame was dropped, so the time and threshold have no base yet.
+  bool stale_;
+
+  unsigned int frames_;
+  unsigned int dropped_;
+  unsigned int bytes_;
+};
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,164 @@
+/**
+ * Wire format of the binary telemetry stream, shared by the firmware's
+ * Telemetry encoder and the host decoder in tools/.
+ *
+ * Every frame is COBS encoded and ends with a 0x00 byte, so a reader that
+ * starts in the middle of the stream finds the next frame at the next zero.
+ * Before encoding, a frame is:
+ *
+ *   header   1 byte   TLM_TYPE_* | TLM_KEY | TLM_ALARM | sensor << 4
+ *   seq      1 byte   counts every frame, including dropped ones
+ *   time     varint   ms since boot in key frames, else since the last frame
+ *   fields   varints  depending on the type, see below
+ *   crc      2 bytes  CRC-16/CCITT-FALSE of everything above, high byte first
+ *
+ * A key sample frame carries the raw echo in microseconds, the filtered
+ * distance and the threshold in centimeters, each zigzag encoded as absolute
+ * values. Any other sample frame carries only the echo and the distance, as
+ * the change since that sensor's last frame; the threshold is the one of the
+ * last key or config frame. The encoder sends a key frame for each sensor
+ * every so many samples, when its threshold changes and after any frame it
+ * had to drop, so a reader can pick up the deltas again after a gap in the
+ * sequence numbers. Between key frames, a sample whose distance and alarm
+ * are the same as in the sensor's last frame is not sent at all.
+ *
+ * A config frame is always a key frame. It carries the threshold (zigzag),
+ * the ping interval in milliseconds and the menu mode, each a varint.
+ *
+ * Nothing here depends on Mbed, so the host can use it as it is.
+ */
+
+#ifndef TELEMETRY_FORMAT_H
+#define TELEMETRY_FORMAT_H
+
+#include <stdint.h>
+
+// Frame types, in the low two bits of the header.
+#define TLM_TYPE_SAMPLE 0
+#define TLM_TYPE_CONFIG 1
+#define TLM_TYPE_MASK 0x03
+
+// Header flags.
+#define TLM_KEY 0x04
+#define TLM_ALARM 0x08
+#define TLM_SENSOR_SHIFT 4
+
+// Sensor indices fit in the top four bits of the header.
+#define TLM_MAX_SENSORS 16
+
+// Longest frame before COBS encoding: header, seq, four varints and the CRC.
+#define TLM_MAX_FRAME (2 + 4 * 5 + 2)
+
+// Longest frame on the wire: COBS adds one byte per 254, plus the delimiter.
+#define TLM_MAX_ENCODED (TLM_MAX_FRAME + TLM_MAX_FRAME / 254 + 2)
+
+/**
+ * Map signed values to unsigned ones so that small magnitudes of either sign
+ * stay small: 0, -1, 1, -2 ... become 0, 1, 2, 3 ...
+ */
+inline uint32_t tlmZigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t tlmUnzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * Append value seven bits at a time, low bits first, with the top bit of
+ * each byte set when more follow.
+ *
+ * @return Number of bytes written, at most 5.
+ */
+inline int tlmPutVarint(uint8_t *out, uint32_t value) {
+  int n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+/**
+ * Read a varint written by tlmPutVarint().
+ *
+ * @return Number of bytes read, or 0 if it runs past end or is too long.
+ */
+inline int tlmGetVarint(const uint8_t *in, const uint8_t *end,
+                        uint32_t &value) {
+  value = 0;
+  for (int n = 0; n < 5 && in + n < end; n++) {
+    value |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+    if (!(in[n] & 0x80)) {
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF), four bits at
+ * a time from a 16 entry table.
+ */
+inline uint16_t tlmCrc16(const uint8_t *data, int length) {
+  static const uint16_t table[16] = {
+      0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+      0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+  uint16_t crc = 0xFFFF;
+  for (int i = 0; i < length; i++) {
+    crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+    crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)]);
+  }
+  return crc;
+}
+
+/**
+ * COBS encode length bytes, removing every zero. out must have room for
+ * length + length / 254 + 1 bytes; the delimiter is not added.
+ *
+ * @return Number of bytes written.
+ */
+inline int tlmCobsEncode(const uint8_t *in, int length, uint8_t *out) {
+  int code = 0;
+  int n = 1;
+  uint8_t run = 1;
+  for (int i = 0; i < length; i++) {
+    if (in[i] != 0) {
+      out[n++] = in[i];
+      run++;
+    }
+    if (in[i] == 0 || run == 0xFF) {
+      out[code] = run;
+      code = n++;
+      run = 1;
+    }
+  }
+  out[code] = run;
+  return n;
+}
+
+/**
+ * Undo tlmCobsEncode(), without the delimiter. out may be in.
+ *
+ * @return Number of bytes decoded, or -1 if the input is not valid COBS.
+ */
+inline int tlmCobsDecode(const uint8_t *in, int length, uint8_t *out) {
+  int n = 0;
+  int i = 0;
+  while (i < length) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > length) {
+      return -1;
+    }
+    for (int j = 1; j < code; j++) {
+      out[n++] = in[i++];
+    }
+    if (code != 0xFF && i < length) {
+      out[n++] = 0;
+    }
+  }
+  return n;
+}
+
+#endif /* TELEMETRY_FORMAT_H */
@@ -0,0 +1,104 @@
+#include "TimeOfFlight.h"
+
+// Number of entries in the table, one per degree.
+#define TOF_TABLE_SIZE (TOF_MAX_C - TOF_MIN_C + 1)
+
+// Square root by Newton's method, so the table can be built at compile time.
+static constexpr double tofSqrt(double x) {
+  double guess = x > 1.0 ? x : 1.0;
+  for (int i = 0; i < 32; i++) {
+    guess = 0.5 * (guess + x / guess);
+  }
+  return guess;
+}
+
+// Q16 millimeters per microsecond of round trip at a temperature. Sound
+// travels at 331.3 m/s at 0 degrees, and m/s is mm/ms, so the one-way
+// distance per microsecond is c / 2000.
+static constexpr uint32_t tofFactor(int celsius) {
+  return (uint32_t)(331.3 * tofSqrt(1.0 + celsius / 273.15) / 2000.0 *
+                        65536.0 +
+                    0.5);
+}
+
+struct TofTable {
+  uint32_t factor[TOF_TABLE_SIZE];
+
+  constexpr TofTable() : factor() {
+    for (int i = 0; i < TOF_TABLE_SIZE; i++) {
+      factor[i] = tofFactor(TOF_MIN_C + i);
+    }
+  }
+};
+
+static constexpr TofTable table;
+
+// The table's factor at a temperature in tenths of a degree, interpolated.
+static uint32_t tableFactor(int temperature) {
+  int offset = temperature - TOF_MIN_C * 10;
+  int i = offset / 10;
+  int tenths = offset % 10;
+  if (tenths == 0) {
+    return table.factor[i];
+  }
+  return table.factor[i] +
+         ((table.factor[i + 1] - table.factor[i]) * tenths + 5) / 10;
+}
+
+TimeOfFlight::TimeOfFlight(int temperature) {
+  correction_ = 1 << 16;
+  factor_ = 0;
+  setTemperature(temperature);
+}
+
+void TimeOfFlight::setTemperature(int temperature) {
+  if (temperature < TOF_MIN_C * 10) {
+    temperature = TOF_MIN_C * 10;
+  } else if (temperature > TOF_MAX_C * 10) {
+    temperature = TOF_MAX_C * 10;
+  }
+  temperature_ = temperature;
+  update();
+}
+
+int TimeOfFlight::temperature() const { return temperature_; }
+
+bool TimeOfFlight::calibrate(int us, int mm) {
+  if (us <= 0 || mm <= 0) {
+    return false;
+  }
+
+  // The factor this measurement asks for, relative to the table's.
+  uint64_t wanted = (((uint64_t)mm << 16) + us / 2) / us;
+  uint64_t correction =
+      ((wanted << 16) + tableFactor(temperature_) / 2) /
+      tableFactor(temperature_);
+
+  return setCorrection(correction > UINT32_MAX ? UINT32_MAX
+                                              : (uint32_t)correction);
+}
+
+bool TimeOfFlight::setCorrection(uint32_t correction) {
+  uint32_t limit = (65536U * TOF_MAX_CORRECTION) / 100;
+  if (correction > 65536 + limit || correction < 65536 - limit) {
+    return false;
+  }
+  correction_ = correction;
+  update();
+  return true;
+}
+
+void TimeOfFlight::uncalibrate() {
+  correction_ = 1 << 16;
+  update();
+}
+
+uint32_t TimeOfFlight::correction() const { return correction_; }
+
+// Work out the factor in a local, so readers never see half an update.
+void TimeOfFlight::update() {
+  uint32_t factor =
+      (uint32_t)(((uint64_t)tableFactor(temperature_) * correction_ + 0x8000) >>
+                 16);
+  factor_ = factor;
+}
@@ -0,0 +1,104 @@
+/**
+ * Integer conversion of ultrasonic echo times to distances.
+ *
+ * The echo time is multiplied by a Q16 factor in millimeters per
+ * microsecond of round trip, so a conversion is one integer multiply and a
+ * shift. The factor follows the speed of sound, which grows with the square
+ * root of the absolute temperature: it is interpolated from a table built at
+ * compile time for every degree from TOF_MIN_C to TOF_MAX_C.
+ *
+ * A one-shot calibration against a target at a known distance corrects the
+ * factor for the sensor's own timing error. The correction is kept apart from
+ * the temperature, so it still applies after the temperature changes.
+ */
+
+#ifndef TIME_OF_FLIGHT_H
+#define TIME_OF_FLIGHT_H
+
+#include <stdint.h>
+
+// Temperature range of the table, in degrees Celsius.
+#define TOF_MIN_C -20
+#define TOF_MAX_C 50
+
+// Default temperature in tenths of a degree Celsius.
+#define TOF_ROOM_TEMPERATURE 200
+
+// Largest calibration correction accepted, in percent.
+#define TOF_MAX_CORRECTION 10
+
+class TimeOfFlight {
+public:
+  /**
+   * Constructor
+   *
+   * @param temperature Air temperature in tenths of a degree Celsius.
+   */
+  TimeOfFlight(int temperature = TOF_ROOM_TEMPERATURE);
+
+  /**
+   * Set the air temperature. Temperatures outside the table are clamped.
+   *
+   * @param temperature Air temperature in tenths of a degree Celsius.
+   */
+  void setTemperature(int temperature);
+
+  /**
+   * @return The air temperature in tenths of a degree Celsius.
+   */
+  int temperature() const;
+
+  /**
+   * Correct the factor from one measurement of a target at a known distance,
+   * taken at the current temperature.
+   *
+   * @param us Echo time measured for the target, in microseconds.
+   * @param mm True distance to the target, in millimeters.
+   * @return false if the correction would be more than TOF_MAX_CORRECTION
+   *         percent, in which case nothing changes.
+   */
+  bool calibrate(int us, int mm);
+
+  /**
+   * Forget the calibration.
+   */
+  void uncalibrate();
+
+  /**
+   * Restore a correction saved from correction().
+   *
+   * @param correction Correction, Q16.
+   * @return false if it is more than TOF_MAX_CORRECTION percent, in which
+   *         case nothing changes.
+   */
+  bool setCorrection(uint32_t correction);
+
+  /**
+   * @return The calibration correction, Q16 (65536 is none).
+   */
+  uint32_t correction() const;
+
+  /**
+   * @return The conversion factor, Q16 millimeters per microsecond.
+   */
+  uint32_t factor() const { return factor_; }
+
+  /**
+   * Convert an echo time to a distance.
+   *
+   * @param us Round trip echo time in microseconds, 0 to 300000.
+   * @return Distance in millimeters, rounded to the nearest.
+   */
+  int toMm(int us) const {
+    return (int)(((uint32_t)us * factor_ + 0x8000) >> 16);
+  }
+
+private:
+  void update();
+
+  int temperature_;
+  uint32_t correction_;
+  uint32_t factor_;
+};
+
+#endif /* TIME_OF_FLIGHT_H */
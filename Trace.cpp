@@ -0,0 +1,143 @@
+#include "Trace.h"
+#include <cstdio>
+
+std::atomic<unsigned int> Trace::next_(0);
+Trace::Event Trace::ring_[TRACE_RING_SIZE];
+TraceHistogram Trace::spans_[TRACE_SPANS];
+uint32_t Trace::boot_[TRACE_BOOT_STEPS];
+std::atomic<uint32_t> Trace::booted_(0);
+uint32_t Trace::mainMs_ = 0;
+
+// Names printed by dump(), in the order of the enums.
+static const char *const pointNames[TRACE_POINTS] = {
+    "trigger", "echo rise", "echo fall", "timeout",
+    "filter",  "decision",  "buzzer",    "lcd flush"};
+static const char *const spanNames[TRACE_SPANS] = {
+    "echo", "filter", "decision", "alarm", "lcd flush", "loop"};
+static const char *const bootNames[TRACE_BOOT_STEPS] = {
+    "main", "settings", "sonars", "lcd", "decision", "shown"};
+
+//------------------TraceHistogram---------------------------------------------
+
+TraceHistogram::TraceHistogram() { reset(); }
+
+void TraceHistogram::reset() {
+  for (int i = 0; i < BUCKETS; i++) {
+    buckets_[i] = 0;
+  }
+  count_ = 0;
+  max_ = 0;
+}
+
+uint32_t TraceHistogram::upper(int bucket) {
+  if (bucket < TRACE_SUB_BUCKETS) {
+    return bucket;
+  }
+  int msb = (bucket >> SHIFT) + SHIFT - 1;
+  uint32_t sub = bucket & (TRACE_SUB_BUCKETS - 1);
+  uint32_t lower = (TRACE_SUB_BUCKETS + sub) << (msb - SHIFT);
+  return lower + ((1U << (msb - SHIFT)) - 1);
+}
+
+uint32_t TraceHistogram::percentile(int percent) const {
+  uint32_t count = count_;
+  if (count == 0) {
+    return 0;
+  }
+
+  // The rank of the percentile, rounded up so p100 is the last duration.
+  uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  uint32_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      uint32_t bound = upper(i);
+      return bound < max_ ? bound : max_;
+    }
+  }
+  return max_;
+}
+
+//------------------Trace------------------------------------------------------
+
+void Trace::start() {
+#if MBED_CONF_APP_TRACE
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  mainMs_ = (uint32_t)Kernel::get_ms_count();
+  sleep_manager_lock_deep_sleep();
+  boot(TRACE_BOOT_MAIN);
+#endif
+}
+
+uint32_t Trace::booted(TraceBoot step) {
+  if (!(booted_.load(std::memory_order_acquire) & (1U << step))) {
+    return UINT32_MAX;
+  }
+  return boot_[step];
+}
+
+const TraceHistogram &Trace::histogram(TraceSpan span) {
+  return spans_[span];
+}
+
+// Print cycles as microseconds with one decimal, without floating point.
+static void printUs(uint32_t cycles) {
+  uint32_t perUs = SystemCoreClock / 1000000;
+  unsigned long tenths = (unsigned long)((uint64_t)cycles * 10 / perUs);
+  printf(" %7lu.%lu", tenths / 10, tenths % 10);
+}
+
+void Trace::dump() {
+  // The kernel clock starts before the static constructors run, so this
+  // shows how long they took to the millisecond.
+  printf("trace: boot, main() %lu ms after the kernel started, then us:\n",
+         (unsigned long)mainMs_);
+  for (int i = 0; i < TRACE_BOOT_STEPS; i++) {
+    uint32_t cycles = booted((TraceBoot)i);
+    if (cycles == UINT32_MAX) {
+      printf("trace: %-10s       -\n", bootNames[i]);
+    } else {
+      printf("trace: %-10s", bootNames[i]);
+      printUs(cycles);
+      printf("\n");
+    }
+  }
+
+  printf("trace: span        count      p50 us      p99 us      max us\n");
+  for (int i = 0; i < TRACE_SPANS; i++) {
+    const TraceHistogram &h = spans_[i];
+    printf("trace: %-10s %7lu", spanNames[i], (unsigned long)h.count());
+    printUs(h.percentile(50));
+    printUs(h.percentile(99));
+    printUs(h.max());
+    printf("\n");
+  }
+
+  // The newest events, oldest first, timed from the first one printed.
+  unsigned int next = next_.load(std::memory_order_relaxed);
+  unsigned int shown = next < TRACE_DUMP_EVENTS ? next : TRACE_DUMP_EVENTS;
+  uint32_t first = ring_[(next - shown) % TRACE_RING_SIZE].cycles;
+  printf("trace: last %u of %u events, us since the first shown\n", shown,
+         next);
+  for (unsigned int i = next - shown; i != next; i++) {
+    const Event &event = ring_[i % TRACE_RING_SIZE];
+    const char *name =
+        event.point < TRACE_POINTS ? pointNames[event.point] : "?";
+    printf("trace:");
+    printUs(event.cycles - first);
+    printf("  %-10s %d\n", name, (int)event.arg);
+  }
+}
+
+void Trace::reset() {
+  next_.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < TRACE_SPANS; i++) {
+    spans_[i].reset();
+  }
+}
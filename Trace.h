@@ -0,0 +1,281 @@
+/**
+ * Latency tracing for the sense -> alarm path.
+ *
+ * Trace points are stamped with the Cortex-M4 cycle counter (DWT->CYCCNT),
+ * which costs one load, so they can sit in interrupt handlers without
+ * changing the timing they measure. There are two kinds:
+ *
+ *   - point() records an event, its stamp and a 16 bit argument in a fixed
+ *     ring of the last TRACE_RING_SIZE events, for reading the sequence that
+ *     led up to something.
+ *   - span() adds the time since an earlier stamp to that span's histogram,
+ *     which keeps the count, the maximum and log-spaced buckets from which
+ *     the 50th and 99th percentiles are read.
+ *
+ * Everything is allocated statically and nothing ever blocks. Each span must
+ * only be added to from one context (one thread or one interrupt), since its
+ * histogram is not locked; the event ring takes points from anywhere.
+ *
+ * Startup is timed apart from these: boot() stamps each step of startup
+ * the first time it is reached, giving a timeline from main() to the first
+ * sample acted on and shown.
+ *
+ * The cycle counter stops while the core is in deep sleep. The spans only
+ * cover work the core stays awake for, but startup waits through long sleeps,
+ * so deep sleep is locked from start() until every step of startup has been
+ * stamped.
+ *
+ * dump() prints all of it to the console. Setting the trace option in
+ * mbed_app.json to false compiles every trace point away.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "mbed.h"
+#include <atomic>
+#include <stdint.h>
+
+// Number of events the ring keeps, must be a power of two.
+#define TRACE_RING_SIZE 256
+
+// Number of newest events dump() prints.
+#define TRACE_DUMP_EVENTS 32
+
+// Buckets per power of two in a histogram, must be a power of two.
+#define TRACE_SUB_BUCKETS 4
+
+// Events recorded with Trace::point().
+enum TracePoint {
+  // SonarArray pinged a sensor, arg is the sensor index.
+  TRACE_TRIGGER,
+  // The echo line rose.
+  TRACE_ECHO_RISE,
+  // The echo line fell, arg is the pulse width in microseconds.
+  TRACE_ECHO_FALL,
+  // The echo timed out with no target.
+  TRACE_ECHO_TIMEOUT,
+  // A sample went through the filters, arg is the estimate in centimeters,
+  // or -1 for no target.
+  TRACE_FILTER,
+  // The main loop decided on a new sample, arg is the distance shown, or -1
+  // for no target.
+  TRACE_DECISION,
+  // The buzzer changed pattern, arg is the alarm level, 0 for off.
+  TRACE_BUZZER,
+  // The render thread sent a flush, arg is the number of cells sent.
+  TRACE_LCD_FLUSH,
+  TRACE_POINTS
+};
+
+// Durations measured with Trace::span().
+enum TraceSpan {
+  // Trigger to the echo result reaching SonarArray.
+  TRACE_SPAN_ECHO,
+  // Filtering and rate selection of one sample.
+  TRACE_SPAN_FILTER,
+  // Trigger to the main loop acting on the sample.
+  TRACE_SPAN_DECISION,
+  // Trigger to the buzzer turning on, the whole sense -> alarm path.
+  TRACE_SPAN_ALARM,
+  // One LCD flush on the render thread, including the I2C transfers.
+  TRACE_SPAN_LCD_FLUSH,
+  // One pass of the main loop, not counting the wait for a sample.
+  TRACE_SPAN_LOOP,
+  TRACE_SPANS
+};
+
+// Steps of startup stamped with Trace::boot(), in the order they are
+// expected.
+enum TraceBoot {
+  // main() started the cycle counter.
+  TRACE_BOOT_MAIN,
+  // The saved settings were restored.
+  TRACE_BOOT_SETTINGS,
+  // SonarArray sent its first ping.
+  TRACE_BOOT_SONARS,
+  // The render thread finished initializing the LCD.
+  TRACE_BOOT_LCD,
+  // The main loop acted on the first sample.
+  TRACE_BOOT_DECISION,
+  // The first LCD flush after the LCD was ready.
+  TRACE_BOOT_SHOWN,
+  TRACE_BOOT_STEPS
+};
+
+/**
+ * Durations in cycles, counted in buckets that are exact below
+ * TRACE_SUB_BUCKETS and TRACE_SUB_BUCKETS per power of two above, so a
+ * percentile is never off by more than 1 / TRACE_SUB_BUCKETS of its value.
+ */
+class TraceHistogram {
+public:
+  TraceHistogram();
+
+  /**
+   * Count a duration.
+   */
+  void add(uint32_t cycles) {
+    buckets_[bucket(cycles)]++;
+    count_++;
+    if (cycles > max_) {
+      max_ = cycles;
+    }
+  }
+
+  /**
+   * @param percent Percentile wanted, 0 to 100.
+   * @return Upper bound in cycles of the bucket that holds the percentile,
+   *         but never more than max(), or 0 if nothing was counted.
+   */
+  uint32_t percentile(int percent) const;
+
+  /**
+   * @return Number of durations counted.
+   */
+  uint32_t count() const { return count_; }
+
+  /**
+   * @return Longest duration counted, in cycles.
+   */
+  uint32_t max() const { return max_; }
+
+  /**
+   * Forget everything counted.
+   */
+  void reset();
+
+private:
+  enum {
+    SHIFT = TRACE_SUB_BUCKETS == 1 ? 0
+            : TRACE_SUB_BUCKETS == 2 ? 1
+            : TRACE_SUB_BUCKETS == 4 ? 2
+                                     : 3,
+    BUCKETS = (32 - SHIFT + 1) * TRACE_SUB_BUCKETS
+  };
+
+  // Exact below TRACE_SUB_BUCKETS, then the leading bit and the SHIFT bits
+  // under it select the bucket.
+  static int bucket(uint32_t cycles) {
+    if (cycles < TRACE_SUB_BUCKETS) {
+      return cycles;
+    }
+    int msb = 31 - __builtin_clz(cycles);
+    return ((msb - SHIFT + 1) << SHIFT) |
+           ((cycles >> (msb - SHIFT)) & (TRACE_SUB_BUCKETS - 1));
+  }
+
+  static uint32_t upper(int bucket);
+
+  volatile uint32_t buckets_[BUCKETS];
+  volatile uint32_t count_;
+  volatile uint32_t max_;
+};
+
+class Trace {
+public:
+  /**
+   * Start the cycle counter and lock deep sleep until startup is done. Call
+   * once, first thing in main(), before any trace point.
+   */
+  static void start();
+
+  /**
+   * @return The current cycle count, to pass to span() later.
+   */
+  static uint32_t now() {
+#if MBED_CONF_APP_TRACE
+    return DWT->CYCCNT;
+#else
+    return 0;
+#endif
+  }
+
+  /**
+   * Record an event in the ring.
+   */
+  static void point(TracePoint point, int arg = 0) {
+#if MBED_CONF_APP_TRACE
+    unsigned int slot = next_.fetch_add(1, std::memory_order_relaxed);
+    Event &event = ring_[slot % TRACE_RING_SIZE];
+    event.cycles = DWT->CYCCNT;
+    event.point = point;
+    event.arg = arg > INT16_MAX   ? INT16_MAX
+                : arg < INT16_MIN ? INT16_MIN
+                                  : arg;
+#endif
+  }
+
+  /**
+   * Add the time since start to a span's histogram.
+   *
+   * @param start Cycle count from now() when the span began.
+   */
+  static void span(TraceSpan span, uint32_t start) {
+#if MBED_CONF_APP_TRACE
+    // Unsigned subtraction keeps the duration right across a wrap.
+    spans_[span].add(DWT->CYCCNT - start);
+#endif
+  }
+
+  /**
+   * Stamp a step of startup, unless it was already stamped. Each step must
+   * only be stamped from one context.
+   */
+  static void boot(TraceBoot step) {
+#if MBED_CONF_APP_TRACE
+    if (!(booted_.load(std::memory_order_relaxed) & (1U << step))) {
+      boot_[step] = DWT->CYCCNT;
+      uint32_t before = booted_.fetch_or(1U << step, std::memory_order_release);
+
+      // The last step lets the core go into deep sleep again.
+      if ((before | (1U << step)) == (1U << TRACE_BOOT_STEPS) - 1) {
+        sleep_manager_unlock_deep_sleep();
+      }
+    }
+#endif
+  }
+
+  /**
+   * @return Cycles from start() to a step of startup, or UINT32_MAX if it
+   *         has not been reached.
+   */
+  static uint32_t booted(TraceBoot step);
+
+  /**
+   * @return The histogram of a span.
+   */
+  static const TraceHistogram &histogram(TraceSpan span);
+
+  /**
+   * Print the startup timeline, the histograms and the newest events to the
+   * console. Events that are recorded while this runs may show up half
+   * written.
+   */
+  static void dump();
+
+  /**
+   * Forget all events and histograms. The startup timeline is kept.
+   */
+  static void reset();
+
+private:
+  struct Event {
+    uint32_t cycles;
+    uint16_t point;
+    int16_t arg;
+  };
+
+  static std::atomic<unsigned int> next_;
+  static Event ring_[TRACE_RING_SIZE];
+  static TraceHistogram spans_[TRACE_SPANS];
+
+  // Stamps of the startup steps, and a bit for each one stamped.
+  static uint32_t boot_[TRACE_BOOT_STEPS];
+  static std::atomic<uint32_t> booted_;
+
+  // Milliseconds the kernel had run for when main() started.
+  static uint32_t mainMs_;
+};
+
+#endif /* TRACE_H */
@@ -0,0 +1,221 @@
+#include "VL53L0X.h"
+
+// Registers, named as in ST's API.
+#define SYSRANGE_START 0x00
+#define SYSTEM_SEQUENCE_CONFIG 0x01
+#define SYSTEM_INTERRUPT_CONFIG_GPIO 0x0A
+#define SYSTEM_INTERRUPT_CLEAR 0x0B
+#define RESULT_RANGE_STATUS 0x14
+#define FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT 0x44
+#define MSRC_CONFIG_CONTROL 0x60
+#define GPIO_HV_MUX_ACTIVE_HIGH 0x84
+#define VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV 0x89
+#define IDENTIFICATION_MODEL_ID 0xC0
+
+// What IDENTIFICATION_MODEL_ID reads on a VL53L0X.
+#define MODEL_ID 0xEE
+
+// SYSTEM_SEQUENCE_CONFIG at power on, and once init() has set the sensor up.
+#define SEQUENCE_POWER_ON 0xFF
+#define SEQUENCE_RANGING 0xE8
+
+// Range status of a valid measurement, in bits 6:3 of RESULT_RANGE_STATUS.
+#define RANGE_VALID 11
+
+// Event flags of the driver thread.
+#define FLAG_START 0x1
+#define FLAG_READY 0x2
+
+VL53L0X::VL53L0X(I2C &i2c, PinName gpio1, int address, osPriority priority)
+    : i2c_(i2c), gpio1_(gpio1), address_(address), transferDone_(0, 1),
+      thread_(priority, 1024) {
+  stop_ = 0;
+  transferEvent_ = 0;
+  started_ = false;
+  result_ = RANGE_NO_TARGET;
+  busy_ = false;
+
+  gpio1_.fall(callback(this, &VL53L0X::dataReady));
+}
+
+bool VL53L0X::initRange() {
+  i2c_.frequency(VL53L0X_I2C_HZ);
+
+  // The driver thread takes the pings, even from a sensor that is missing,
+  // which then reports no target.
+  if (!started_) {
+    started_ = true;
+    thread_.start(callback(this, &VL53L0X::run));
+  }
+
+  char id = 0;
+  if (!readRegs(IDENTIFICATION_MODEL_ID, &id, 1) ||
+      (uint8_t)id != MODEL_ID) {
+    return false;
+  }
+
+  // Run the I/O at 2.8 V and the I2C in standard mode.
+  char pad = 0;
+  readRegs(VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV, &pad, 1);
+  writeReg(VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV, pad | 0x01);
+  writeReg(0x88, 0x00);
+
+  // Read the stop variable from the sensor's private page.
+  char stop = 0;
+  writeReg(0x80, 0x01);
+  writeReg(0xFF, 0x01);
+  writeReg(0x00, 0x00);
+  readRegs(0x91, &stop, 1);
+  writeReg(0x00, 0x01);
+  writeReg(0xFF, 0x00);
+  writeReg(0x80, 0x00);
+  stop_ = stop;
+
+  // Leave out the MSRC and pre-range signal checks, and ask for a return
+  // signal rate of at least 0.25 MCPS, in Q9.7.
+  char msrc = 0;
+  readRegs(MSRC_CONFIG_CONTROL, &msrc, 1);
+  writeReg(MSRC_CONFIG_CONTROL, msrc | 0x12);
+  writeReg16(FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT, 32);
+
+  // Pull GPIO1 low when a new sample is ready.
+  char mux = 0;
+  writeReg(SYSTEM_INTERRUPT_CONFIG_GPIO, 0x04);
+  readRegs(GPIO_HV_MUX_ACTIVE_HIGH, &mux, 1);
+  writeReg(GPIO_HV_MUX_ACTIVE_HIGH, mux & ~0x10);
+  writeReg(SYSTEM_INTERRUPT_CLEAR, 0x01);
+
+  // A sensor that kept its power through a reset of the board is still
+  // calibrated, which saves two rangings' worth of time on a warm start.
+  char sequence = SEQUENCE_POWER_ON;
+  readRegs(SYSTEM_SEQUENCE_CONFIG, &sequence, 1);
+  if ((uint8_t)sequence == SEQUENCE_RANGING) {
+    return true;
+  }
+
+  // The reference calibrations, then the default sequence steps: DSS,
+  // pre-range and final range.
+  bool ok = calibrate(0x01, 0x41) && calibrate(0x02, 0x01);
+  return writeReg(SYSTEM_SEQUENCE_CONFIG, SEQUENCE_RANGING) && ok;
+}
+
+bool VL53L0X::startRange() {
+  if (busy_) {
+    return false;
+  }
+  busy_ = true;
+  flags_.set(FLAG_START);
+  return true;
+}
+
+int VL53L0X::readRange() { return result_; }
+
+// There is no raw reading apart from the distance.
+int VL53L0X::rawRange() { return -1; }
+
+void VL53L0X::attachRange(Callback<void()> complete) {
+  complete_ = complete;
+}
+
+//------------------Driver thread---------------------------------------------
+
+void VL53L0X::run() {
+  while (true) {
+    flags_.wait_any(FLAG_START);
+    result_ = measure();
+    busy_ = false;
+    if (complete_) {
+      complete_();
+    }
+  }
+}
+
+// One single ranging, in millimeters or RANGE_NO_TARGET.
+int VL53L0X::measure() {
+  flags_.clear(FLAG_READY);
+
+  // Put the stop variable back and start, as ST's API does for each ranging.
+  if (!writeReg(0x80, 0x01) || !writeReg(0xFF, 0x01) ||
+      !writeReg(0x00, 0x00) || !writeReg(0x91, stop_) ||
+      !writeReg(0x00, 0x01) || !writeReg(0xFF, 0x00) ||
+      !writeReg(0x80, 0x00) || !writeReg(SYSRANGE_START, 0x01)) {
+    return RANGE_NO_TARGET;
+  }
+  if (!waitReady(VL53L0X_TIMEOUT_MS)) {
+    return RANGE_NO_TARGET;
+  }
+
+  // The status, then the distance at byte 10, big endian.
+  char result[12];
+  bool read = readRegs(RESULT_RANGE_STATUS, result, sizeof(result));
+  writeReg(SYSTEM_INTERRUPT_CLEAR, 0x01);
+  if (!read) {
+    return RANGE_NO_TARGET;
+  }
+
+  int status = (result[0] & 0x78) >> 3;
+  int mm = (uint8_t)result[10] << 8 | (uint8_t)result[11];
+  if (status != RANGE_VALID || mm >= VL53L0X_MAX_MM) {
+    return RANGE_NO_TARGET;
+  }
+  return mm;
+}
+
+// Run one reference calibration with the given sequence step.
+bool VL53L0X::calibrate(uint8_t sequence, uint8_t start) {
+  flags_.clear(FLAG_READY);
+  if (!writeReg(SYSTEM_SEQUENCE_CONFIG, sequence) ||
+      !writeReg(SYSRANGE_START, start) || !waitReady(VL53L0X_TIMEOUT_MS)) {
+    return false;
+  }
+  writeReg(SYSTEM_INTERRUPT_CLEAR, 0x01);
+  return writeReg(SYSRANGE_START, 0x00);
+}
+
+bool VL53L0X::waitReady(int ms) {
+  return (flags_.wait_any(FLAG_READY, ms) & osFlagsError) == 0;
+}
+
+bool VL53L0X::writeReg(uint8_t reg, uint8_t value) {
+  char data[2] = {(char)reg, (char)value};
+  return transfer(data, 2, NULL, 0);
+}
+
+bool VL53L0X::writeReg16(uint8_t reg, uint16_t value) {
+  char data[3] = {(char)reg, (char)(value >> 8), (char)(value & 0xFF)};
+  return transfer(data, 3, NULL, 0);
+}
+
+bool VL53L0X::readRegs(uint8_t reg, char *data, int length) {
+  char index = reg;
+  return transfer(&index, 1, data, length);
+}
+
+// Write tx, then read rx after a repeated start if rxLength is not 0. Where
+// the target supports it the transfer runs from interrupts, and the calling
+// thread sleeps until it completes instead of polling the bus.
+bool VL53L0X::transfer(const char *tx, int txLength, char *rx,
+                       int rxLength) {
+#if DEVICE_I2C_ASYNCH
+  if (i2c_.transfer(address_, tx, txLength, rx, rxLength,
+                    callback(this, &VL53L0X::transferDone),
+                    I2C_EVENT_ALL) == 0) {
+    transferDone_.acquire();
+    return transferEvent_ == I2C_EVENT_TRANSFER_COMPLETE;
+  }
+#endif
+  if (i2c_.write(address_, tx, txLength, rxLength > 0) != 0) {
+    return false;
+  }
+  return rxLength == 0 || i2c_.read(address_, rx, rxLength) == 0;
+}
+
+void VL53L0X::transferDone(int event) {
+  transferEvent_ = event;
+  transferDone_.release();
+}
+
+//------------------Interrupt handler---------------------------------------
+
+// GPIO1 went low: a result is ready.
+void VL53L0X::dataReady() { flags_.set(FLAG_READY); }
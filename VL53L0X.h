@@ -0,0 +1,104 @@
+/**
+ * RangeSensor driver for the ST VL53L0X time-of-flight sensor over I2C.
+ *
+ * The VL53L0X times a pulse of infrared light instead of sound, so its beam
+ * is a narrow cone, it takes about VL53L0X_BUDGET_US per measurement and
+ * neighbours cannot hear each other's echoes. Each ping() starts one single
+ * ranging. The sensor pulls its GPIO1 pin low when the result is in, and the
+ * driver's own thread then reads it over I2C, so nothing waits on the bus in
+ * interrupt context, where Mbed's I2C cannot be used.
+ *
+ * init() brings the sensor up with the steps of ST's API that matter for
+ * single ranging: 2.8 V I/O, the stop variable, the signal rate limit, the
+ * GPIO1 interrupt and the VHV and phase reference calibrations, which it
+ * skips when the sensor kept its power through a reset. It does not
+ * load ST's default tuning settings or the SPAD map, which leaves the range
+ * somewhat shorter than the datasheet's.
+ */
+
+#ifndef VL53L0X_H
+#define VL53L0X_H
+
+#include "RangeSensor.h"
+#include "mbed.h"
+
+// I2C address of the sensor after power on, in Mbed's 8 bit form.
+#define VL53L0X_ADDRESS 0x52
+
+// I2C bus speed, fast mode.
+#define VL53L0X_I2C_HZ 400000
+
+// Time in microseconds one ranging takes with the default timing budget.
+#define VL53L0X_BUDGET_US 33000
+
+// Shortest time in microseconds between two pings, with the I2C traffic.
+#define VL53L0X_CYCLE_US 40000
+
+// Longest wait in milliseconds for a result before it counts as no target.
+#define VL53L0X_TIMEOUT_MS 100
+
+// Distances at or beyond this many millimeters count as no target.
+#define VL53L0X_MAX_MM 2000
+
+class VL53L0X : public RangeSensor<VL53L0X> {
+public:
+  static const int CYCLE_US = VL53L0X_CYCLE_US;
+  static const int SETTLE_US = 0;
+  static const int MAX_MM = VL53L0X_MAX_MM;
+
+  /**
+   * Constructor
+   *
+   * @param i2c      Bus the sensor is on, not shared with threads that use
+   *                 it while a ranging is in flight.
+   * @param gpio1    Pin connected to the sensor's GPIO1 interrupt output.
+   * @param address  I2C address of the sensor, in Mbed's 8 bit form.
+   * @param priority Priority of the driver thread.
+   */
+  VL53L0X(I2C &i2c, PinName gpio1, int address = VL53L0X_ADDRESS,
+          osPriority priority = osPriorityAboveNormal);
+
+private:
+  friend class RangeSensor<VL53L0X>;
+
+  bool initRange();
+  bool startRange();
+  int readRange();
+  int rawRange();
+  void attachRange(Callback<void()> complete);
+
+  void run();
+  void dataReady();
+  int measure();
+  bool calibrate(uint8_t sequence, uint8_t start);
+  bool waitReady(int ms);
+  bool writeReg(uint8_t reg, uint8_t value);
+  bool writeReg16(uint8_t reg, uint16_t value);
+  bool readRegs(uint8_t reg, char *data, int length);
+  bool transfer(const char *tx, int txLength, char *rx, int rxLength);
+  void transferDone(int event);
+
+  I2C &i2c_;
+  InterruptIn gpio1_;
+  int address_;
+
+  // Read from the sensor by init(), and written back before every ranging.
+  uint8_t stop_;
+
+  // Signals from ping() and GPIO1 to the driver thread.
+  EventFlags flags_;
+
+  // Released when an asynchronous transfer finishes, with its event.
+  Semaphore transferDone_;
+  volatile int transferEvent_;
+
+  Thread thread_;
+  bool started_;
+
+  Callback<void()> complete_;
+
+  volatile int result_;
+  volatile bool busy_;
+};
+
+#endif /* VL53L0X_H */
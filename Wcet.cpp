@@ -0,0 +1,139 @@
+#include "Wcet.h"
+#include "Trace.h"
+#include <cstdio>
+
+// Names printed by report(), in the order of the enums.
+static const char *const callNames[WCET_CALLS] = {
+    "settings", "ultrasonic", "stats", "telemetry", "buzzer",
+    "menu",     "knob",       "sprintf", "lcd"};
+static const char *const pathNames[WCET_PATHS] = {
+    "clear",  "warning",  "no target", "bar",
+    "alarm",  "switch",   "settings",  "turn"};
+
+Wcet::Wcet(uint32_t budgetUs) : budgetUs_(budgetUs) {
+  stamp_ = 0;
+  for (int i = 0; i < WCET_CALLS; i++) {
+    laps_[i] = 0;
+  }
+  reset();
+}
+
+void Wcet::begin() {
+  for (int i = 0; i < WCET_CALLS; i++) {
+    laps_[i] = 0;
+  }
+  stamp_ = Trace::now();
+}
+
+void Wcet::lap(WcetCall call) {
+  uint32_t now = Trace::now();
+  // Unsigned subtraction keeps the lap right across a wrap.
+  uint32_t cycles = now - stamp_;
+  stamp_ = now;
+
+  // A call can take more than one lap in a pass; its laps add up.
+  laps_[call] += cycles;
+  if (cycles > callMax_[call]) {
+    callMax_[call] = cycles;
+  }
+}
+
+void Wcet::skip() { stamp_ = Trace::now(); }
+
+void Wcet::end(uint32_t paths) {
+  uint32_t total = 0;
+  for (int i = 0; i < WCET_CALLS; i++) {
+    total += laps_[i];
+  }
+
+  passes_++;
+  if ((uint64_t)total > (uint64_t)budgetUs_ * (SystemCoreClock / 1000000)) {
+    over_++;
+  }
+
+  for (int i = 0; i < WCET_PATHS; i++) {
+    if (paths & (1U << i)) {
+      pathPasses_[i]++;
+      if (total > pathMax_[i]) {
+        pathMax_[i] = total;
+      }
+    }
+  }
+
+  if (total > worst_) {
+    worst_ = total;
+    worstPaths_ = paths;
+    for (int i = 0; i < WCET_CALLS; i++) {
+      worstLaps_[i] = laps_[i];
+    }
+  }
+}
+
+bool Wcet::ok() {
+  for (int i = 0; i < WCET_PATHS; i++) {
+    if (pathPasses_[i] == 0) {
+      return false;
+    }
+  }
+  return over_ == 0;
+}
+
+uint32_t Wcet::over() { return over_; }
+
+// Print cycles as microseconds with one decimal, without floating point.
+static void printUs(uint32_t cycles) {
+  uint32_t perUs = SystemCoreClock / 1000000;
+  unsigned long tenths = (unsigned long)((uint64_t)cycles * 10 / perUs);
+  printf(" %7lu.%lu", tenths / 10, tenths % 10);
+}
+
+void Wcet::report() {
+  printf("wcet: %lu passes, budget %lu us, worst", (unsigned long)passes_,
+         (unsigned long)budgetUs_);
+  printUs(worst_);
+  printf(" us\n");
+
+  printf("wcet: call            max us    in worst\n");
+  for (int i = 0; i < WCET_CALLS; i++) {
+    printf("wcet: %-10s", callNames[i]);
+    printUs(callMax_[i]);
+    printUs(worstLaps_[i]);
+    printf("\n");
+  }
+
+  // The paths the worst pass took are starred.
+  printf("wcet: path        passes      max us\n");
+  int missing = 0;
+  for (int i = 0; i < WCET_PATHS; i++) {
+    printf("wcet: %-10s %7lu", pathNames[i], (unsigned long)pathPasses_[i]);
+    if (pathPasses_[i] == 0) {
+      printf("           -\n");
+      missing++;
+    } else {
+      printUs(pathMax_[i]);
+      printf("%s\n", worstPaths_ & (1U << i) ? " *" : "");
+    }
+  }
+
+  if (ok()) {
+    printf("wcet: PASS, every path ran and no pass was over budget\n");
+  } else {
+    printf("wcet: FAIL, %d path(s) never ran, %lu pass(es) over budget\n",
+           missing, (unsigned long)over_);
+  }
+}
+
+void Wcet::reset() {
+  passes_ = 0;
+  over_ = 0;
+  for (int i = 0; i < WCET_CALLS; i++) {
+    callMax_[i] = 0;
+    worstLaps_[i] = 0;
+  }
+  for (int i = 0; i < WCET_PATHS; i++) {
+    pathMax_[i] = 0;
+    pathPasses_[i] = 0;
+  }
+  worst_ = 0;
+  worstPaths_ = 0;
+}
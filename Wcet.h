@@ -0,0 +1,144 @@
+/**
+ * Worst-case execution time of the main loop, against a budget.
+ *
+ * Each pass of the loop is cut into laps, one per call it makes: begin()
+ * starts a pass, lap() charges the cycles since the previous stamp to a call
+ * and end() closes the pass with the paths it took, such as whether it warned
+ * or redrew the proximity bar. skip() restarts the stamp without
+ * charging anything, for the waits a pass makes on purpose. Cycles come from
+ * Trace::now(), so the trace option must be on.
+ *
+ * For every call and every path the longest time seen is kept, along with
+ * the breakdown of the longest pass. A pass is over budget when its laps add
+ * up to more than the budget, and the loop only counts as within its budget
+ * once every path has run at least once and no pass was over.
+ *
+ * Only the main loop may time passes. report() can be called from another
+ * thread, but may then show a pass half counted.
+ */
+
+#ifndef WCET_H
+#define WCET_H
+
+#include <stdint.h>
+
+// Calls of the main loop, each timed as one lap.
+enum WcetCall {
+  // publishConfig() and queueSave(), which only posts the flash write.
+  WCET_SETTINGS,
+  // Ultrasonic() and the violation check.
+  WCET_ULTRASONIC,
+  // The trace and statistics of a new sample.
+  WCET_STATS,
+  // sendTelemetry().
+  WCET_TELEMETRY,
+  // BuzzerOn() or BuzzerOff().
+  WCET_BUZZER,
+  // printMenu(), or drawing the warning.
+  WCET_MENU,
+  // Reading the encoder and moving minDistance.
+  WCET_KNOB,
+  // sprintf() of minDistance.
+  WCET_FORMAT,
+  // Drawing the bar or the number and flushing the LCD.
+  WCET_LCD,
+  WCET_CALLS
+};
+
+// Paths of the main loop a pass can take, as bits for end().
+enum WcetPath {
+  // Nothing too close.
+  WCET_CLEAR,
+  // A target too close, with the warning shown.
+  WCET_WARNING,
+  // No target in range.
+  WCET_NO_TARGET,
+  // The proximity bar changed length, so its cells are redrawn.
+  WCET_BAR,
+  // The buzzer changed level, so its pattern is reprogrammed.
+  WCET_ALARM,
+  // The first pass after the menu was switched.
+  WCET_SWITCH,
+  // A pass in the "Set new distance" menu.
+  WCET_SETTINGS_MENU,
+  // The knob moved minDistance.
+  WCET_TURN,
+  WCET_PATHS
+};
+
+class Wcet {
+public:
+  /**
+   * Constructor
+   *
+   * @param budgetUs Longest time in microseconds a pass may take.
+   */
+  Wcet(uint32_t budgetUs);
+
+  /**
+   * Start timing a pass.
+   */
+  void begin();
+
+  /**
+   * Charge the cycles since the last stamp to a call.
+   */
+  void lap(WcetCall call);
+
+  /**
+   * Restart the stamp without charging the time since the last one, after a
+   * wait that is not part of the work.
+   */
+  void skip();
+
+  /**
+   * Finish the pass.
+   *
+   * @param paths The paths the pass took, a bit (1 << path) for each.
+   */
+  void end(uint32_t paths);
+
+  /**
+   * @return true if every path has run and no pass was over budget.
+   */
+  bool ok();
+
+  /**
+   * @return Number of passes over budget.
+   */
+  uint32_t over();
+
+  /**
+   * Print the worst pass and its breakdown, each call's and each path's
+   * longest time, and whether the loop kept to its budget, to the console.
+   */
+  void report();
+
+  /**
+   * Forget every pass timed so far. Only the main loop may call it, between
+   * two passes.
+   */
+  void reset();
+
+private:
+  uint32_t budgetUs_;
+
+  // Stamp of the end of the last lap, and the laps of the pass so far.
+  uint32_t stamp_;
+  uint32_t laps_[WCET_CALLS];
+
+  volatile uint32_t passes_;
+  volatile uint32_t over_;
+
+  // Each call's longest lap and each path's longest pass, in cycles.
+  volatile uint32_t callMax_[WCET_CALLS];
+  volatile uint32_t pathMax_[WCET_PATHS];
+  volatile uint32_t pathPasses_[WCET_PATHS];
+
+  // The longest pass, its paths and its laps.
+  volatile uint32_t worst_;
+  volatile uint32_t worstPaths_;
+  volatile uint32_t worstLaps_[WCET_CALLS];
+};
+
+#endif /* WCET_H */
@@ -1,18 +1,31 @@
 #include "lcd1602.h"
 #include "mbed.h"
+#include <cstring>
+
+// DDRAM address of the first column of each row
+static const unsigned char row_offsets[] = {0x00, 0x40, 0x14, 0x54};
 
 CSE321_LCD::CSE321_LCD(unsigned char lcd_cols, unsigned char lcd_rows,
                        unsigned char charsize, PinName sda, PinName scl)
     : i2c(sda, scl) {
 
   _addr = LCD_ADDRESS_1602; //address of the device
-  _cols = lcd_cols;
-  _rows = lcd_rows;
+  _cols = lcd_cols > LCD_MAX_COLS ? LCD_MAX_COLS : lcd_cols;
+  _rows = lcd_rows > LCD_MAX_ROWS ? LCD_MAX_ROWS : lcd_rows;
   _charsize = charsize;
   _backlightval = LCD_BACKLIGHT;
+  _displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+  _burstLen = 0;
+
+  // the display contents are unknown until begin() clears it
+  clearFrame();
+  _stale = true;
+  _cursorKnown = false;
+  _cursorCol = 0;
+  _cursorRow = 0;
 }
 
-void CSE321_LCD::begin() {
+void CSE321_LCD::begin(bool warm) {
   _displayfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
 
   if (_rows > 1) {
@@ -24,33 +37,56 @@ void CSE321_LCD::begin() {
     _displayfunction |= LCD_5x10DOTS;
   }
 
-  // According to datasheet, we need at least 40ms after power rises above 2.7V
-  // before sending commands.
-  thread_sleep_for(50);
-
-  // Now we pull both RS and R/W low to begin commands
-  expanderWrite(
-      _backlightval); // reset expanderand turn backlight off (Bit 8 =1)
-  thread_sleep_for(1000);
-
-  // put the LCD into 4 bit mode
-  // this is according to the hitachi HD44780 datasheet
-  // figure 24, pg 46
-
-  // we start in 8bit mode, try to set 4 bit mode
-  write4bits(0x03 << 4);
-  wait_us(4500); // wait min 4.1ms
-
-  // second try
-  write4bits(0x03 << 4);
-  wait_us(4500); // wait min 4.1ms
-
-  // third go!
-  write4bits(0x03 << 4);
-  wait_us(150);
+  if (warm) {
+    // The controller is already running, in 4 bit mode unless the reset came
+    // between the two nibbles of a byte. The first 0x3 nibble either starts
+    // a new byte or finishes that one, which could be a clear or home, so
+    // give it the 1.52ms those take.
+    expanderWrite(_backlightval);
+    write4bits(0x03 << 4);
+    transmit();
+    wait_us(2000);
+
+    // Either way it now takes 8 bit instructions after at most one more
+    // nibble, so two more 0x3 nibbles leave it in 8 bit mode. Each nibble
+    // is latched three byte times after the last, more than the 37us each
+    // needs.
+    write4bits(0x03 << 4);
+    write4bits(0x03 << 4);
+  } else {
+    // According to datasheet, we need at least 40ms after power rises above
+    // 2.7V before sending commands.
+    thread_sleep_for(50);
+
+    // Now we pull both RS and R/W low to begin commands
+    expanderWrite(
+        _backlightval); // reset expanderand turn backlight off (Bit 8 =1)
+    transmit();
+    thread_sleep_for(1000);
+
+    // put the LCD into 4 bit mode
+    // this is according to the hitachi HD44780 datasheet
+    // figure 24, pg 46
+
+    // we start in 8bit mode, try to set 4 bit mode
+    write4bits(0x03 << 4);
+    transmit();
+    wait_us(4500); // wait min 4.1ms
+
+    // second try
+    write4bits(0x03 << 4);
+    transmit();
+    wait_us(4500); // wait min 4.1ms
+
+    // third go!
+    write4bits(0x03 << 4);
+    transmit();
+    wait_us(150);
+  }
 
   // finally, set to 4-bit interface
   write4bits(0x02 << 4);
+  transmit();
 
   // set # lines, font size, etc.
   command(LCD_FUNCTIONSET | _displayfunction);
@@ -68,8 +104,14 @@ void CSE321_LCD::begin() {
   // set the entry mode
   command(LCD_ENTRYMODESET | _displaymode);
 
-  home();
+  // clear() already homed the cursor; only a cold start pays for it twice
+  if (!warm) {
+    home();
+  }
   backlight();
+
+  // the partial blocks drawBar() needs
+  loadBarGlyphs();
 }
 
 //------------------Core Functions-----------------------------------------
@@ -77,19 +119,33 @@ void CSE321_LCD::begin() {
 void CSE321_LCD::clear() {
   command(LCD_CLEARDISPLAY); // clear display, set cursor position to zero
   wait_us(2000);             // this command takes a long time!
+
+  clearFrame();
+  memcpy(_shadow, _frame, sizeof(_shadow));
+  _stale = false;
+  _cursorCol = 0;
+  _cursorRow = 0;
+  _cursorKnown = true;
 }
 
 void CSE321_LCD::home() {
   command(LCD_RETURNHOME); // set cursor position to zero
   wait_us(2000);           // this command takes a long time!
+
+  _cursorCol = 0;
+  _cursorRow = 0;
+  _cursorKnown = true;
 }
 
 void CSE321_LCD::setCursor(unsigned char col, unsigned char row) {
-  int row_offsets[] = {0x00, 0x40, 0x14, 0x54};
-  if (row > _rows) {
+  if (row >= _rows) {
     row = _rows - 1; // we count rows starting w/0
   }
   command(LCD_SETDDRAMADDR | (col + row_offsets[row]));
+
+  _cursorCol = col;
+  _cursorRow = row;
+  _cursorKnown = true;
 }
 
 // Turn the display on/off (quickly)
@@ -125,11 +181,14 @@ void CSE321_LCD::blink() {
 //----------------------Text Configuration functions-----------------------
 //not addressing, explore if you wish
 // These commands scroll the display without changing the RAM
+// The frame buffer does not follow scrolling, so the next flush() resends all
 void CSE321_LCD::scrollDisplayLeft(void) {
   command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT);
+  _stale = true;
 }
 void CSE321_LCD::scrollDisplayRight(void) {
   command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVERIGHT);
+  _stale = true;
 }
 
 // This is for text that flows Left to Right
@@ -160,37 +219,67 @@ void CSE321_LCD::noAutoscroll(void) {
 // with custom characters
 void CSE321_LCD::createChar(unsigned char location, unsigned char charmap[]) {
   location &= 0x7; // we only have 8 locations 0-7
-  command(LCD_SETCGRAMADDR | (location << 3));
+  send(LCD_SETCGRAMADDR | (location << 3), 0);
   for (int i = 0; i < 8; i++) {
-    write(charmap[i]);
+    send(charmap[i], Rs);
   }
+  transmit();
+
+  // the address counter now points into CGRAM
+  _cursorKnown = false;
 }
 
 // Turn the (optional) backlight off/on
 void CSE321_LCD::noBacklight(void) {
   _backlightval = LCD_NOBACKLIGHT;
   expanderWrite(0);
+  transmit();
 }
 
 void CSE321_LCD::backlight(void) {
   _backlightval = LCD_BACKLIGHT;
   expanderWrite(0);
+  transmit();
 }
 bool CSE321_LCD::getBacklight() { return _backlightval == LCD_BACKLIGHT; }
 
 //-----------functions to output to LCD---------------------------------------
-inline void CSE321_LCD::command(unsigned char value) { send(value, 0); }
+inline void CSE321_LCD::command(unsigned char value) {
+  send(value, 0);
+  transmit();
+}
 
 inline int CSE321_LCD::write(unsigned char value) {
   send(value, Rs);
+  transmit();
+  track(value);
   return 1;
 }
 
+// Keep the frame buffer in step with characters written through print/write.
+void CSE321_LCD::track(unsigned char value) {
+  // only plain left-to-right entry mode is followed
+  if (!_cursorKnown || _cursorCol >= _cols || !(_displaymode & LCD_ENTRYLEFT) ||
+      (_displaymode & LCD_ENTRYSHIFTINCREMENT)) {
+    _stale = true;
+    _cursorKnown = false;
+    return;
+  }
+  _frame[_cursorRow][_cursorCol] = value;
+  _shadow[_cursorRow][_cursorCol] = value;
+  _cursorCol++;
+}
+
 
 // write either command or data
 void CSE321_LCD::send(unsigned char value, unsigned char mode) {
   unsigned char highnib = value & 0xf0;
   unsigned char lownib = (value << 4) & 0xf0;
+
+  // keep both nibbles of a byte in the same transaction
+  if (_burstLen > LCD_BURST_SIZE - 6) {
+    transmit();
+  }
   write4bits((highnib) | mode);
   write4bits((lownib) | mode);
 }
@@ -200,22 +289,62 @@ void CSE321_LCD::write4bits(unsigned char value) {
   pulseEnable(value);
 }
 
+// Queue one expander state; nothing goes on the bus until transmit().
 void CSE321_LCD::expanderWrite(unsigned char _data) {
-  char data_write[2];
-  data_write[0] = _data | _backlightval;
   // Wire.beginTransmission(_addr);
   // Wire.write((int)(_data) | _backlightval);
   // Wire.endTransmission();
-  i2c.write(_addr, data_write, 1, 0);
-  i2c.stop();
+  _burst[_burstLen++] = _data | _backlightval;
 }
 
+// The PCF8574 updates its outputs after every byte of a multi-byte write, so
+// each queued state is held for one byte time on the bus: 90us at 100kHz,
+// 22.5us at 400kHz. One byte time covers the >450ns enable pulse. The LCD
+// latches a nibble when En falls, and each nibble takes three states, so the
+// next nibble is latched three byte times later (270us at 100kHz, 67.5us at
+// 400kHz). That covers the >37us a command needs to execute, which is why
+// there are no waits between the queued states.
 void CSE321_LCD::pulseEnable(unsigned char _data) {
-  expanderWrite(_data | En); // En high
-  wait_us(1);                // enable pulse must be >450ns
-
+  expanderWrite(_data | En);  // En high
   expanderWrite(_data & ~En); // En low
-  wait_us(50);                // commands need > 37us to settle
+}
+
+// Send every queued expander state in a single I2C write.
+// Where the target supports it the transfer runs from interrupts, and the
+// calling thread sleeps until it completes instead of polling the bus.
+void CSE321_LCD::transmit() {
+  if (_burstLen == 0) {
+    return;
+  }
+#if DEVICE_I2C_ASYNCH
+  if (i2c.transfer(_addr, _burst, _burstLen, NULL, 0,
+                   callback(this, &CSE321_LCD::transferDone),
+                   I2C_EVENT_ALL) == 0) {
+    _transferDone.acquire();
+    _burstLen = 0;
+    return;
+  }
+#endif
+  i2c.write(_addr, _burst, _burstLen, 0);
+  _burstLen = 0;
+}
+
+void CSE321_LCD::transferDone(int event) { _transferDone.release(); }
+
+// Fill the bar glyphs' CGRAM locations in one go: the address counter moves
+// on after every row, so one address and 8 rows per glyph is all it takes.
+void CSE321_LCD::loadBarGlyphs() {
+  send(LCD_SETCGRAMADDR | (LCD_BAR_GLYPH << 3), 0);
+  for (int lit = 1; lit < LCD_BAR_STEPS; lit++) {
+    unsigned char dots = (0x1F << (LCD_BAR_STEPS - lit)) & 0x1F;
+    for (int i = 0; i < 8; i++) {
+      send(dots, Rs);
+    }
+  }
+  transmit();
+
+  // the address counter now points into CGRAM
+  _cursorKnown = false;
 }
 
 void CSE321_LCD::load_custom_character(unsigned char char_num,
@@ -235,7 +364,80 @@ int CSE321_LCD::print(const char *text) {
 
   while (*text != 0) {
     send(*text, Rs);
+    track(*text);
     text++;
   }
+  transmit();
   return 0;
+}
+
+//-----------------------Frame buffer-------------------------------------------
+
+void CSE321_LCD::draw(unsigned char col, unsigned char row, const char *text,
+                      unsigned char width) {
+  if (row >= _rows) {
+    return;
+  }
+  unsigned char end = _cols;
+  if (width > 0 && col + width < end) {
+    end = col + width;
+  }
+  while (col < _cols && *text != 0) {
+    _frame[row][col++] = *text++;
+  }
+  while (col < end) {
+    _frame[row][col++] = ' ';
+  }
+}
+
+void CSE321_LCD::drawBar(unsigned char col, unsigned char row, int level,
+                         unsigned char width) {
+  if (row >= _rows) {
+    return;
+  }
+  if (level < 0) {
+    level = 0;
+  }
+  for (unsigned char i = 0; i < width && col + i < _cols; i++) {
+    int lit = level - i * LCD_BAR_STEPS;
+    unsigned char cell;
+    if (lit >= LCD_BAR_STEPS) {
+      cell = LCD_FULL_BLOCK;
+    } else if (lit > 0) {
+      cell = LCD_BAR_GLYPH + lit - 1;
+    } else {
+      cell = ' ';
+    }
+    _frame[row][col + i] = cell;
+  }
+}
+
+void CSE321_LCD::clearFrame() { memset(_frame, ' ', sizeof(_frame)); }
+
+int CSE321_LCD::flush() {
+  int sent = 0;
+
+  for (unsigned char row = 0; row < _rows; row++) {
+    for (unsigned char col = 0; col < _cols; col++) {
+      if (!_stale && _frame[row][col] == _shadow[row][col]) {
+        continue;
+      }
+
+      // only move the cursor when it is not already on this cell
+      if (!_cursorKnown || _cursorRow != row || _cursorCol != col) {
+        send(LCD_SETDDRAMADDR | (col + row_offsets[row]), 0);
+        _cursorRow = row;
+        _cursorCol = col;
+        _cursorKnown = true;
+      }
+      send(_frame[row][col], Rs);
+      _shadow[row][col] = _frame[row][col];
+      _cursorCol++;
+      sent++;
+    }
+  }
+
+  transmit();
+  _stale = false;
+  return sent;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 //modified from https://os.mbed.com/users/Yar/code/LiquidCrystal_I2C_for_Nucleo/
 
+#ifndef LCD1602_H
+#define LCD1602_H
+
  #include "mbed.h"
  
 // commands
@@ -48,6 +51,25 @@
 #define En 0x04//B00000100  // Enable bit
 #define Rw 0x02 // B00000010  // Read/Write bit
 #define Rs 0x01 //B00000001  // Register select bit
+
+// Expander bytes buffered before they are sent as one I2C transaction.
+// Each byte sent to the LCD takes 6 (two nibbles of setup, En high, En low).
+#define LCD_BURST_SIZE 102
+
+// Largest display the frame buffer can hold
+#define LCD_MAX_COLS 20
+#define LCD_MAX_ROWS 4
+
+// Columns of dots in one character cell, the steps of a bar per cell
+#define LCD_BAR_STEPS 5
+
+// First CGRAM location of the partial bar glyphs, which have 1 to
+// LCD_BAR_STEPS - 1 columns lit. Location 0 is left alone, since its code
+// ends a string.
+#define LCD_BAR_GLYPH 1
+
+// Character ROM code of the full block
+#define LCD_FULL_BLOCK 0xFF
  
 /**
  * This is the driver for the Liquid Crystal LCD displays that use the I2C bus.
@@ -55,6 +77,15 @@
  * After creating an instance of this class, first call begin() before anything else.
  * The backlight is on by default, since that is the most likely operating mode in
  * most cases.
+ *
+ * Text can either be sent straight away with setCursor()/print(), or drawn into
+ * a frame buffer with draw() and sent with flush(). flush() only sends the cells
+ * that differ from what the display already shows, so redrawing an unchanged
+ * screen costs no I2C traffic at all.
+ *
+ * begin() loads partial block glyphs into CGRAM for drawBar(), which draws a
+ * horizontal bar to one column of dots. A bar that grows or shrinks by a few
+ * columns changes one or two cells, so flush() only sends those.
  */
 class CSE321_LCD {
 public:
@@ -71,8 +102,13 @@ public:
  
     /**
      * Set the LCD display in the correct begin state, must be called before anything else is done.
+     *
+     * @param warm  The LCD kept its power since it was last set up, as after a watchdog or
+     *              software reset of the microcontroller. The power-on waits, over a second,
+     *              are skipped and the controller is only brought back to a known state, which
+     *              takes a few milliseconds. Pass false after a power-on reset.
      */
-    void begin();
+    void begin(bool warm = false);
  
      /**
       * Remove all the characters currently shown. Next print/write operation will start
@@ -143,11 +179,50 @@ public:
     void setBacklight(unsigned char new_val);             // alias for backlight() and nobacklight()
     void load_custom_character(unsigned char char_num, unsigned char *rows);    // alias for createChar()
     int print(const char* text);
+
+    /**
+     * Write text into the frame buffer. Nothing is sent to the display until
+     * flush() is called. Text that does not fit on the row is cut off.
+     *
+     * @param col   Column to start at.
+     * @param row   Row to write to.
+     * @param text  Text to write.
+     * @param width If longer than the text, pad with spaces up to this many cells.
+     */
+    void draw(unsigned char col, unsigned char row, const char* text, unsigned char width = 0);
+
+    /**
+     * Draw a horizontal bar into the frame buffer, filled from the left to one
+     * column of dots. Nothing is sent to the display until flush() is called.
+     *
+     * @param col   Column to start at.
+     * @param row   Row to draw on.
+     * @param level Columns of dots lit, 0 to width * LCD_BAR_STEPS.
+     * @param width Cells the bar spans, cut off at the end of the row.
+     */
+    void drawBar(unsigned char col, unsigned char row, int level, unsigned char width);
+
+    /**
+     * Fill the frame buffer with spaces. Unlike clear(), nothing is sent.
+     */
+    void clearFrame();
+
+    /**
+     * Send every cell of the frame buffer that differs from the display, moving
+     * the cursor only where a run of changed cells starts.
+     *
+     * @return Number of cells sent.
+     */
+    int flush();
 private:
     void send(unsigned char, unsigned char);
     void write4bits(unsigned char);
     void expanderWrite(unsigned char);
     void pulseEnable(unsigned char);
+    void transmit();
+    void transferDone(int);
+    void track(unsigned char);
+    void loadBarGlyphs();
     unsigned char _addr;
     unsigned char _displayfunction;
     unsigned char _displaycontrol;
@@ -157,7 +232,29 @@ private:
     unsigned char _charsize;
     unsigned char _backlightval;
 
+    // Cells callers want shown, and cells the display's DDRAM holds
+    unsigned char _frame[LCD_MAX_ROWS][LCD_MAX_COLS];
+    unsigned char _shadow[LCD_MAX_ROWS][LCD_MAX_COLS];
+
+    // Set when the display may not match _shadow, so flush() resends everything
+    bool _stale;
+
+    // Where the next character will land, if known
+    unsigned char _cursorCol;
+    unsigned char _cursorRow;
+    bool _cursorKnown;
+
+    // Expander states waiting to go out in the next I2C transaction
+    char _burst[LCD_BURST_SIZE];
+    int _burstLen;
+
+#if DEVICE_I2C_ASYNCH
+    // Released by the I2C interrupt when an asynchronous transfer completes
+    Semaphore _transferDone;
+#endif
+
        //MBED I2C object used to transfer data to LCD
     I2C i2c;       
 };
- 
\ No newline at end of file
+
+#endif /* LCD1602_H */
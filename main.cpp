@@ -29,24 +29,77 @@ https://os.mbed.com/users/Powers/code/YT_001_HCSR04//file/777a2656a150/main.cpp/
 // Rotary Encoder header file
 #include "QEI.h"
 
+// Distance sensor driver header files
+#include "HCSR04.h"
+#include "VL53L0X.h"
+
+// Distance sensor scheduler header file
+#include "SonarArray.h"
+
+// Non-blocking LCD front-end header file
+#include "LCDRenderer.h"
+
+// Lock-free shared state header file
+#include "SystemState.h"
+
+// Latency trace header file
+#include "Trace.h"
+
+// Binary telemetry header file
+#include "Telemetry.h"
+
+// Deferred console logging header file
+#include "Logger.h"
+
+// Occupancy statistics header file
+#include "OccupancyStats.h"
+
+// Buzzer pattern header file
+#include "BuzzerSequencer.h"
+
+// Deep sleep and duty cycle header file
+#include "PowerManager.h"
+
+// Heartbeat supervisor header file
+#include "Supervisor.h"
+
+// Main loop execution time header file
+#include "Wcet.h"
+
+// Persistent settings header files
+#include "ConfigStore.h"
+#include "FlashIAPBlockDevice.h"
+
 // C standard IO header file
 #include <cstdio>
 
+// C++ atomics header file
+#include <atomic>
+
 /**
  * minDistance is the minimum "safe" distance from the system in centimeters
  * By default this is set to 183 cm, or 6 feet, as recommended by the CDC.
  */
 int minDistance = 183;
 
-// dist keeps track of the distance the ultrasonic sensor returns.
-int dist;
+/**
+ * dist keeps track of the closest distance the ultrasonic sensors return. It is
+ * -1 while there is no target in range.
+ */
+int dist = -1;
 
-// pulse keeps track of the previous state of the rotary encoder.
+// pulse keeps track of the encoder pulses already turned into distance steps.
 int pulse = 0;
 
 // isWarning keeps track if the system is currently displaying the Warning text
 bool isWarning = false;
 
+// buzzing keeps track of whether the Buzzer is on.
+bool buzzing = false;
+
+// reported keeps track of how many samples of each sensor were sent out.
+unsigned int reported[SONAR_MAX_SENSORS];
+
 /**
  * menu 1 and menu 2 are strings that are to be later displayed onto the
  * LCD Display.
@@ -57,43 +110,88 @@ char menu2[] = "Set new distance";
 char warning[] = "Please Back Up! ";
 
 /**
- * get_time stores the time between the ultrasonic sensor's outgoing wave and
- * reflected wave.
+ * state holds which menu the user is in, whether the top line of the LCD needs
+ * to be redrawn, and the number of times the User Push button was pressed.
+ * The button handler and the main loop both change it, and each change is a
+ * single atomic step, so no thread ever waits on another for it. This
+ * technique was used for our synchronization requirement.
+ */
+SystemState state;
+
+/**
+ * config is the snapshot of the settings the sensing loop works from: the
+ * threshold, the ping interval and the menu mode. Only the main loop writes
+ * it. Any thread can read a consistent copy of it without taking a lock.
  */
-Timer get_time;
+SeqLock<Config> config;
 
 /**
- * The below 3 variables are to be used with synchronization, as unplanned
- * changes to them can cause undesired results. They are set as "volatile".
+ * stats counts approaches, violations, violation time, dwell time and the
+ * closest approach per minute, hour and day, from every distance sample.
+ * Type "s" on the console to print them.
  */
-// pbcounter keeps track of the number of times the User Push button is pressed.
-volatile int pbcounter = 0;
+OccupancyStats stats;
 
 /**
- * printed is a boolean that determines whether or not the top line of the LCD
- * has printed.
+ * wcet times every pass of the main loop, call by call, against the budget
+ * set by loop-budget-us in mbed_app.json, and notes which paths each pass
+ * took. Type "w" on the console to print the worst case.
  */
-volatile bool printed = true;
+Wcet wcet(MBED_CONF_APP_LOOP_BUDGET_US);
 
 /**
- * isChanging is a boolean that determines if the user has switched between the
- * menus. If it is false, then the user is at the default menu. If it is true,
- * then the user is at the "Change Distance" menu.
+ * inSettings keeps track of whether the last pass of the main loop was in the
+ * "Set new distance" menu, to tell the first pass after a switch.
  */
-volatile bool isChanging = false;
+bool inSettings = false;
 
-/*
- * lock is a mutex that prevents any change to the above 3 variables from other
- * threads when used. This technique was used for our synchronization
- * requirement.
+/**
+ * sound converts the Ultrasonic sensors' echo times to distances, at the air
+ * temperature and with the calibration saved in flash.
+ */
+TimeOfFlight sound;
+
+#if MBED_CONF_APP_TIME_OF_FLIGHT
+/**
+ * Initialization of the VL53L0X time-of-flight sensor, chosen with the
+ * time-of-flight option, on I2C3 so it does not share the LCD's bus.
+ * SDA is PC_1 and SCL is PC_0. The sensor's GPIO1 output, which tells that a
+ * measurement is ready, is on pin D7 (PF_13).
  */
-Mutex lock;
+I2C rangeBus(PC_1, PC_0);
+VL53L0X sonar(rangeBus, D7);
+typedef VL53L0X RangeDriver;
+#else
+/**
+ * Initialization of the Ultrasonic sensor.
+ * The first argument is the trigger output and pin D9 (PD_15) is assigned.
+ * The second argument is the echo input. By default pin D8 (PF_12) is
+ * assigned and the echo edges are timestamped by interrupts. With the
+ * echo-input-capture option, the echo must be wired to pin D13 (PA_5) instead,
+ * where TIM2 measures it in hardware. Either way, measuring never blocks.
+ */
+#if MBED_CONF_APP_ECHO_INPUT_CAPTURE
+HCSR04 sonar(D9, D13, sound);
+#else
+HCSR04 sonar(D9, D8, sound);
+#endif
+typedef HCSR04 RangeDriver;
+#endif
 
-// Enable pin D9 (PD_15) as an output for the Ultrasonic sensor's trigger
-DigitalOut trigger(D9);
+/**
+ * sensors lists every distance sensor, in physical order so that sensors
+ * next to each other are next to each other in the list. To cover a wider
+ * area, initialize more sensors of the same kind and add them here.
+ */
+RangeDriver *sensors[] = {&sonar};
 
-// Enable pin D9 (PF_12) as an input for the Ultrasonic sensor's echo
-DigitalIn echo(D8);
+/**
+ * Initialization of the distance sensor scheduler. It pings the sensors one
+ * after the other, staggered so they do not hear each other's echoes, and
+ * keeps the latest distance of each sensor. It is built for the one kind of
+ * sensor, so its calls into the driver are direct.
+ */
+SonarArray<RangeDriver> sonars(sensors, sizeof(sensors) / sizeof(sensors[0]));
 
 /**
  * Enable pin PB_8 as a PWM output. PWM was used to completely turn the buzzer
@@ -101,6 +199,12 @@ DigitalIn echo(D8);
  */
 PwmOut Buzzer(PB_8);
 
+/**
+ * Initialization of the buzzer patterns. The PWM itself times the beeps, so
+ * the buzzer is only touched when the alarm level changes. It starts quiet.
+ */
+BuzzerSequencer beeper(Buzzer);
+
 /**
  * Initialization of a QEI object.
  * The first argument is "Channel A" (DT) and PE_10 is assigned.
@@ -119,6 +223,72 @@ QEI encoder(PE_10, PE_12, NC, 1);
  */
 CSE321_LCD lcd(16, 2, LCD_5x8DOTS, PF_0, PF_1);
 
+/**
+ * Initialization of the LCD front-end. All LCD output goes through display,
+ * which queues it for a low priority render thread, so the main loop never
+ * waits on the I2C bus or the LCD.
+ */
+LCDRenderer display(lcd);
+
+/**
+ * Initialization of the telemetry stream. Every sample and every change of
+ * settings is sent as a small binary frame on the UART TX pin set by the
+ * telemetry-tx option (D1 by default), by interrupts, so the main loop never
+ * waits on the UART. tools/telemetry_decode turns the stream into CSV.
+ */
+Telemetry telemetry(MBED_CONF_APP_TELEMETRY_TX, MBED_CONF_APP_TELEMETRY_BAUD);
+
+/**
+ * Initialization of the console logger. Messages are queued with
+ * logger.print() and printed later by a low priority thread, so no thread
+ * ever waits for the console UART to send them.
+ */
+Logger logger;
+
+/**
+ * Initialization of the settings store, in the flash region set by
+ * flashiap-block-device in mbed_app.json. saved holds the settings it has
+ * last written or restored, and is only touched by the EventQueue thread
+ * once the main loop runs. queued is the minDistance the main loop last
+ * asked it to save.
+ */
+FlashIAPBlockDevice flash;
+ConfigStore store(flash);
+Settings saved;
+int queued = 0;
+
+/**
+ * Initialization of the power manager. Between pings the core goes into deep
+ * sleep, unless the console is listening for commands, which it only does for
+ * the time set by console-listen-ms in mbed_app.json after startup, a button
+ * press or a command. Holding the button for a second wakes it without
+ * switching the menu. Type "p" on the console to print the time spent
+ * running, sleeping and in deep sleep.
+ */
+PowerManager power(MBED_CONF_APP_CONSOLE_LISTEN_MS);
+
+// lastTurn is when the knob last moved minDistance, in milliseconds.
+uint64_t lastTurn = 0;
+
+// buttonDownAt is when the user push button last went down, in milliseconds.
+uint64_t buttonDownAt = 0;
+
+/**
+ * clearRequested is set by the "r" console command. The main loop clears the
+ * trace and the loop timing at the start of its next pass, as only it may
+ * touch the pass being timed.
+ */
+std::atomic<bool> clearRequested(false);
+
+/**
+ * warmStart is true when the system was reset without losing power, by the
+ * watchdog or in software, so the LCD is still powered and set up.
+ */
+bool warmStart = false;
+
+// booted is set once the main loop has acted on its first sample.
+bool booted = false;
+
 /**
  * Initialization of the User Push Button (PC_13) as an interrupt input.
  * PullDown is used to give it a default value of off.
@@ -138,42 +308,189 @@ EventQueue q(32 * EVENTS_EVENT_SIZE);
 // Initialization of the WatchDog Timer
 Watchdog &dog = Watchdog::get_instance();
 
+/**
+ * Initialization of the heartbeat supervisor. The sensing loop, the LCD
+ * render thread, the EventQueue thread and the telemetry UART each post
+ * heartbeats, and the WatchDog is only kicked while all of them keep to their
+ * deadlines. Which one missed, and by how much, is printed after the reset.
+ */
+Supervisor supervisor(dog);
+
+// The supervisor's index of each task.
+int sensingTask = -1;
+int displayTask = -1;
+int eventsTask = -1;
+int telemetryTask = -1;
+
+// telemetrySent keeps track of how many telemetry bytes had gone out.
+unsigned int telemetrySent = 0;
+
 /**
  * wdTimeout is the time for how long the WatchDog waits until it resets the
- * system. It is set to a value of 30000 milliseconds, or 30 seconds.
+ * system. It is set to a value of 4000 milliseconds, or 4 seconds. The
+ * supervisor kicks it every second while every task is healthy.
  */
-#define wdTimeout 30000
+#define wdTimeout 4000
+
+/**
+ * Deadlines of the tasks in milliseconds. Sensing takes a sample at least
+ * every 2 seconds, and the EventQueue gets a heartbeat event every second.
+ * The render thread and the telemetry only have work when the sensing loop
+ * gives them some, so they get longer deadlines and a stuck sensing loop is
+ * the first to miss.
+ */
+#define sensingDeadline 5000
+#define eventsDeadline 3000
+#define displayDeadline 8000
+#define telemetryDeadline 8000
+
+// eventsBeat is the interval of the EventQueue's heartbeat in milliseconds.
+#define eventsBeat 1000
+
+/**
+ * airTemperature is the temperature of the air in tenths of a degree Celsius,
+ * which sets the speed of sound used to convert echo times to distances. It
+ * is set to 20 degrees, as there is no temperature sensor.
+ */
+#define airTemperature 200
+
+/**
+ * knobPulses is the number of encoder pulses in one detent of the knob.
+ * The encoder goes through a full cycle per detent, which X2 decoding counts
+ * as 2 pulses.
+ */
+#define knobPulses 2
+
+/**
+ * knobMaxStep is the most centimeters one detent can move minDistance when
+ * the knob is spun fast.
+ */
+#define knobMaxStep 20
+
+/**
+ * minSetting and maxSetting are the smallest and largest minDistance the knob
+ * can set, in centimeters. The largest is as far as the distance sensor
+ * reaches, 400 cm for the Ultrasonic sensor and 200 cm for the VL53L0X, as
+ * a threshold beyond that could never be crossed.
+ */
+#define minSetting 31
+#define maxSetting (RangeDriver::maxMm() / 10)
+
+/**
+ * barCells is the number of cells the proximity bar spans, the whole second
+ * line of the LCD. Each cell has 5 columns of dots, so the bar has 80 steps.
+ */
+#define barCells 16
+
+/**
+ * saveDelay is how long the knob must rest, in milliseconds, before a new
+ * minDistance is saved, so a spin of the knob is written to flash once.
+ */
+#define saveDelay 1000
+
+/**
+ * buttonHold is how long, in milliseconds, the user push button must be held
+ * for the press to only wake the console instead of switching the menu.
+ */
+#define buttonHold 1000
 
 // Below are the prototyping for all of the functions in the program.
 
 // Function prototype for the Ultrasonic sensor code.
 int Ultrasonic(void);
 
+// Function prototype for the start of a button press.
+void ButtonDown(void);
+
 // Function prototype for system menu logic.
 void ChangeDistance(void);
 
-// Function prototype for WatchDog timer reset.
-void resetDog();
+// Function prototype for the EventQueue's heartbeat.
+void beatEvents();
+
+// Function prototype for the render thread's heartbeat.
+void beatDisplay();
 
 // Function prototype for turning the Buzzer on.
-void BuzzerOn();
+bool BuzzerOn(int level);
 
 // Function prototype for turning the Buzzer off.
-void BuzzerOff();
+bool BuzzerOff();
 
 // Function prototype for LCD display logic.
 void printMenu(char[]);
 
+// Function prototype for publishing the settings snapshot.
+void publishConfig(int interval);
+
+// Function prototype for the knob acceleration.
+int knobStep(int velocity);
+
+// Function prototype for sending the new samples as telemetry.
+void sendTelemetry();
+
+// Function prototype for the console input interrupt.
+void consoleInput();
+
+// Function prototype for the console commands.
+void readConsole();
+
+// Function prototype for restoring the saved settings.
+void restoreSettings();
+
+// Function prototype for handing a changed threshold to the EventQueue.
+void queueSave();
+
+// Function prototype for saving changed settings.
+void saveSettings();
+
+// Function prototype for timing the first decision after startup.
+void bootDone();
+
+// Function prototype for the length of the proximity bar.
+int proximity(int distance, int threshold);
+
+// Function prototype for how urgent the alarm is.
+int alarmLevel(int distance, int threshold);
+
 // main method
 int main() {
+  /**
+   * Start the cycle counter for the latency trace first, so the boot
+   * timeline counts from here.
+   */
+  Trace::start();
+
+  // Start printing the console messages.
+  logger.start();
+
   // Used to separate instances.
-  printf("------Start------\n");
+  logger.print("------Start------\n");
+
+  // Find out whether the LCD kept its power through the reset.
+  reset_reason_t reason = ResetReason::get();
+  warmStart = reason == RESET_REASON_WATCHDOG ||
+              reason == RESET_REASON_SOFTWARE ||
+              reason == RESET_REASON_LOCKUP;
+  logger.print("%s start\n", warmStart ? "warm" : "cold");
+
+  // Say which task kept the watchdog from being kicked before the reset.
+  Supervisor::Miss miss;
+  if (Supervisor::missed(miss)) {
+    logger.print("%s missed its heartbeat by %u ms, %u ms after startup\n",
+                 miss.task, (unsigned int)miss.lateMs,
+                 (unsigned int)miss.atMs);
+  }
 
   /**
-   * Start the watchdog, have it restart the system after wdTimeout
-   * milliseconds.
+   * Add the tasks to the supervisor, then start the watchdog, which restarts
+   * the system wdTimeout milliseconds after a task misses its deadline.
    */
-  dog.start(wdTimeout);
+  sensingTask = supervisor.add("sensing", sensingDeadline);
+  displayTask = supervisor.add("display", displayDeadline);
+  eventsTask = supervisor.add("events", eventsDeadline);
+  telemetryTask = supervisor.add("telemetry", telemetryDeadline);
+  supervisor.start(wdTimeout);
 
   /**
    * Direct Bit-wise configuration to program the pin PC_13 (user push button)
@@ -191,171 +508,290 @@ int main() {
    */
   t.start(callback(&q, &EventQueue::dispatch_forever));
 
+  // Have the EventQueue post its heartbeat, so a stuck event is noticed.
+  q.call_every(std::chrono::milliseconds(eventsBeat), &beatEvents);
+
   /**
    * Set up the user push button to trigger an interrupt when pressed (on the
-   * rise).
+   * rise) and when released (on the fall). The menu switches on the release,
+   * once it is known whether the button was only held to wake the console.
    */
-  button.rise(q.event(&ChangeDistance));
+  button.rise(q.event(&ButtonDown));
+  button.fall(q.event(&ChangeDistance));
 
-  // Turn off the buzzer.
-  Buzzer.suspend();
+  // Print the latency trace whenever "t" is typed on the console.
+  mbed_file_handle(STDIN_FILENO)->sigio(callback(&consoleInput));
 
-  // Set the Ultrasonic sensor's trigger to low for the start of the program.
-  trigger = 0;
+  // String buffer that is used to convert minDistance to a string later.
+  char Ebuffer[5];
 
-  // String buffers that are used to convert int to string later.
-  char buffer[3];
-  char Ebuffer[3];
+  // interval keeps track of the last ping interval printed to the console.
+  int interval = 0;
 
-  // Set up the LCD to start displaying text.
-  lcd.begin();
+  // bar keeps track of the length of the proximity bar last drawn.
+  int bar = -1;
 
-  // Clear the LCD display.
-  lcd.clear();
+  /**
+   * Start the LCD render thread, which sets up the LCD to start displaying
+   * text while the main loop carries on. After a warm start that takes a few
+   * milliseconds instead of over a second.
+   */
+  display.attach(callback(&beatDisplay));
+  display.start(warmStart);
 
   // Print "Social Distance" to the first line of the LCD display.
-  lcd.print("Social Distance");
+  display.draw(0, 0, menu1, 16);
+  display.flush();
+
+  /**
+   * Restore the settings saved before the last reset, so a watchdog reset
+   * does not lose the threshold, then start pinging.
+   */
+  restoreSettings();
+
+  // Set up every distance sensor. One that does not answer reports no target.
+  for (int i = 0; i < sonars.count(); i++) {
+    if (!sensors[i]->init()) {
+      logger.print("distance sensor %d did not answer\n", i);
+    }
+  }
+  sonars.start();
+
+  // Publish the default settings.
+  publishConfig(sonars.interval());
 
   // Loop to run forever
   while (true) {
+    // Clear the trace and the loop timing between passes, if asked to.
+    if (clearRequested.exchange(false)) {
+      Trace::reset();
+      wcet.reset();
+      logger.print("trace cleared\n");
+    }
+
+    // Turn the console input off once nobody has used it for a while.
+    power.update(Kernel::get_ms_count());
+
+    // The telemetry is healthy while it has nothing to send or is sending.
+    unsigned int sent = telemetry.sent();
+    if (telemetry.pending() == 0 || sent != telemetrySent) {
+      supervisor.beat(telemetryTask);
+    }
+    telemetrySent = sent;
+
     /**
-     * If push button has been pressed and isChanging is true, then the system
-     * should be at the "Set new distance" menu. Being in this menu for too long
-     * will trigger the Watchdog and reset minDistance to 183.
+     * If push button has been pressed and the mode is MODE_SETTINGS, then the
+     * system should be at the "Set new distance" menu.
      */
-    if (isChanging) {
+    if (state.settings()) {
+      // Time the work this pass of the loop does, call by call.
+      wcet.begin();
+      uint32_t paths = 1U << WCET_SETTINGS_MENU;
+      if (!inSettings) {
+        paths |= 1U << WCET_SWITCH;
+
+        // Nothing is sampled in the menu, so its time is not counted.
+        stats.pause(Kernel::get_ms_count());
+      }
+      inSettings = true;
+
+      // Sensing is paused in the menu, so the menu counts as its heartbeat.
+      supervisor.beat(sensingTask);
+
       // Call printMenu to print "Set new distance" to LCD
       printMenu(menu2);
+      wcet.lap(WCET_MENU);
 
       // Turn the Buzzer off
       BuzzerOff();
+      wcet.lap(WCET_BUZZER);
 
       // Adjust delay for knob turning speed，currently set for 50 ms delay
       thread_sleep_for(50);
 
-      // pulses stores the current state of the encoder
-      int pulses = encoder.getPulses();
+      // The delay is not work, so it is not timed.
+      wcet.skip();
+
+      // knob stores the current position and speed of the encoder.
+      QEI::Snapshot knob = encoder.getSnapshot();
 
       /**
-       * minDistance should not be smaller than the recommended distance by CDC
-       * (currently 6 feet or 183 cm).
-       * The maximum detectable distance is 400cm for the Ultrasonic sensor.
-       * For Demoing purposes, minimum settable distance is 1 foot or 31 cm.
+       * Number of whole detents turned since last time, positive to the
+       * right. Half a detent is kept for next time.
        */
+      int detents = (knob.pulses - pulse) / knobPulses;
 
-      // If minDistance is less than 31, set it equal to 31.
-      if (minDistance < 31) {
-        minDistance = 31;
-      }
+      // If encoder has been turned, move minDistance by every detent turned.
+      if (detents != 0) {
+        /**
+         * Slow turns move one centimeter per detent, for fine changes. Faster
+         * spins move further per detent, so a large change takes one spin.
+         */
+        minDistance += detents * knobStep(knob.velocity);
 
-      // If minDistance is greater than 400, set it equal to 400.
-      else if (minDistance > 400) {
-        minDistance = 400;
-      }
+        // Mark the detents as used.
+        pulse += detents * knobPulses;
 
-      // If encoder has been turned, determine which direction it was turned.
-      else if (pulse != pulses) {
-        // If turned to the right, increase minDistance.
-        if (pulse < pulses) {
-          minDistance++;
+        // Remember when, so the change is saved once the knob rests.
+        lastTurn = Kernel::get_ms_count();
+        paths |= 1U << WCET_TURN;
+
+        /**
+         * minDistance should not be smaller than the recommended distance by
+         * CDC (currently 6 feet or 183 cm).
+         * The maximum settable distance is as far as the distance sensor
+         * reaches. For Demoing purposes, minimum settable distance is 1 foot
+         * or 31 cm.
+         */
+
+        // If minDistance is less than minSetting, set it equal to minSetting.
+        if (minDistance < minSetting) {
+          minDistance = minSetting;
         }
 
-        // If turned to the left, decrease minDistance.
-        else {
-          minDistance--;
+        // If minDistance is greater than maxSetting, set it equal to it.
+        else if (minDistance > maxSetting) {
+          minDistance = maxSetting;
         }
+      }
+      wcet.lap(WCET_KNOB);
 
-        // Update pulse to equal the current encoder state.
-        pulse = pulses;
+      // Publish the new threshold if it changed, which also sends it out.
+      publishConfig(sonars.interval());
 
-        // Print the minDistance to the console.
-        printf("%d\n", minDistance);
-      }
+      // Have the new threshold saved once the knob has rested.
+      queueSave();
+      wcet.lap(WCET_SETTINGS);
 
       // Convert minDistance to a string.
       sprintf(Ebuffer, "%d", minDistance);
+      wcet.lap(WCET_FORMAT);
 
-      // Print minDistance to the second line of LCD.
-      lcd.setCursor(0, 1);
-      lcd.print(Ebuffer);
-
-      // If minDistance is not a 3 digit number, clear the third digit.
-      if (minDistance < 100) {
-        lcd.setCursor(2, 1);
-        lcd.print(" ");
-      }
+      /**
+       * Draw minDistance on the second line of the LCD, padded with spaces to
+       * clear any digits left over from a longer number and the proximity
+       * bar.
+       */
+      display.draw(0, 1, Ebuffer, barCells);
 
-      // If minDistance is not a 2 digit number, clear the second digit as well.
-      if (minDistance < 10) {
-        lcd.setCursor(1, 1);
-        lcd.print(" ");
-      }
+      // Send only the parts of the LCD that changed.
+      display.flush();
+      wcet.lap(WCET_LCD);
+      wcet.end(paths);
     }
 
     /**
      * The default state of the system.
-     * If push button has been pressed and isChanging is false, then the system
-     * should be at the default menu.
+     * If push button has been pressed and the mode is MODE_DEFAULT, then the
+     * system should be at the default menu.
      */
     else {
-      // Check for the distance every 300 ms.
-      thread_sleep_for(300);
-
-      // Store the distance between object and sensor in dist.
-      dist = Ultrasonic();
-
-      // Print the distance to the console.
-      printf("%d\n", dist);
+      /**
+       * Wait for the next distance sample, checking the menu at least every
+       * 300 ms. The sensors are pinged by sonars in the background, faster
+       * when someone is close or approaching and slower when nobody is in
+       * range, so the alarm reacts as quickly as the samples arrive.
+       */
+      bool sampled = sonars.wait(300);
+
+      // Time the work this pass of the loop does, in all and call by call.
+      uint32_t begin = Trace::now();
+      wcet.begin();
+      uint32_t paths = 0;
+      if (inSettings) {
+        paths |= 1U << WCET_SWITCH;
+      }
+      inSettings = false;
 
-      // Convert dist to a string.
-      sprintf(buffer, "%d", dist);
+      // Publish the settings, in case the menu or ping interval changed.
+      publishConfig(sonars.interval());
 
-      // Print dist to the second line of the LCD.
-      lcd.setCursor(0, 1);
-      lcd.print(buffer);
+      // Have a threshold set just before leaving the menu saved.
+      queueSave();
 
       /**
-       * If dist is not a 4 digit number, clear the fourth digit (In case of
-       * number formatting bugs).
+       * Take a consistent copy of the settings, and give every sensor the
+       * threshold from it.
        */
-      if (dist < 1000) {
-        lcd.setCursor(3, 1);
-        lcd.print(" ");
+      Config current = config.read();
+      sonars.setThresholds(current.minDistance);
+
+      // Print the ping interval to the console when it changes.
+      if (current.interval != interval) {
+        interval = current.interval;
+        logger.print("ping every %d ms\n", interval);
       }
+      wcet.lap(WCET_SETTINGS);
+
+      // Store the distance between object and sensor in dist.
+      dist = Ultrasonic();
 
-      // If dist is not a 3 digit number, clear the third digit.
-      if (dist < 100) {
-        lcd.setCursor(2, 1);
-        lcd.print(" ");
+      // Check if any sensor's filtered estimate is closer than minDistance.
+      bool violation = sonars.anyViolation();
+      wcet.lap(WCET_ULTRASONIC);
+      if (dist < 0) {
+        paths |= 1U << WCET_NO_TARGET;
       }
+      paths |= 1U << (violation ? WCET_WARNING : WCET_CLEAR);
+
+      // Trace how long a new sample took to get from its ping to here, and
+      // count it in the statistics.
+      if (sampled) {
+        supervisor.beat(sensingTask);
+        Trace::point(TRACE_DECISION, dist);
+        Trace::span(TRACE_SPAN_DECISION, sonars.sampledAt());
+        bootDone();
+        stats.update(Kernel::get_ms_count(), dist, violation);
+      }
+      wcet.lap(WCET_STATS);
+
+      // Send every new sample out as telemetry.
+      sendTelemetry();
+      wcet.lap(WCET_TELEMETRY);
 
-      // If dist is not a 2 digit number, clear the second digit as well.
-      if (dist < 10) {
-        lcd.setCursor(1, 1);
-        lcd.print(" ");
+      /**
+       * Draw how close dist is as a bar across the second line of the LCD.
+       * As someone moves, only the one or two cells at the end of the bar
+       * change, so little is sent.
+       */
+      int length = proximity(dist, current.minDistance);
+      display.bar(0, 1, length, barCells);
+      if (length != bar) {
+        bar = length;
+        paths |= 1U << WCET_BAR;
       }
+      wcet.lap(WCET_LCD);
 
-      // If object is closer than minDistance, turn the Buzzer on.
-      if (dist < minDistance) {
-        BuzzerOn();
+      /**
+       * If any sensor's filtered estimate is closer than minDistance, turn the
+       * Buzzer on, beeping faster the closer dist is. A single stray echo does
+       * not get through the filters.
+       */
+      if (violation) {
+        if (BuzzerOn(alarmLevel(dist, current.minDistance))) {
+          paths |= 1U << WCET_ALARM;
+        }
+        wcet.lap(WCET_BUZZER);
 
-        // Set the cursor to the top line of LCD, and print the warning message.
-        lcd.setCursor(0, 0);
-        lcd.print(warning);
+        // Draw the warning message on the top line of the LCD.
+        display.draw(0, 0, warning);
 
-        // Set printed to false, to allow default text to display later.
-        printed = false;
+        // Ask for a redraw, to allow default text to display later.
+        state.requestRedraw();
       }
 
       // If not, turn the Buzzer off.
       else {
-        BuzzerOff();
+        if (BuzzerOff()) {
+          paths |= 1U << WCET_ALARM;
+        }
+        wcet.lap(WCET_BUZZER);
 
         /**
-         * Call printMenu to print "Set new distance" to LCD if isChanging is
-         * true.
+         * Call printMenu to print "Set new distance" to LCD if the mode is
+         * MODE_SETTINGS.
          */
-        if (isChanging) {
+        if (current.mode == MODE_SETTINGS) {
           printMenu(menu2);
         }
 
@@ -364,9 +800,17 @@ int main() {
           printMenu(menu1);
         }
       }
+      wcet.lap(WCET_MENU);
 
-      // Reset the WatchDog Timer.
-      resetDog();
+      /**
+       * Send only the parts of the LCD that changed. If the distance and the
+       * message are the same as last time, nothing is sent.
+       */
+      display.flush();
+      wcet.lap(WCET_LCD);
+
+      Trace::span(TRACE_SPAN_LOOP, begin);
+      wcet.end(paths);
     }
   }
 
@@ -374,22 +818,45 @@ int main() {
   return 0;
 }
 
-// Resets the WatchDog Timer when called.
-void resetDog() {
-  // Refresh the timer.
-  dog.kick();
+// Heartbeat of the EventQueue thread, run on it every eventsBeat ms.
+void beatEvents() {
+  supervisor.beat(eventsTask);
+}
+
+// Heartbeat of the render thread, run on it after every batch of commands.
+void beatDisplay() {
+  supervisor.beat(displayTask);
 }
 
-// Turn the buzzer on if called.
-void BuzzerOn() {
-  // Turn the buzzer on.
-  Buzzer.resume();
+/**
+ * Turn the buzzer on if called. When it was off, trace the time from the ping
+ * that caught the violation to the alarm sounding. Returns true if the level
+ * changed.
+ */
+bool BuzzerOn(int level) {
+  if (!buzzing) {
+    Trace::span(TRACE_SPAN_ALARM, sonars.sampledAt());
+    buzzing = true;
+  }
+
+  // Play the level's beep pattern, which only reprograms it if it changed.
+  if (!beeper.post(level)) {
+    return false;
+  }
+  Trace::point(TRACE_BUZZER, level);
+  return true;
 }
 
-// Turn the buzzer off if called.
-void BuzzerOff() {
-  // Turn the buzzer off.
-  Buzzer.suspend();
+// Turn the buzzer off if called. Returns true if it was on.
+bool BuzzerOff() {
+  buzzing = false;
+
+  // Turn the buzzer off, unless it already is.
+  if (!beeper.post(0)) {
+    return false;
+  }
+  Trace::point(TRACE_BUZZER, 0);
+  return true;
 }
 
 /**
@@ -399,106 +866,301 @@ void BuzzerOff() {
  * https://os.mbed.com/users/Powers/code/YT_001_HCSR04//file/777a2656a150/main.cpp/
  * Last Updated: 06/03/2020
  *
- * Returns an int that represents the distance measured by the Ultrasonic sensor
- * when called.
+ * Returns an int that represents the closest distance measured by any of the
+ * Ultrasonic sensors when called, or -1 if there is no target in range.
+ * The distances are filtered estimates, so stray echoes do not show up here.
+ * This never waits on the sensors. They are pinged by sonars and their echoes
+ * are captured by interrupts; this only collects the latest results.
  */
 int Ultrasonic(void) {
 
-  // Temporary variable for distance measured.
-  int distance;
+  // The smallest distance across all sensors is the one that matters.
+  return sonars.closest();
+}
+
+/**
+ * Library: QEI
+ * Author: Chris Powers
+ * Link: https://os.mbed.com/users/aberk/code/QEI/docs/tip/classQEI.html
+ * Last Updated: 09/02/2010
+ *
+ * ISR function for the release of the User Push Button.
+ * This function changes the variables that determine which menu the user is
+ * currently in.
+ * The menu mode flips, the top line is marked for redrawing and the press is
+ * counted in one atomic step on state, so the main loop never sees half of
+ * the change and neither side has to wait for the other.
+ * A press held for buttonHold or longer only wakes the console, so commands
+ * can be typed without leaving the alarm.
+ */
+void ChangeDistance(void) {
+  // Listen on the console again, in case someone is about to type.
+  power.wake();
+
+  // A long press leaves the menu as it is.
+  if (Kernel::get_ms_count() - buttonDownAt >= buttonHold) {
+    logger.print("console listening\n");
+    return;
+  }
+
+  // Flip the mode, ask for a redraw and count the press.
+  state.toggleMode();
+
+  // Print to the console that the menu has changed.
+  logger.print("switched menu\n");
+}
+
+/**
+ * ISR function for the User Push Button going down. It only notes the time,
+ * so the release can tell a long press from a short one.
+ */
+void ButtonDown(void) { buttonDownAt = Kernel::get_ms_count(); }
 
+/**
+ * Draws the text that is passed in to the first line of the LCD Display.
+ * The values that are passed in only change top row text, so only the first
+ * line is affected. The text reaches the display on the next display.flush().
+ */
+void printMenu(char text[]) {
   /**
-   * Send a HI signal to start the Ultrasonic sensor's measurement by turning
-   * on trigger.
+   * If a redraw was asked for, the menu text needs to change. Taking the
+   * request clears it, so the menu text isn't constantly printing.
    */
-  trigger.write(1);
-
-  // Wait for 10 us.
-  wait_us(10);
+  if (state.takeRedraw()) {
+    // Replace the whole top line with the passed in text.
+    display.draw(0, 0, text, 16);
+  }
+}
 
-  // Send a LO signal to turn off the trigger.
-  trigger.write(0);
+/**
+ * Publishes minDistance, the ping interval and the menu mode as the new
+ * settings snapshot, if any of them changed, and sends them as telemetry.
+ * Only the main loop calls this, so there is only ever one writer.
+ */
+void publishConfig(int interval) {
+  Config next = {minDistance, interval, state.mode()};
+  Config last = config.read();
+
+  if (config.version() == 0 || next.minDistance != last.minDistance ||
+      next.interval != last.interval || next.mode != last.mode) {
+    config.write(next);
+    telemetry.config(Kernel::get_ms_count(), next.minDistance, next.interval,
+                     next.mode);
+  }
+}
 
-  // Do nothing while the echo is waiting for a HI signal.
-  while (echo.read() == 0) {
+/**
+ * Hands telemetry each sensor that finished a measurement since last time,
+ * with its raw echo, filtered distance, threshold and alarm state. If a
+ * sensor finished more than one, only the latest is sent, and only if its
+ * distance or alarm changed or a key frame is due. A frame that does not fit
+ * in the telemetry buffer is dropped rather than waited for.
+ */
+void sendTelemetry() {
+  for (int i = 0; i < sonars.count(); i++) {
+    unsigned int samples = sonars.samples(i);
+    if (samples != reported[i]) {
+      reported[i] = samples;
+      telemetry.sample(i, Kernel::get_ms_count(), sonars.echo(i),
+                       sonars.estimate(i), sonars.threshold(i),
+                       sonars.violation(i));
+    }
   }
+}
 
-  // Reset the timer, then start the timer.
-  get_time.reset();
-  get_time.start();
+/**
+ * Returns how many centimeters one detent moves minDistance, given the knob's
+ * velocity in pulses per second. Up to 5 detents per second it is 1, then it
+ * grows with the square of the speed, up to knobMaxStep.
+ */
+int knobStep(int velocity) {
+  // Speed in detents per second.
+  int speed = (velocity < 0 ? -velocity : velocity) / knobPulses;
 
-  // Do nothing while echo is waiting to be LO again.
-  while (echo.read() == 1) {
+  // Slow turns are single steps.
+  if (speed <= 5) {
+    return 1;
   }
 
-  // Stop the timer.
-  get_time.stop();
+  // Accelerate with the square of the speed.
+  int step = 1 + (speed * speed - 25) / 50;
 
-  // Store the time elapsed into distance.
-  distance = get_time.read_us();
+  // Never jump further than knobMaxStep.
+  if (step > knobMaxStep) {
+    step = knobMaxStep;
+  }
+  return step;
+}
 
-  // Calculate the distance using the time elapsed.
-  distance = distance * 0.03432f / 2.0f;
+/**
+ * ISR for characters arriving on the console. Reading and printing cannot
+ * happen in an interrupt, so the commands are handled on the EventQueue.
+ */
+void consoleInput() {
+  q.call(&readConsole);
+}
 
-  // Return distance.
-  return distance;
+/**
+ * Handles the characters typed on the console: "t" prints the latency trace,
+ * "w" the worst-case execution time of the main loop, "r" has the main loop
+ * clear both, "s" prints the occupancy statistics and "p" the time spent in
+ * each power state.
+ * Anything else is ignored. Any of them keeps the console listening.
+ */
+void readConsole() {
+  FileHandle *console = mbed_file_handle(STDIN_FILENO);
+  char c;
+
+  // Only read what has arrived, so this never waits for more.
+  while (console->readable() && console->read(&c, 1) == 1) {
+    if (c == 't') {
+      Trace::dump();
+    } else if (c == 'w') {
+      wcet.report();
+    } else if (c == 'r') {
+      clearRequested = true;
+    } else if (c == 's') {
+      stats.print();
+    } else if (c == 'p') {
+      power.report();
+    }
+    power.wake();
+  }
 }
 
 /**
- * Library: QEI
- * Author: Chris Powers
- * Link: https://os.mbed.com/users/aberk/code/QEI/docs/tip/classQEI.html
- * Last Updated: 09/02/2010
- *
- * ISR function for the User Push Button.
- * This function changes the variables that determine which menu the user is
- * currently in.
- * The variables isChanging, printed, and pbcounter are also locked at the start
- * and unlocked after to ensure that threads other than the current one are not
- * changing those values.
- * The synchronization is implemented with a Mutex lock.
+ * Reads the newest saved settings back from flash and applies them, or keeps
+ * the defaults if nothing was saved. This only reads a few records, so it
+ * takes microseconds; the time is printed to the console.
  */
-void ChangeDistance(void) {
-  // Lock the Mutex to prevent other threads from changing values.
-  lock.lock();
+void restoreSettings() {
+  // Start from the defaults, in case nothing was saved.
+  saved.minDistance = minDistance;
+  saved.temperature = airTemperature;
+  saved.correction = sound.correction();
+
+  uint32_t begin = Trace::now();
+  bool restored = store.load(saved);
+  uint32_t cycles = Trace::now() - begin;
 
-  // Flip the value of isChanging: True -> False, False -> True.
-  isChanging = !isChanging;
+  /**
+   * Keep minDistance within the range the knob allows, which is shorter with
+   * the VL53L0X than a threshold saved by the Ultrasonic sensor's build.
+   */
+  minDistance = saved.minDistance;
+  if (minDistance < minSetting) {
+    minDistance = minSetting;
+  } else if (minDistance > maxSetting) {
+    minDistance = maxSetting;
+  }
 
-  // Set printed to false, a different menu text needs to display.
-  printed = false;
+  // A threshold that was out of range is saved again, clamped.
+  queued = saved.minDistance;
+  sound.setTemperature(saved.temperature);
+  sound.setCorrection(saved.correction);
+  Trace::boot(TRACE_BOOT_SETTINGS);
 
-  // Print to the console that the menu has changed.
-  printf("switched menu\n");
+  logger.print("settings %s in %u us\n",
+               restored ? "restored" : "defaulted",
+               (unsigned int)(cycles / (SystemCoreClock / 1000000)));
+}
 
-  // If the button hasn't been pressed, then increment pbcounter.
-  if (pbcounter == 0) {
-    // Increase pbcounter
-    pbcounter++;
+/**
+ * Has saveSettings() run on the EventQueue if minDistance changed and the
+ * knob has not moved for saveDelay milliseconds. The main loop only posts the
+ * event, so a flash page erase never holds it up.
+ */
+void queueSave() {
+  if (minDistance == queued || Kernel::get_ms_count() - lastTurn < saveDelay) {
+    return;
   }
-  // If the button has been pressed, then set pbcounter back to 0.
-  else {
-    // Set pbcounter to 0.
-    pbcounter = 0;
+  queued = minDistance;
+  q.call(&saveSettings);
+}
+
+/**
+ * Appends the settings to flash if the published minDistance differs from
+ * the saved one. Writing the first record of a flash page erases it first,
+ * which takes about 20 ms, so this runs on the EventQueue thread.
+ */
+void saveSettings() {
+  // Take the threshold from the published settings, the newest there is.
+  int distance = config.read().minDistance;
+  if (distance == saved.minDistance) {
+    return;
   }
 
-  // Unlock the Mutex, allowing other threads to access the variables again.
-  lock.unlock();
+  Settings next = saved;
+  next.minDistance = distance;
+  next.temperature = sound.temperature();
+  next.correction = sound.correction();
+
+  // On failure, keep running with the new threshold and try again later.
+  if (store.save(next)) {
+    saved = next;
+    logger.print("saved minimum distance %d\n", distance);
+  } else {
+    q.call_in(std::chrono::milliseconds(saveDelay), &saveSettings);
+  }
 }
 
 /**
- * Prints the text that is passed in to the first line of the LCD Display.
- * The values that are passed in only change top row text, so only the first
- * line is affected.
+ * Stamps the first decision on a sample in the boot timeline, and prints how
+ * long after main() started it came. Later calls do nothing.
  */
-void printMenu(char text[]) {
-  // If printed is false, then the menu text needs to change.
-  if (printed == false) {
-    // Clear the LCD Display and set the text to the passed in text.
-    lcd.clear();
-    lcd.print(text);
-
-    // Set printed to true, so the menu text isn't constantly printing.
-    printed = true;
+void bootDone() {
+  // Only the first decision counts.
+  if (booted) {
+    return;
   }
-}
\ No newline at end of file
+  booted = true;
+
+  // Without the trace there is no cycle counter to time it with.
+  Trace::boot(TRACE_BOOT_DECISION);
+#if MBED_CONF_APP_TRACE
+  logger.print("first decision %u us after main\n",
+               (unsigned int)(Trace::booted(TRACE_BOOT_DECISION) /
+                              (SystemCoreClock / 1000000)));
+#endif
+}
+
+/**
+ * Returns how many columns of dots of the proximity bar to light for a
+ * distance. The bar is half full at the threshold, empty from twice the
+ * threshold or when nothing is in range, and full at 0, so a bar past the
+ * middle of the LCD means too close.
+ */
+int proximity(int distance, int threshold) {
+  // Columns of dots in the whole bar.
+  int steps = barCells * LCD_BAR_STEPS;
+
+  // Nothing in range, or too far to show.
+  if (distance < 0 || distance >= 2 * threshold) {
+    return 0;
+  }
+
+  // Half the bar per threshold closer than twice the threshold, rounded.
+  return steps - (distance * steps + threshold) / (2 * threshold);
+}
+
+/**
+ * Returns the alarm level for a target closer than threshold: 1 when it is
+ * less than a quarter of threshold inside, up to the steady tone of the last
+ * level when it is three quarters inside or more.
+ */
+int alarmLevel(int distance, int threshold) {
+  // How far inside the threshold the target is.
+  int depth = threshold - distance;
+
+  // Still alarming on the way out, or no distance to go by.
+  if (distance < 0 || depth <= 0) {
+    return 1;
+  }
+
+  // One more level for every quarter of threshold.
+  int level = 1 + depth * (BUZZER_LEVELS - 1) / threshold;
+  if (level > BUZZER_LEVELS - 1) {
+    level = BUZZER_LEVELS - 1;
+  }
+  return level;
+}
@@ -0,0 +1,42 @@
+/**
+ * Host stand-in for Mbed OS's BlockDevice interface, with only the calls the
+ * project makes.
+ */
+
+#ifndef SIM_BLOCK_DEVICE_H
+#define SIM_BLOCK_DEVICE_H
+
+#include <cstdint>
+
+namespace mbed {
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+enum {
+  BD_ERROR_OK = 0,
+  BD_ERROR_DEVICE_ERROR = -4001,
+};
+
+class BlockDevice {
+public:
+  virtual ~BlockDevice() {}
+
+  virtual int init() = 0;
+  virtual int deinit() = 0;
+  virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int erase(bd_addr_t addr, bd_size_t size) = 0;
+
+  virtual bd_size_t get_read_size() const = 0;
+  virtual bd_size_t get_program_size() const = 0;
+  virtual bd_size_t get_erase_size() const = 0;
+  virtual int get_erase_value() const { return -1; }
+  virtual bd_size_t size() const = 0;
+};
+
+} // namespace mbed
+
+using mbed::BlockDevice;
+
+#endif /* SIM_BLOCK_DEVICE_H */
@@ -0,0 +1,58 @@
+/**
+ * Host stand-in for Mbed OS's FlashIAPBlockDevice on the NUCLEO-L4R5ZI, over
+ * the flash model in sim.cpp: 4 KiB pages (dual bank), 8 byte programs,
+ * erased to 0xFF. The region defaults to the one in mbed_app.json.
+ */
+
+#ifndef SIM_FLASH_IAP_BLOCK_DEVICE_H
+#define SIM_FLASH_IAP_BLOCK_DEVICE_H
+
+#include "BlockDevice.h"
+#include "sim.h"
+
+class FlashIAPBlockDevice : public mbed::BlockDevice {
+public:
+  FlashIAPBlockDevice(uint32_t address = 0x081FC000, uint32_t size = 16384)
+      : address_(address), size_(size) {}
+
+  int init() override {
+    sim::flash_open(address_, size_);
+    return mbed::BD_ERROR_OK;
+  }
+  int deinit() override { return mbed::BD_ERROR_OK; }
+
+  int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) override {
+    return sim::flash_read(address_ + addr, buffer, size)
+               ? mbed::BD_ERROR_OK
+               : mbed::BD_ERROR_DEVICE_ERROR;
+  }
+  int program(const void *buffer, mbed::bd_addr_t addr,
+              mbed::bd_size_t size) override {
+    if (addr % get_program_size() != 0 || size % get_program_size() != 0) {
+      return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    return sim::flash_program(address_ + addr, buffer, size)
+               ? mbed::BD_ERROR_OK
+               : mbed::BD_ERROR_DEVICE_ERROR;
+  }
+  int erase(mbed::bd_addr_t addr, mbed::bd_size_t size) override {
+    if (addr % get_erase_size() != 0 || size % get_erase_size() != 0) {
+      return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    return sim::flash_erase(address_ + addr, size)
+               ? mbed::BD_ERROR_OK
+               : mbed::BD_ERROR_DEVICE_ERROR;
+  }
+
+  mbed::bd_size_t get_read_size() const override { return 1; }
+  mbed::bd_size_t get_program_size() const override { return 8; }
+  mbed::bd_size_t get_erase_size() const override { return 4096; }
+  int get_erase_value() const override { return 0xFF; }
+  mbed::bd_size_t size() const override { return size_; }
+
+private:
+  uint32_t address_;
+  uint32_t size_;
+};
+
+#endif /* SIM_FLASH_IAP_BLOCK_DEVICE_H */
@@ -0,0 +1,90 @@
+/**
+ * Scripted RangeSensor driver for the host simulation.
+ *
+ * Each ping() takes the next distance from a script, in millimeters or
+ * RANGE_NO_TARGET, and completes it MOCK_RANGE_US later from a Timeout, the
+ * way a real sensor's completion comes from an interrupt. The script repeats
+ * once it runs out. The mock touches no pins or buses, so it shows what the
+ * code around a sensor costs on its own.
+ */
+
+#ifndef MOCK_RANGE_H
+#define MOCK_RANGE_H
+
+#include "RangeSensor.h"
+#include "mbed.h"
+
+// Time in microseconds from ping() to the result.
+#define MOCK_RANGE_US 1000
+
+// Shortest time in microseconds between two pings.
+#define MOCK_RANGE_CYCLE_US 2000
+
+// Longest distance in millimeters a script should hold.
+#define MOCK_RANGE_MAX_MM 4000
+
+class MockRange : public RangeSensor<MockRange> {
+public:
+  static const int CYCLE_US = MOCK_RANGE_CYCLE_US;
+  static const int SETTLE_US = 0;
+  static const int MAX_MM = MOCK_RANGE_MAX_MM;
+
+  /**
+   * Constructor
+   *
+   * @param script Distances to report in turn, in millimeters.
+   * @param length Number of distances in the script.
+   */
+  MockRange(const int *script, int length) : script_(script) {
+    length_ = length;
+    position_ = 0;
+    result_ = RANGE_NO_TARGET;
+    busy_ = false;
+  }
+
+  /**
+   * @return Number of measurements completed.
+   */
+  unsigned int completed() { return position_; }
+
+private:
+  friend class RangeSensor<MockRange>;
+
+  bool initRange() { return length_ > 0; }
+
+  bool startRange() {
+    if (busy_ || length_ == 0) {
+      return false;
+    }
+    busy_ = true;
+    done_.attach(callback(this, &MockRange::finish),
+                 std::chrono::microseconds(MOCK_RANGE_US));
+    return true;
+  }
+
+  int readRange() { return result_; }
+
+  // The script is all there is.
+  int rawRange() { return -1; }
+
+  void attachRange(Callback<void()> complete) { complete_ = complete; }
+
+  void finish() {
+    result_ = script_[position_ % length_];
+    position_++;
+    busy_ = false;
+    if (complete_) {
+      complete_();
+    }
+  }
+
+  const int *script_;
+  int length_;
+  unsigned int position_;
+  Timeout done_;
+  Callback<void()> complete_;
+  volatile int result_;
+  volatile bool busy_;
+};
+
+#endif /* MOCK_RANGE_H */
@@ -0,0 +1,201 @@
+/**
+ * Microbenchmark for QEI::encode().
+ *
+ * Walks the simulated encoder pins through quadrature states and calls the
+ * decoder's interrupt handler directly for every edge it listens to. It
+ * reports the host time per interrupt for X2 and X4 encoding, comparing QEI
+ * against LegacyQEI, the decoder QEI started from. The cost of the harness
+ * and of reading both channels is measured with a handler that only does the
+ * reads, and then subtracted. QEI also counts invalid transitions and
+ * timestamps every counted edge for getSnapshot(), which LegacyQEI does not,
+ * so its column shows what those cost. Both must end on the same count.
+ *
+ * The numbers are host nanoseconds and TSC cycles, not Cortex-M4 cycles. They
+ * compare the two decoders, but they are not a target budget.
+ */
+
+#include "QEI.h"
+#include "mbed.h"
+
+#include <chrono>
+#include <cstdlib>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// The decoder QEI started from, for comparison.
+class LegacyQEI {
+public:
+  LegacyQEI(PinName a, PinName b, PinName, int, QEI::Encoding encoding)
+      : encoding_(encoding), channelA_(a), channelB_(b) {
+    pulses_ = 0;
+    currState_ = (channelA_.read() << 1) | channelB_.read();
+    prevState_ = currState_;
+    channelA_.rise(callback(this, &LegacyQEI::encode));
+    channelA_.fall(callback(this, &LegacyQEI::encode));
+    if (encoding == QEI::X4_ENCODING) {
+      channelB_.rise(callback(this, &LegacyQEI::encode));
+      channelB_.fall(callback(this, &LegacyQEI::encode));
+    }
+  }
+  int getPulses() { return pulses_; }
+
+private:
+  void encode() {
+    int change = 0;
+    currState_ = (channelA_.read() << 1) | channelB_.read();
+    if (encoding_ == QEI::X2_ENCODING) {
+      if ((prevState_ == 0x3 && currState_ == 0x0) ||
+          (prevState_ == 0x0 && currState_ == 0x3)) {
+        pulses_++;
+      } else if ((prevState_ == 0x2 && currState_ == 0x1) ||
+                 (prevState_ == 0x1 && currState_ == 0x2)) {
+        pulses_--;
+      }
+    } else if (encoding_ == QEI::X4_ENCODING) {
+      if (((currState_ ^ prevState_) != INVALID) &&
+          (currState_ != prevState_)) {
+        change = (prevState_ & PREV_MASK) ^ ((currState_ & CURR_MASK) >> 1);
+        if (change == 0) {
+          change = -1;
+        }
+        pulses_ -= change;
+      }
+    }
+    prevState_ = currState_;
+  }
+
+  QEI::Encoding encoding_;
+  InterruptIn channelA_;
+  InterruptIn channelB_;
+  int prevState_;
+  int currState_;
+  volatile int pulses_;
+};
+
+// Reads both channels like encode() does, and nothing else.
+class ReadOnly {
+public:
+  ReadOnly(PinName a, PinName b, PinName, int, QEI::Encoding encoding)
+      : channelA_(a), channelB_(b) {
+    channelA_.rise(callback(this, &ReadOnly::encode));
+    channelA_.fall(callback(this, &ReadOnly::encode));
+    if (encoding == QEI::X4_ENCODING) {
+      channelB_.rise(callback(this, &ReadOnly::encode));
+      channelB_.fall(callback(this, &ReadOnly::encode));
+    }
+  }
+  int getPulses() { return state_; }
+
+private:
+  void encode() { state_ = (channelA_.read() << 1) | channelB_.read(); }
+  InterruptIn channelA_;
+  InterruptIn channelB_;
+  volatile int state_ = 0;
+};
+
+struct Result {
+  double ns;
+  double cycles;
+  int pulses;
+};
+
+static const int EDGES = 1000000;
+static const int TRIALS = 9;
+
+// Gray code walk; with `jitter` the direction flips at random, which is what
+// a bouncing contact looks like and what defeats the branch predictor.
+template <typename Decoder>
+static Result measure(PinName a, PinName b, QEI::Encoding encoding,
+                      bool jitter) {
+  static const int gray[4] = {0x0, 0x1, 0x3, 0x2};
+  Decoder decoder(a, b, NC, 1, encoding);
+  bool x4 = encoding == QEI::X4_ENCODING;
+
+  // Precompute the walk so only the decoder runs inside the timed loop.
+  static signed char steps[EDGES];
+  unsigned seed = 12345;
+  int direction = 1;
+  for (int i = 0; i < EDGES; i++) {
+    if (jitter) {
+      seed = seed * 1103515245 + 12345;
+      direction = (seed >> 16) & 1 ? 1 : -1;
+    }
+    steps[i] = direction;
+  }
+
+  // Find the handlers the decoder attached, through the pins' listeners.
+  InterruptIn *inA = sim::pin_listener(a);
+  InterruptIn *inB = sim::pin_listener(b);
+  const Callback<void()> *handlers[2][2] = {
+      {&inB->handler(0), &inB->handler(1)},
+      {&inA->handler(0), &inA->handler(1)}};
+
+  int pos = 0;
+  int interrupts = 0;
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+  unsigned long long tsc = __rdtsc();
+#endif
+  for (int i = 0; i < EDGES; i++) {
+    int prev = gray[pos];
+    pos = (pos + steps[i]) & 3;
+    int curr = gray[pos];
+    sim::pin_set(b, curr & 1);
+    sim::pin_set(a, curr >> 1);
+
+    // Exactly one channel changes per step, bit 1 is channel A.
+    int channel = ((prev ^ curr) >> 1) & 1;
+    if (channel == 1 || x4) {
+      (*handlers[channel][channel ? curr >> 1 : curr & 1])();
+      interrupts++;
+    }
+  }
+#ifdef HAVE_TSC
+  double cycles = (double)(__rdtsc() - tsc);
+#else
+  double cycles = 0;
+#endif
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+
+  return {ns / interrupts, cycles / interrupts, decoder.getPulses()};
+}
+
+static void keep_min(Result &best, Result r) {
+  if (r.ns < best.ns) {
+    best = r;
+  }
+}
+
+// Interleave several trials of each decoder and keep the fastest of each,
+// which filters out most of the noise from the rest of the host.
+static bool report(const char *name, QEI::Encoding encoding, bool jitter) {
+  Result base = {1e9, 0, 0}, qei = {1e9, 0, 0}, legacy = {1e9, 0, 0};
+  for (int trial = 0; trial < TRIALS; trial++) {
+    keep_min(base, measure<ReadOnly>(PA_0, PA_1, encoding, jitter));
+    keep_min(qei, measure<QEI>(PA_2, PA_3, encoding, jitter));
+    keep_min(legacy, measure<LegacyQEI>(PA_4, PA_5, encoding, jitter));
+  }
+  printf("%-10s  %6.2f ns %5.1f cyc  %6.2f ns %5.1f cyc  %6.2f ns\n", name,
+         qei.ns - base.ns, qei.cycles - base.cycles, legacy.ns - base.ns,
+         legacy.cycles - base.cycles, base.ns);
+  if (qei.pulses != legacy.pulses) {
+    printf("%-10s  FAIL: QEI counted %d, LegacyQEI %d\n", name, qei.pulses,
+           legacy.pulses);
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  printf("QEI::encode cost per interrupt, beyond reading the two channels\n");
+  printf("            QEI                legacy             harness\n");
+  bool ok = report("X2 steady", QEI::X2_ENCODING, false);
+  ok &= report("X2 jitter", QEI::X2_ENCODING, true);
+  ok &= report("X4 steady", QEI::X4_ENCODING, false);
+  ok &= report("X4 jitter", QEI::X4_ENCODING, true);
+  return ok ? 0 : 1;
+}
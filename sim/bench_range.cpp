@@ -0,0 +1,121 @@
+/**
+ * Sample rate benchmark for the RangeSensor drivers.
+ *
+ * Runs a one sensor SonarArray of each driver type against the simulator's
+ * device models for SECONDS of virtual time, with a target held close to the
+ * threshold so the array stays at its fast rate. Each driver reports the
+ * samples per second it delivers, the time the simulated core was busy per
+ * sample and the host time per sample. The simulator runs once per process,
+ * so every driver gets a child process of its own.
+ *
+ * The sample rates come from the device models and each driver's cycle, so
+ * they hold for the board as long as the models do. The busy time counts the
+ * waits modelled on the devices, such as the HC-SR04 trigger pulse, not the
+ * code around them, and the host time is host nanoseconds, not Cortex-M4
+ * cycles.
+ */
+
+#include "HCSR04.h"
+#include "MockRange.h"
+#include "SonarArray.h"
+#include "VL53L0X.h"
+#include "mbed.h"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const int SECONDS = 10;
+static const int TARGET_CM = 150;
+static const int THRESHOLD_CM = 180;
+
+// The mock's target sways a little around the same distance.
+static const int SCRIPT[] = {1500, 1480, 1460, 1480};
+
+template <typename Sensor>
+[[noreturn]] static void bench(const char *name, Sensor &sensor) {
+  std::ostringstream text;
+  text << "0 dist " << TARGET_CM << "\n" << SECONDS * 1000 << " end\n";
+  std::istringstream scene(text.str());
+  if (!sim::load_scene(scene, name)) {
+    std::_Exit(2);
+  }
+  // The simulator's own report would bury the table.
+  if (!freopen("/dev/null", "w", stderr)) {
+    std::_Exit(2);
+  }
+
+  static Sensor *sensors[1] = {&sensor};
+  static SonarArray<Sensor> array(sensors, 1);
+  static auto hostStart = std::chrono::steady_clock::now();
+  array.setThresholds(THRESHOLD_CM);
+
+  sim::at_end([name] {
+    unsigned int samples = array.samples(0);
+    uint64_t busy, sleep, deepSleep;
+    sim::cpu_time(&busy, &sleep, &deepSleep);
+    double hostNs = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - hostStart)
+                        .count();
+    double n = samples > 0 ? samples : 1;
+    printf("  %-10s %9.1f %15.1f %15.1f %8d\n", name,
+           samples / (sim::now_ns() / 1e9), busy / 1e3 / n, hostNs / 1e3 / n,
+           array.distance(0));
+    return samples > 0;
+  });
+  sim::run([name, &sensor] {
+    if (!sensor.init()) {
+      printf("  %-10s did not answer\n", name);
+    }
+    array.start();
+    while (true) {
+      ThisThread::sleep_for(1000);
+    }
+  });
+}
+
+static void hcsr04() {
+  static TimeOfFlight sound;
+  static HCSR04 sensor(D9, MBED_CONF_APP_ECHO_INPUT_CAPTURE ? D13 : D8, sound);
+  bench("HC-SR04", sensor);
+}
+
+static void vl53l0x() {
+  static I2C bus(PC_1, PC_0);
+  static VL53L0X sensor(bus, D7);
+  bench("VL53L0X", sensor);
+}
+
+static void mock() {
+  static MockRange sensor(SCRIPT, sizeof(SCRIPT) / sizeof(SCRIPT[0]));
+  bench("MockRange", sensor);
+}
+
+int main() {
+  static void (*const drivers[])() = {hcsr04, vl53l0x, mock};
+
+  printf("One sensor at the fast rate for %d s, target at %d cm\n", SECONDS,
+         TARGET_CM);
+  printf("  %-10s %9s %15s %15s %8s\n", "driver", "samples/s",
+         "busy us/sample", "host us/sample", "last cm");
+  fflush(stdout);
+  int status = 0;
+  for (void (*driver)() : drivers) {
+    pid_t child = fork();
+    if (child < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (child == 0) {
+      driver();
+    }
+    int result = 0;
+    if (waitpid(child, &result, 0) != child || !WIFEXITED(result) ||
+        WEXITSTATUS(result) != 0) {
+      status = 1;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,113 @@
+/**
+ * Microbenchmark and accuracy report for TimeOfFlight.
+ *
+ * The first table compares the host time of the fixed-point conversion
+ * against the float expression Ultrasonic() used before, over a spread of
+ * echo times. The numbers are host nanoseconds, not Cortex-M4 cycles.
+ *
+ * The second table shows the error in millimeters at targets 0.5 m, 1.5 m and
+ * 3 m, across the temperature range. The echo times come from the exact speed
+ * of sound at each temperature. "fixed 20C" is the old conversion, which
+ * assumes 343.2 m/s; "compensated" is TimeOfFlight set to the temperature.
+ *
+ * The last table gives a sensor whose clock runs 1.5% fast, calibrated once
+ * against a target at 1 m, then used at other distances and temperatures.
+ */
+
+#include "TimeOfFlight.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+static const int SAMPLES = 4096;
+static const int ROUNDS = 2000;
+static const int TRIALS = 9;
+
+static double speedOfSound(double celsius) {
+  return 331.3 * std::sqrt(1.0 + celsius / 273.15);
+}
+
+// Round trip echo time in microseconds for a target at mm.
+static int echoUs(double mm, double celsius, double clock = 1.0) {
+  return (int)(mm * 2000.0 / speedOfSound(celsius) * clock + 0.5);
+}
+
+// The conversion Ultrasonic() used before, in millimeters.
+static int floatMm(int us) { return us * 0.03432f / 2.0f * 10.0f; }
+
+template <typename Convert> static double measure(const int *us, Convert c) {
+  double best = 1e9;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    unsigned sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+      // One conversion at a time, as in the completion interrupt: the
+      // barrier keeps the compiler from vectorizing or folding the loop.
+      for (int i = 0; i < SAMPLES; i++) {
+        sum += c(us[i]);
+        asm volatile("" : "+r"(sum));
+      }
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    volatile unsigned sink = sum;
+    (void)sink;
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best / ((double)SAMPLES * ROUNDS);
+}
+
+int main() {
+  static int us[SAMPLES];
+  unsigned seed = 12345;
+  for (int i = 0; i < SAMPLES; i++) {
+    seed = seed * 1103515245 + 12345;
+    us[i] = 120 + (seed >> 8) % 25000;
+  }
+
+  TimeOfFlight tof;
+  printf("Echo time conversion cost per sample\n");
+  printf("  fixed point  %5.2f ns\n",
+         measure(us, [&tof](int t) { return tof.toMm(t); }));
+  printf("  float        %5.2f ns\n", measure(us, floatMm));
+
+  static const double targets[3] = {500, 1500, 3000};
+
+  printf("\nError in mm against the true distance\n");
+  printf("          fixed 20C              compensated\n");
+  printf("  temp   0.5m   1.5m   3.0m    0.5m   1.5m   3.0m\n");
+  for (int c = TOF_MIN_C; c <= TOF_MAX_C; c += 10) {
+    tof.setTemperature(c * 10);
+    printf("  %3d C", c);
+    for (double mm : targets) {
+      printf(" %6d", floatMm(echoUs(mm, c)) - (int)mm);
+    }
+    printf(" ");
+    for (double mm : targets) {
+      printf(" %6d", tof.toMm(echoUs(mm, c)) - (int)mm);
+    }
+    printf("\n");
+  }
+
+  printf("\nSensor clock 1.5%% fast, calibrated at 1 m and 20 C\n");
+  printf("  temp   0.5m   1.5m   3.0m\n");
+  const double clock = 1.015;
+  tof.setTemperature(200);
+  if (!tof.calibrate(echoUs(1000, 20, clock), 1000)) {
+    printf("  calibration rejected\n");
+    return 1;
+  }
+  for (int c = TOF_MIN_C; c <= TOF_MAX_C; c += 10) {
+    tof.setTemperature(c * 10);
+    printf("  %3d C", c);
+    for (double mm : targets) {
+      printf(" %6d", tof.toMm(echoUs(mm, c, clock)) - (int)mm);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,849 @@
+/**
+ * Host stand-in for the subset of the Mbed OS 6 API used by this project.
+ *
+ * Every class here is driven by the deterministic virtual clock in sim.cpp:
+ * nothing reads the host's wall clock, so a run is repeatable and takes as
+ * long as the host needs to execute the code, not as long as the scene lasts.
+ *
+ * Threads are real host threads, but only one of them runs at a time. A
+ * thread gives the CPU away only when it blocks (sleep, mutex, semaphore,
+ * event flags, event queue), which is where the virtual clock advances to the
+ * next timer or interrupt. Busy waits such as wait_us() and blocking I2C
+ * transfers advance the clock in place and run any interrupt that falls due.
+ */
+
+#ifndef SIM_MBED_H
+#define SIM_MBED_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include <unistd.h>
+
+#include "sim.h"
+
+//------------------Pins-------------------------------------------------------
+
+typedef enum {
+  PA_0 = 0x00, PA_1, PA_2, PA_3, PA_4, PA_5, PA_6, PA_7,
+  PA_8, PA_9, PA_10, PA_11, PA_12, PA_13, PA_14, PA_15,
+  PB_0 = 0x10, PB_1, PB_2, PB_3, PB_4, PB_5, PB_6, PB_7,
+  PB_8, PB_9, PB_10, PB_11, PB_12, PB_13, PB_14, PB_15,
+  PC_0 = 0x20, PC_1, PC_2, PC_3, PC_4, PC_5, PC_6, PC_7,
+  PC_8, PC_9, PC_10, PC_11, PC_12, PC_13, PC_14, PC_15,
+  PD_0 = 0x30, PD_1, PD_2, PD_3, PD_4, PD_5, PD_6, PD_7,
+  PD_8, PD_9, PD_10, PD_11, PD_12, PD_13, PD_14, PD_15,
+  PE_0 = 0x40, PE_1, PE_2, PE_3, PE_4, PE_5, PE_6, PE_7,
+  PE_8, PE_9, PE_10, PE_11, PE_12, PE_13, PE_14, PE_15,
+  PF_0 = 0x50, PF_1, PF_2, PF_3, PF_4, PF_5, PF_6, PF_7,
+  PF_8, PF_9, PF_10, PF_11, PF_12, PF_13, PF_14, PF_15,
+  PG_0 = 0x60, PG_1, PG_2, PG_3, PG_4, PG_5, PG_6, PG_7,
+  PG_8, PG_9, PG_10, PG_11, PG_12, PG_13, PG_14, PG_15,
+
+  // Arduino header names as routed on the NUCLEO-L4R5ZI.
+  D0 = PD_9, D1 = PD_8, D2 = PF_15, D3 = PE_13, D4 = PF_14, D5 = PE_11,
+  D6 = PE_9, D7 = PF_13, D8 = PF_12, D9 = PD_15, D10 = PD_14, D11 = PA_7,
+  D12 = PA_6, D13 = PA_5, D14 = PB_9, D15 = PB_8,
+
+  NC = -1
+} PinName;
+
+typedef enum { PullNone, PullUp, PullDown, OpenDrain, PullDefault = PullNone } PinMode;
+
+//------------------Callbacks--------------------------------------------------
+
+namespace mbed {
+
+template <typename F> class Callback;
+
+template <typename R, typename... Args>
+class Callback<R(Args...)> : public std::function<R(Args...)> {
+public:
+  using std::function<R(Args...)>::function;
+  Callback() = default;
+  Callback(std::nullptr_t) {}
+};
+
+template <typename R, typename... Args>
+Callback<R(Args...)> callback(R (*func)(Args...)) {
+  return Callback<R(Args...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... Args>
+Callback<R(Args...)> callback(U *obj, R (T::*method)(Args...)) {
+  return Callback<R(Args...)>(
+      [obj, method](Args... args) { return (obj->*method)(args...); });
+}
+
+template <typename T, typename U, typename R, typename... Args>
+Callback<R(Args...)> callback(const U *obj, R (T::*method)(Args...) const) {
+  return Callback<R(Args...)>(
+      [obj, method](Args... args) { return (obj->*method)(args...); });
+}
+
+template <typename R, typename... Args>
+Callback<R(Args...)> callback(const Callback<R(Args...)> &func) {
+  return func;
+}
+
+typedef Callback<void(int)> event_callback_t;
+
+} // namespace mbed
+
+//------------------Digital and PWM IO-----------------------------------------
+
+namespace mbed {
+
+class DigitalOut {
+public:
+  DigitalOut(PinName pin, int value = 0) : pin_(pin) { write(value); }
+  void write(int value) { sim::pin_write(pin_, value); }
+  int read() { return sim::pin_read(pin_); }
+  DigitalOut &operator=(int value) {
+    write(value);
+    return *this;
+  }
+  operator int() { return read(); }
+
+private:
+  PinName pin_;
+};
+
+class DigitalIn {
+public:
+  DigitalIn(PinName pin, PinMode mode = PullDefault) : pin_(pin) {
+    (void)mode;
+  }
+  int read() { return sim::pin_read(pin_); }
+  void mode(PinMode) {}
+  operator int() { return read(); }
+
+private:
+  PinName pin_;
+};
+
+class InterruptIn {
+public:
+  InterruptIn(PinName pin, PinMode mode = PullDefault) : pin_(pin) {
+    (void)mode;
+    sim::pin_listen(pin_, this);
+  }
+  ~InterruptIn() { sim::pin_unlisten(pin_, this); }
+  int read() { return sim::pin_read(pin_); }
+  void mode(PinMode) {}
+  void rise(Callback<void()> func) { rise_ = func; }
+  void fall(Callback<void()> func) { fall_ = func; }
+  void enable_irq() { enabled_ = true; }
+  void disable_irq() { enabled_ = false; }
+  operator int() { return read(); }
+
+  // The handler for an edge to `level`, for benchmarks that call it directly.
+  const Callback<void()> &handler(int level) const {
+    return level ? rise_ : fall_;
+  }
+
+  // Called by the simulator when the pin changes level.
+  void edge(int level) {
+    if (!enabled_) {
+      return;
+    }
+    Callback<void()> &handler = level ? rise_ : fall_;
+    if (handler) {
+      sim::IsrScope isr;
+      handler();
+    }
+  }
+
+private:
+  PinName pin_;
+  Callback<void()> rise_;
+  Callback<void()> fall_;
+  bool enabled_ = true;
+};
+
+class SerialBase {
+public:
+  enum IrqType { RxIrq = 0, TxIrq };
+};
+
+// Transmit only: bytes go to the UART model in sim.cpp.
+class UnbufferedSerial : public SerialBase {
+public:
+  UnbufferedSerial(PinName tx, PinName rx, int baud = 9600)
+      : tx_(tx), baud_(baud) {}
+  ~UnbufferedSerial() { sim::uart_tx_irq(tx_, baud_, nullptr); }
+  ssize_t write(const void *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      sim::uart_put(tx_, baud_, ((const uint8_t *)buffer)[i]);
+    }
+    return size;
+  }
+  void baud(int baudrate) { baud_ = baudrate; }
+  // Like SerialBase, an attached interrupt holds a deep sleep lock.
+  void attach(Callback<void()> func, IrqType type = RxIrq) {
+    if (type == TxIrq) {
+      if (func && !txAttached_) {
+        sim::deep_sleep_lock();
+      } else if (!func && txAttached_) {
+        sim::deep_sleep_unlock();
+      }
+      txAttached_ = (bool)func;
+      sim::uart_tx_irq(tx_, baud_,
+                       static_cast<const std::function<void()> &>(func));
+    }
+  }
+
+private:
+  int tx_;
+  int baud_;
+  bool txAttached_ = false;
+};
+
+// Runs from construction. Like the STM32 driver, it holds a deep sleep lock
+// while running, as the timer clock stops in deep sleep.
+class PwmOut {
+public:
+  PwmOut(PinName pin) : pin_(pin) {
+    sim::deep_sleep_lock();
+    sim::pwm_update(pin_, true, period_, duty_);
+  }
+  ~PwmOut() {
+    if (running_) {
+      sim::deep_sleep_unlock();
+    }
+  }
+  void write(float value) {
+    duty_ = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    sim::pwm_update(pin_, running_, period_, duty_);
+  }
+  float read() { return duty_; }
+  void period(float seconds) {
+    period_ = seconds;
+    sim::pwm_update(pin_, running_, period_, duty_);
+  }
+  void period_ms(int ms) { period(ms / 1000.0f); }
+  void period_us(int us) { period(us / 1000000.0f); }
+  void pulsewidth_us(int us) { write(us / (period_ * 1000000.0f)); }
+  void suspend() {
+    if (running_) {
+      sim::deep_sleep_unlock();
+    }
+    running_ = false;
+    sim::pwm_update(pin_, running_, period_, duty_);
+  }
+  void resume() {
+    if (!running_) {
+      sim::deep_sleep_lock();
+    }
+    running_ = true;
+    sim::pwm_update(pin_, running_, period_, duty_);
+  }
+  PwmOut &operator=(float value) {
+    write(value);
+    return *this;
+  }
+
+private:
+  PinName pin_;
+  float period_ = 0.02f;
+  float duty_ = 0.0f;
+  bool running_ = true;
+};
+
+//------------------I2C--------------------------------------------------------
+
+#define I2C_EVENT_ERROR (1 << 1)
+#define I2C_EVENT_ERROR_NO_SLAVE (1 << 2)
+#define I2C_EVENT_TRANSFER_COMPLETE (1 << 3)
+#define I2C_EVENT_TRANSFER_EARLY_NACK (1 << 4)
+#define I2C_EVENT_ALL                                                          \
+  (I2C_EVENT_ERROR | I2C_EVENT_TRANSFER_COMPLETE | I2C_EVENT_ERROR_NO_SLAVE |  \
+   I2C_EVENT_TRANSFER_EARLY_NACK)
+
+#define DEVICE_I2C_ASYNCH 1
+
+class I2C {
+public:
+  I2C(PinName sda, PinName scl) : sda_(sda), scl_(scl) {}
+  void frequency(int hz) { hz_ = hz; }
+  int write(int address, const char *data, int length, bool repeated = false) {
+    return sim::i2c_write(sda_, hz_, address, data, length, repeated);
+  }
+  int read(int address, char *data, int length, bool repeated = false) {
+    return sim::i2c_read(sda_, hz_, address, data, length, repeated);
+  }
+  void start() {}
+  void stop() { sim::i2c_stop(hz_); }
+  int transfer(int address, const char *tx_buffer, int tx_length,
+               char *rx_buffer, int rx_length,
+               const event_callback_t &callback,
+               int event = I2C_EVENT_TRANSFER_COMPLETE,
+               bool repeated = false) {
+    return sim::i2c_transfer(sda_, hz_, address, tx_buffer, tx_length,
+                             rx_buffer, rx_length, callback, event, repeated);
+  }
+  void abort_transfer() {}
+
+private:
+  PinName sda_;
+  PinName scl_;
+  int hz_ = 100000;
+};
+
+//------------------Time-------------------------------------------------------
+
+class Timer {
+public:
+  void start() {
+    if (!running_) {
+      startNs_ = sim::now_ns();
+      running_ = true;
+      lock();
+    }
+  }
+  void stop() {
+    if (running_) {
+      accumNs_ += sim::now_ns() - startNs_;
+      running_ = false;
+      unlock();
+    }
+  }
+  void reset() {
+    accumNs_ = 0;
+    startNs_ = sim::now_ns();
+  }
+  std::chrono::microseconds elapsed_time() {
+    return std::chrono::microseconds(elapsedNs() / 1000);
+  }
+  int read_us() { return (int)(elapsedNs() / 1000); }
+  int read_ms() { return (int)(elapsedNs() / 1000000); }
+  float read() { return elapsedNs() / 1e9f; }
+  ~Timer() { stop(); }
+
+protected:
+  virtual void lock() { sim::deep_sleep_lock(); }
+  virtual void unlock() { sim::deep_sleep_unlock(); }
+
+private:
+  uint64_t elapsedNs() {
+    return accumNs_ + (running_ ? sim::now_ns() - startNs_ : 0);
+  }
+  uint64_t startNs_ = 0;
+  uint64_t accumNs_ = 0;
+  bool running_ = false;
+};
+
+class LowPowerTimer : public Timer {
+protected:
+  void lock() override {}
+  void unlock() override {}
+};
+
+class Timeout {
+public:
+  template <typename Rep, typename Period>
+  void attach(Callback<void()> func, std::chrono::duration<Rep, Period> t) {
+    detach();
+    func_ = func;
+    uint64_t ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+    lock();
+    id_ = sim::schedule(sim::now_ns() + ns, [this] {
+      id_ = 0;
+      unlock();
+      sim::IsrScope isr;
+      func_();
+    });
+  }
+  void detach() {
+    if (id_ != 0) {
+      sim::cancel(id_);
+      id_ = 0;
+      unlock();
+    }
+  }
+  virtual ~Timeout() { detach(); }
+
+protected:
+  virtual void lock() { sim::deep_sleep_lock(); }
+  virtual void unlock() { sim::deep_sleep_unlock(); }
+
+private:
+  Callback<void()> func_;
+  uint64_t id_ = 0;
+};
+
+class LowPowerTimeout : public Timeout {
+public:
+  ~LowPowerTimeout() { detach(); }
+
+protected:
+  void lock() override {}
+  void unlock() override {}
+};
+
+class Ticker {
+public:
+  template <typename Rep, typename Period>
+  void attach(Callback<void()> func, std::chrono::duration<Rep, Period> t) {
+    detach();
+    func_ = func;
+    periodNs_ =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+    lock();
+    arm(sim::now_ns() + periodNs_);
+  }
+  void detach() {
+    if (id_ != 0) {
+      sim::cancel(id_);
+      id_ = 0;
+      unlock();
+    }
+  }
+  virtual ~Ticker() { detach(); }
+
+protected:
+  virtual void lock() { sim::deep_sleep_lock(); }
+  virtual void unlock() { sim::deep_sleep_unlock(); }
+
+private:
+  void arm(uint64_t at) {
+    id_ = sim::schedule(at, [this, at] {
+      arm(at + periodNs_);
+      sim::IsrScope isr;
+      func_();
+    });
+  }
+  Callback<void()> func_;
+  uint64_t periodNs_ = 0;
+  uint64_t id_ = 0;
+};
+
+class LowPowerTicker : public Ticker {
+public:
+  ~LowPowerTicker() { detach(); }
+
+protected:
+  void lock() override {}
+  void unlock() override {}
+};
+
+class Watchdog {
+public:
+  static Watchdog &get_instance() {
+    static Watchdog instance;
+    return instance;
+  }
+  bool start(uint32_t timeout) {
+    timeout_ = timeout;
+    running_ = true;
+    sim::watchdog_kick(timeout_);
+    return true;
+  }
+  bool start() { return start(timeout_); }
+  bool stop() {
+    running_ = false;
+    sim::watchdog_kick(0);
+    return true;
+  }
+  void kick() {
+    if (running_) {
+      sim::watchdog_kick(timeout_);
+    }
+  }
+  bool is_running() const { return running_; }
+  uint32_t get_timeout() const { return timeout_; }
+  uint32_t get_max_timeout() const { return 32768; }
+
+private:
+  Watchdog() = default;
+  uint32_t timeout_ = 0;
+  bool running_ = false;
+};
+
+typedef enum {
+  RESET_REASON_POWER_ON,
+  RESET_REASON_PIN_RESET,
+  RESET_REASON_BROWN_OUT,
+  RESET_REASON_SOFTWARE,
+  RESET_REASON_WATCHDOG,
+  RESET_REASON_LOCKUP,
+  RESET_REASON_WAKE_LOW_POWER,
+  RESET_REASON_ACCESS_ERROR,
+  RESET_REASON_BOOT_ERROR,
+  RESET_REASON_MULTIPLE,
+  RESET_REASON_PLATFORM,
+  RESET_REASON_UNKNOWN
+} reset_reason_t;
+
+// The reason set by the scene's reset command, power on by default.
+class ResetReason {
+public:
+  static reset_reason_t get() { return (reset_reason_t)sim::reset_reason(); }
+};
+
+// The console. Input comes from the scene's key commands; output is stdout.
+class FileHandle {
+public:
+  ssize_t read(void *buffer, size_t size) {
+    return sim::console_read((char *)buffer, size);
+  }
+  ssize_t write(const void *buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+  }
+  bool readable() const { return sim::console_readable(); }
+  int set_blocking(bool blocking) { return blocking ? -1 : 0; }
+  bool is_blocking() const { return false; }
+  void sigio(Callback<void()> func) { sim::console_sigio(func); }
+  int enable_input(bool enabled) {
+    sim::console_enable(enabled);
+    return 0;
+  }
+};
+
+inline FileHandle *mbed_file_handle(int fd) {
+  static FileHandle console;
+  return &console;
+}
+
+} // namespace mbed
+
+inline void wait_us(int us) { sim::busy_wait_ns((uint64_t)us * 1000); }
+inline void wait_ns(unsigned int ns) { sim::busy_wait_ns(ns); }
+inline void thread_sleep_for(uint32_t ms) {
+  sim::sleep_ns((uint64_t)ms * 1000000);
+}
+
+//------------------Power------------------------------------------------------
+
+inline void sleep_manager_lock_deep_sleep() { sim::deep_sleep_lock(); }
+inline void sleep_manager_unlock_deep_sleep() { sim::deep_sleep_unlock(); }
+inline bool sleep_manager_can_deep_sleep() { return sim::deep_sleep_allowed(); }
+
+// The CPU statistics of platform.cpu-stats-enabled, in microseconds.
+typedef struct {
+  uint64_t uptime;
+  uint64_t idle_time;
+  uint64_t sleep_time;
+  uint64_t deep_sleep_time;
+} mbed_stats_cpu_t;
+
+inline void mbed_stats_cpu_get(mbed_stats_cpu_t *stats) {
+  uint64_t busy, sleep, deep;
+  sim::cpu_time(&busy, &sleep, &deep);
+  stats->uptime = sim::now_ns() / 1000;
+  stats->sleep_time = sleep / 1000;
+  stats->deep_sleep_time = deep / 1000;
+  stats->idle_time = stats->sleep_time + stats->deep_sleep_time;
+}
+
+//------------------RTOS-------------------------------------------------------
+
+typedef enum {
+  osPriorityIdle = 1,
+  osPriorityLow = 8,
+  osPriorityBelowNormal = 16,
+  osPriorityNormal = 24,
+  osPriorityAboveNormal = 32,
+  osPriorityHigh = 40,
+  osPriorityRealtime = 48,
+} osPriority;
+
+typedef int32_t osStatus;
+#define osOK 0
+#define osErrorResource -3
+#define osWaitForever 0xFFFFFFFFU
+#define osFlagsError 0x80000000U
+#define osFlagsErrorTimeout 0xFFFFFFFEU
+#define OS_STACK_SIZE 4096
+
+namespace rtos {
+
+namespace Kernel {
+inline uint64_t get_ms_count() { return sim::now_ns() / 1000000; }
+} // namespace Kernel
+
+namespace ThisThread {
+inline void sleep_for(uint32_t ms) { thread_sleep_for(ms); }
+inline void yield() { sim::yield(); }
+} // namespace ThisThread
+
+class Thread {
+public:
+  Thread(osPriority priority = osPriorityNormal,
+         uint32_t stack_size = OS_STACK_SIZE, unsigned char *stack_mem = nullptr,
+         const char *name = nullptr)
+      : priority_(priority), name_(name) {
+    (void)stack_size;
+    (void)stack_mem;
+  }
+  osStatus start(mbed::Callback<void()> task) {
+    task_ = sim::thread_start(task, priority_, name_);
+    return osOK;
+  }
+  osStatus set_priority(osPriority priority) {
+    priority_ = priority;
+    if (task_) {
+      sim::thread_set_priority(task_, priority);
+    }
+    return osOK;
+  }
+  osPriority get_priority() const { return priority_; }
+  const char *get_name() const { return name_; }
+
+private:
+  osPriority priority_;
+  const char *name_;
+  sim::Task *task_ = nullptr;
+};
+
+class Mutex {
+public:
+  void lock() { sim::mutex_lock(&state_); }
+  bool trylock() { return sim::mutex_trylock(&state_); }
+  void unlock() { sim::mutex_unlock(&state_); }
+
+private:
+  sim::WaitState state_;
+};
+
+class Semaphore {
+public:
+  Semaphore(int32_t count = 0, uint16_t max_count = 0xFFFF)
+      : max_(max_count) {
+    state_.count = count;
+  }
+  void acquire() { sim::sem_acquire(&state_, UINT64_MAX); }
+  bool try_acquire() { return sim::sem_acquire(&state_, 0); }
+  bool try_acquire_for(uint32_t ms) {
+    return sim::sem_acquire(&state_, (uint64_t)ms * 1000000);
+  }
+  osStatus release() {
+    if (state_.count >= max_) {
+      return osErrorResource;
+    }
+    sim::sem_release(&state_);
+    return osOK;
+  }
+
+private:
+  sim::WaitState state_;
+  int32_t max_;
+};
+
+class EventFlags {
+public:
+  uint32_t set(uint32_t flags) { return sim::flags_set(&state_, flags); }
+  uint32_t clear(uint32_t flags = 0x7fffffff) {
+    uint32_t old = state_.flags;
+    state_.flags &= ~flags;
+    return old;
+  }
+  uint32_t get() const { return state_.flags; }
+  uint32_t wait_any(uint32_t flags, uint32_t ms = osWaitForever,
+                    bool clear = true) {
+    return sim::flags_wait(&state_, flags, false, ms, clear);
+  }
+  uint32_t wait_all(uint32_t flags, uint32_t ms = osWaitForever,
+                    bool clear = true) {
+    return sim::flags_wait(&state_, flags, true, ms, clear);
+  }
+
+private:
+  sim::WaitState state_;
+};
+
+} // namespace rtos
+
+//------------------Events-----------------------------------------------------
+
+#define EVENTS_EVENT_SIZE 64
+
+namespace events {
+
+class EventQueue {
+public:
+  EventQueue(unsigned size = 32 * EVENTS_EVENT_SIZE) { (void)size; }
+
+  template <typename F> int call(F f) {
+    sim::queue_post(&state_, mbed::Callback<void()>(f));
+    return 1;
+  }
+
+  template <typename F> int call_in(std::chrono::milliseconds ms, F f) {
+    mbed::Callback<void()> func(f);
+    sim::schedule(sim::now_ns() + (uint64_t)ms.count() * 1000000,
+                  [this, func] { sim::queue_post(&state_, func); });
+    return 1;
+  }
+
+  template <typename F> int call_every(std::chrono::milliseconds ms, F f) {
+    every(std::chrono::duration_cast<std::chrono::nanoseconds>(ms).count(),
+          mbed::Callback<void()>(f));
+    return 1;
+  }
+
+  // A deferred call, returned by event(), that posts onto the queue when run.
+  template <typename F> struct Event {
+    EventQueue *queue;
+    F func;
+    void operator()() const { queue->call(func); }
+  };
+
+  template <typename F> Event<F> event(F f) { return Event<F>{this, f}; }
+
+  template <typename T, typename R> auto event(T *obj, R (T::*method)()) {
+    return event(mbed::callback(obj, method));
+  }
+
+  void dispatch_forever() { sim::queue_dispatch(&state_); }
+
+private:
+  void every(uint64_t periodNs, mbed::Callback<void()> func) {
+    sim::schedule(sim::now_ns() + periodNs, [this, periodNs, func] {
+      sim::queue_post(&state_, func);
+      every(periodNs, func);
+    });
+  }
+
+  sim::QueueState state_;
+};
+
+} // namespace events
+
+//------------------Critical sections----------------------------------------
+
+namespace mbed {
+
+// Interrupts only run when the running thread blocks or busy waits, so
+// holding off interrupts needs nothing.
+class CriticalSectionLock {
+public:
+  CriticalSectionLock() {}
+  ~CriticalSectionLock() {}
+};
+
+} // namespace mbed
+
+//------------------Registers--------------------------------------------------
+
+// Register blocks the application touches directly. Writes are simply kept,
+// except that TIM2 captures echo edges; see sim.cpp.
+typedef struct {
+  volatile uint32_t CFGR, AHB1ENR, AHB2ENR, AHB3ENR, APB1ENR1, APB1ENR2,
+      APB2ENR;
+} RCC_TypeDef;
+
+typedef struct {
+  volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR,
+      AFR[2];
+} GPIO_TypeDef;
+
+// A status register whose bits are cleared by writing 0 and unaffected by
+// writing 1 (rc_w0), as in the timers.
+struct RcW0Register {
+  volatile uint32_t value;
+  RcW0Register &operator=(uint32_t bits) {
+    value &= bits;
+    return *this;
+  }
+  operator uint32_t() const { return value; }
+};
+
+typedef struct {
+  volatile uint32_t CR1, CR2, SMCR, DIER;
+  RcW0Register SR;
+  volatile uint32_t EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2,
+      CCR3, CCR4;
+} TIM_TypeDef;
+
+// The cycle counter runs with the virtual clock at the core clock, so cycle
+// stamps measure simulated time. Writing it sets the count from now on.
+struct SimCycleCounter {
+  uint32_t offset;
+  static uint32_t cycles() { return (uint32_t)(sim::cycle_ns() * 3 / 25); }
+  SimCycleCounter &operator=(uint32_t count) {
+    offset = cycles() - count;
+    return *this;
+  }
+  operator uint32_t() const { return cycles() - offset; }
+};
+
+typedef struct {
+  volatile uint32_t CTRL;
+  SimCycleCounter CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  volatile uint32_t DHCSR, DCRSR, DCRDR, DEMCR;
+} CoreDebug_Type;
+
+extern RCC_TypeDef sim_rcc;
+extern GPIO_TypeDef sim_gpio[8];
+extern TIM_TypeDef sim_tim2;
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_coredebug;
+
+#define RCC (&sim_rcc)
+#define GPIOA (&sim_gpio[0])
+#define GPIOB (&sim_gpio[1])
+#define GPIOC (&sim_gpio[2])
+#define GPIOD (&sim_gpio[3])
+#define GPIOE (&sim_gpio[4])
+#define GPIOF (&sim_gpio[5])
+#define GPIOG (&sim_gpio[6])
+#define TIM2 (&sim_tim2)
+#define DWT (&sim_dwt)
+#define CoreDebug (&sim_coredebug)
+
+#define DWT_CTRL_CYCCNTENA_Msk 0x1U
+#define CoreDebug_DEMCR_TRCENA_Msk 0x1000000U
+
+#define RCC_CFGR_PPRE1 0x700U
+#define RCC_CFGR_PPRE1_DIV1 0x000U
+#define RCC_AHB2ENR_GPIOAEN 0x1U
+#define RCC_APB1ENR1_TIM2EN 0x1U
+
+#define TIM_CR1_CEN 0x1U
+#define TIM_SMCR_SMS_2 0x4U
+#define TIM_SMCR_TS_0 0x10U
+#define TIM_SMCR_TS_2 0x40U
+#define TIM_DIER_CC2IE 0x4U
+#define TIM_SR_CC1IF 0x2U
+#define TIM_SR_CC2IF 0x4U
+#define TIM_SR_CC2OF 0x400U
+#define TIM_EGR_UG 0x1U
+#define TIM_CCMR1_CC1S_0 0x1U
+#define TIM_CCMR1_CC2S_1 0x200U
+#define TIM_CCER_CC1E 0x1U
+#define TIM_CCER_CC1P 0x2U
+#define TIM_CCER_CC2E 0x10U
+#define TIM_CCER_CC2P 0x20U
+
+// Core clock of the NUCLEO-L4R5ZI.
+extern uint32_t SystemCoreClock;
+
+// Timer clock of the NUCLEO-L4R5ZI, with APB1 undivided.
+inline uint32_t HAL_RCC_GetPCLK1Freq() { return 120000000; }
+
+typedef enum { TIM2_IRQn = 28 } IRQn_Type;
+
+inline void NVIC_SetVector(IRQn_Type irq, uintptr_t vector) {
+  sim::irq_set_vector(irq, (void (*)())vector);
+}
+inline void NVIC_EnableIRQ(IRQn_Type irq) { sim::irq_enable(irq, true); }
+inline void NVIC_DisableIRQ(IRQn_Type irq) { sim::irq_enable(irq, false); }
+
+#define MBED_ASSERT(expr) ((void)0)
+
+using namespace mbed;
+using namespace rtos;
+using namespace events;
+
+#endif /* SIM_MBED_H */
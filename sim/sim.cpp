@@ -0,0 +1,1569 @@
+/**
+ * Deterministic virtual-clock simulator for the social distancing system.
+ *
+ * Models the HC-SR04, the VL53L0X, the PCF8574/HD44780 LCD, the rotary
+ * encoder, the user button, the buzzer and the watchdog, and schedules the
+ * firmware's threads against the virtual clock. simulate.cpp runs the firmware on top of it.
+ */
+
+#include "mbed.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+RCC_TypeDef sim_rcc;
+GPIO_TypeDef sim_gpio[8];
+TIM_TypeDef sim_tim2;
+DWT_Type sim_dwt;
+CoreDebug_Type sim_coredebug;
+uint32_t SystemCoreClock = 120000000;
+
+// The crash data RAM the Mbed linker scripts reserve, 256 bytes. A run is a
+// single boot, so nothing in it survives a reset here.
+asm(".bss\n"
+    ".balign 8\n"
+    ".globl __CRASH_DATA_RAM_START__\n"
+    "__CRASH_DATA_RAM_START__:\n"
+    ".space 256\n"
+    ".globl __CRASH_DATA_RAM_END__\n"
+    "__CRASH_DATA_RAM_END__:\n"
+    ".text\n");
+
+namespace sim {
+
+static const uint64_t NEVER = UINT64_MAX;
+static const uint64_t US = 1000;
+static const uint64_t MS = 1000000;
+
+// Software cost of one blocking I2C transaction in the HAL, on top of the
+// time the bytes take on the bus.
+static const uint64_t I2C_TRANSACTION_OVERHEAD_NS = 20 * US;
+
+//------------------Clock------------------------------------------------------
+
+static uint64_t g_now = 0;
+static uint64_t g_end = 60000 * MS;
+static uint64_t g_nextId = 1;
+static std::map<std::pair<uint64_t, uint64_t>, std::function<void()>> g_events;
+static std::unordered_map<uint64_t, uint64_t> g_eventTime;
+static int g_isr = 0;
+static int g_deepSleepLocks = 0;
+
+static uint64_t g_busyNs = 0;
+static uint64_t g_sleepNs = 0;
+static uint64_t g_deepSleepNs = 0;
+static uint64_t g_wakeups = 0;
+// True while an event that woke the core from deep sleep (stop mode) runs.
+// The high speed clock is off until it is handled, so TIM2 does not count.
+static bool g_stopMode = false;
+
+[[noreturn]] static void finish(int code);
+
+[[noreturn]] static void fatal(const char *what) {
+  fprintf(stderr, "sim: error at %.3f s: %s\n", g_now / 1e9, what);
+  finish(2);
+}
+
+uint64_t now_ns() { return g_now; }
+
+// Host CPU time when host_cycles() was turned on, or -1 while it is off.
+static int64_t g_hostCyclesFrom = -1;
+
+static int64_t host_cpu_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t cycle_ns() {
+  if (g_hostCyclesFrom < 0) {
+    return g_now;
+  }
+  return g_now + (uint64_t)(host_cpu_ns() - g_hostCyclesFrom);
+}
+
+void host_cycles(bool on) { g_hostCyclesFrom = on ? host_cpu_ns() : -1; }
+
+uint64_t schedule(uint64_t at_ns, std::function<void()> func) {
+  uint64_t id = g_nextId++;
+  g_events.emplace(std::make_pair(at_ns, id), std::move(func));
+  g_eventTime[id] = at_ns;
+  return id;
+}
+
+void cancel(uint64_t id) {
+  auto it = g_eventTime.find(id);
+  if (it != g_eventTime.end()) {
+    g_events.erase(std::make_pair(it->second, id));
+    g_eventTime.erase(it);
+  }
+}
+
+// Run the earliest pending event if it is due by `limit`.
+static bool run_event(uint64_t limit) {
+  if (g_events.empty() || g_events.begin()->first.first > limit) {
+    return false;
+  }
+  auto it = g_events.begin();
+  uint64_t at = it->first.first;
+  std::function<void()> func = std::move(it->second);
+  g_eventTime.erase(it->first.second);
+  g_events.erase(it);
+  if (at > g_now) {
+    g_now = at;
+  }
+  func();
+  return true;
+}
+
+IsrScope::IsrScope() { g_isr++; }
+IsrScope::~IsrScope() { g_isr--; }
+
+void deep_sleep_lock() { g_deepSleepLocks++; }
+void deep_sleep_unlock() {
+  if (g_deepSleepLocks > 0) {
+    g_deepSleepLocks--;
+  }
+}
+bool deep_sleep_allowed() { return g_deepSleepLocks == 0; }
+
+void cpu_time(uint64_t *busy_ns, uint64_t *sleep_ns, uint64_t *deep_sleep_ns) {
+  *busy_ns = g_busyNs;
+  *sleep_ns = g_sleepNs;
+  *deep_sleep_ns = g_deepSleepNs;
+}
+
+void busy_wait_ns(uint64_t ns) {
+  uint64_t target = g_now + ns;
+  while (run_event(target)) {
+  }
+  g_busyNs += target - g_now;
+  g_now = target;
+}
+
+//------------------Threads----------------------------------------------------
+
+struct Task {
+  std::function<void()> func;
+  std::mutex m;
+  std::condition_variable cv;
+  bool go = false;
+  bool finished = false;
+  int priority;
+  const char *name;
+  uint64_t order = 0;
+  uint64_t wakeId = 0;
+  bool timedOut = false;
+  WaitState *waitingOn = nullptr;
+  QueueState *waitingQueue = nullptr;
+  uint32_t wantFlags = 0;
+  bool wantAll = false;
+  bool wantClear = true;
+  uint32_t gotFlags = 0;
+};
+
+static Task *g_current = nullptr;
+static std::vector<Task *> g_ready;
+static uint64_t g_readyOrder = 0;
+
+static void make_ready(Task *task) {
+  if (task->wakeId != 0) {
+    cancel(task->wakeId);
+    task->wakeId = 0;
+  }
+  task->order = g_readyOrder++;
+  g_ready.push_back(task);
+}
+
+static Task *pop_ready() {
+  if (g_ready.empty()) {
+    return nullptr;
+  }
+  auto best = g_ready.begin();
+  for (auto it = g_ready.begin(); it != g_ready.end(); ++it) {
+    if ((*it)->priority > (*best)->priority ||
+        ((*it)->priority == (*best)->priority && (*it)->order < (*best)->order)) {
+      best = it;
+    }
+  }
+  Task *task = *best;
+  g_ready.erase(best);
+  return task;
+}
+
+static void handoff(Task *self, Task *next) {
+  g_current = next;
+  {
+    std::lock_guard<std::mutex> lock(next->m);
+    next->go = true;
+  }
+  next->cv.notify_one();
+  if (self != nullptr && !self->finished) {
+    std::unique_lock<std::mutex> lock(self->m);
+    self->cv.wait(lock, [self] { return self->go; });
+    self->go = false;
+  }
+}
+
+// Give the CPU to the next ready thread, advancing the clock while all
+// threads are blocked. Returns once `self` has been scheduled again.
+static void run_next(Task *self) {
+  for (;;) {
+    Task *next = pop_ready();
+    if (next != nullptr) {
+      if (next != self) {
+        handoff(self, next);
+      }
+      g_current = self;
+      return;
+    }
+    uint64_t before = g_now;
+    g_stopMode = g_deepSleepLocks == 0;
+    bool woken = run_event(g_end);
+    g_stopMode = false;
+    if (!woken) {
+      g_now = g_end;
+    } else {
+      g_wakeups++;
+    }
+    // Nothing was running, so the time that passed was spent asleep.
+    if (g_deepSleepLocks == 0) {
+      g_deepSleepNs += g_now - before;
+    } else {
+      g_sleepNs += g_now - before;
+    }
+    if (g_now >= g_end) {
+      finish(0);
+    }
+  }
+}
+
+static void block(uint64_t timeout_ns) {
+  if (g_isr > 0) {
+    fatal("blocking call in interrupt context");
+  }
+  Task *self = g_current;
+  self->timedOut = false;
+  if (timeout_ns != NEVER) {
+    self->wakeId = schedule(g_now + timeout_ns, [self] {
+      self->wakeId = 0;
+      self->timedOut = true;
+      if (self->waitingOn != nullptr) {
+        auto &w = self->waitingOn->waiters;
+        w.erase(std::remove(w.begin(), w.end(), self), w.end());
+      }
+      make_ready(self);
+    });
+  }
+  run_next(self);
+  self->waitingOn = nullptr;
+}
+
+static void task_main(Task *task) {
+  {
+    std::unique_lock<std::mutex> lock(task->m);
+    task->cv.wait(lock, [task] { return task->go; });
+    task->go = false;
+  }
+  task->func();
+  task->finished = true;
+  run_next(task);
+}
+
+Task *thread_start(std::function<void()> func, int priority,
+                   const char *name) {
+  Task *task = new Task;
+  task->func = std::move(func);
+  task->priority = priority;
+  task->name = name;
+  std::thread(task_main, task).detach();
+  make_ready(task);
+  return task;
+}
+
+void thread_set_priority(Task *task, int priority) { task->priority = priority; }
+
+void sleep_ns(uint64_t ns) { block(ns); }
+
+void yield() {
+  make_ready(g_current);
+  run_next(g_current);
+}
+
+//------------------Synchronization--------------------------------------------
+
+void mutex_lock(WaitState *state) {
+  if (state->owner == nullptr || state->owner == g_current) {
+    state->owner = g_current;
+    state->count++;
+    return;
+  }
+  state->waiters.push_back(g_current);
+  g_current->waitingOn = state;
+  block(NEVER);
+}
+
+bool mutex_trylock(WaitState *state) {
+  if (state->owner == nullptr || state->owner == g_current) {
+    state->owner = g_current;
+    state->count++;
+    return true;
+  }
+  return false;
+}
+
+void mutex_unlock(WaitState *state) {
+  if (--state->count > 0) {
+    return;
+  }
+  state->owner = nullptr;
+  if (!state->waiters.empty()) {
+    Task *next = state->waiters.front();
+    state->waiters.pop_front();
+    state->owner = next;
+    state->count = 1;
+    make_ready(next);
+  }
+}
+
+bool sem_acquire(WaitState *state, uint64_t timeout_ns) {
+  if (state->count > 0) {
+    state->count--;
+    return true;
+  }
+  if (timeout_ns == 0) {
+    return false;
+  }
+  state->waiters.push_back(g_current);
+  g_current->waitingOn = state;
+  block(timeout_ns);
+  return !g_current->timedOut;
+}
+
+void sem_release(WaitState *state) {
+  if (!state->waiters.empty()) {
+    Task *next = state->waiters.front();
+    state->waiters.pop_front();
+    make_ready(next);
+  } else {
+    state->count++;
+  }
+}
+
+static bool flags_match(uint32_t have, uint32_t want, bool all) {
+  return all ? (have & want) == want : (have & want) != 0;
+}
+
+uint32_t flags_set(WaitState *state, uint32_t flags) {
+  state->flags |= flags;
+  for (auto it = state->waiters.begin(); it != state->waiters.end();) {
+    Task *task = *it;
+    if (flags_match(state->flags, task->wantFlags, task->wantAll)) {
+      task->gotFlags = state->flags;
+      if (task->wantClear) {
+        state->flags &= ~task->wantFlags;
+      }
+      it = state->waiters.erase(it);
+      make_ready(task);
+    } else {
+      ++it;
+    }
+  }
+  return state->flags;
+}
+
+uint32_t flags_wait(WaitState *state, uint32_t flags, bool all, uint32_t ms,
+                    bool clear) {
+  if (flags_match(state->flags, flags, all)) {
+    uint32_t got = state->flags;
+    if (clear) {
+      state->flags &= ~flags;
+    }
+    return got;
+  }
+  if (ms == 0) {
+    return osFlagsErrorTimeout;
+  }
+  Task *self = g_current;
+  self->wantFlags = flags;
+  self->wantAll = all;
+  self->wantClear = clear;
+  state->waiters.push_back(self);
+  self->waitingOn = state;
+  block(ms == osWaitForever ? NEVER : (uint64_t)ms * MS);
+  return self->timedOut ? osFlagsErrorTimeout : self->gotFlags;
+}
+
+void queue_post(QueueState *state, std::function<void()> func) {
+  state->events.push_back(std::move(func));
+  Task *dispatcher = state->dispatcher;
+  if (dispatcher != nullptr && dispatcher->waitingQueue == state) {
+    dispatcher->waitingQueue = nullptr;
+    make_ready(dispatcher);
+  }
+}
+
+void queue_dispatch(QueueState *state) {
+  state->dispatcher = g_current;
+  for (;;) {
+    while (!state->events.empty()) {
+      std::function<void()> func = std::move(state->events.front());
+      state->events.pop_front();
+      func();
+    }
+    g_current->waitingQueue = state;
+    block(NEVER);
+  }
+}
+
+//------------------Pins-------------------------------------------------------
+
+struct Pin {
+  int level = 0;
+  std::vector<mbed::InterruptIn *> listeners;
+};
+
+// Indexed by PinName; NC and anything out of range share the last entry.
+static const int PIN_COUNT = 0x80;
+
+static Pin &pin_state(int pin) {
+  static Pin table[PIN_COUNT + 1];
+  return table[pin >= 0 && pin < PIN_COUNT ? pin : PIN_COUNT];
+}
+
+static void on_pin_write(int pin, int level);
+
+static void tim2_edge(int pin, int level);
+
+static void pin_drive(int pin, int value) {
+  Pin &p = pin_state(pin);
+  int level = value ? 1 : 0;
+  if (p.level == level) {
+    return;
+  }
+  p.level = level;
+  for (size_t i = 0; i < p.listeners.size(); i++) {
+    p.listeners[i]->edge(level);
+  }
+  tim2_edge(pin, level);
+}
+
+int pin_read(int pin) { return pin_state(pin).level; }
+
+void pin_set(int pin, int value) { pin_state(pin).level = value ? 1 : 0; }
+
+void pin_write(int pin, int value) {
+  pin_drive(pin, value);
+  on_pin_write(pin, value ? 1 : 0);
+}
+
+void pin_listen(int pin, mbed::InterruptIn *in) {
+  pin_state(pin).listeners.push_back(in);
+}
+
+mbed::InterruptIn *pin_listener(int pin) {
+  auto &l = pin_state(pin).listeners;
+  return l.empty() ? nullptr : l.back();
+}
+
+void pin_unlisten(int pin, mbed::InterruptIn *in) {
+  auto &l = pin_state(pin).listeners;
+  l.erase(std::remove(l.begin(), l.end(), in), l.end());
+}
+
+//------------------Timer input capture----------------------------------------
+
+// Only what PWM input mode on TIM2 channel 1 needs: captures on TI1 into
+// CCR1/CCR2 with their polarities, the counter reset on TI1's rising edge,
+// and the capture 2 interrupt.
+
+static const int TIM2_IRQ = 28;
+static const uint64_t TIM2_CLOCK_HZ = 120000000;
+
+static void (*g_vectors[128])();
+static bool g_irqEnabled[128];
+static uint64_t g_tim2Base = 0;
+
+void irq_set_vector(int irq, void (*vector)()) { g_vectors[irq] = vector; }
+
+void irq_enable(int irq, bool enabled) { g_irqEnabled[irq] = enabled; }
+
+// True if the pin is in alternate function 1 mode, which routes PA_0, PA_5
+// and PA_15 to TIM2 channel 1.
+static bool tim2_routed(int pin) {
+  if (pin != PA_0 && pin != PA_5 && pin != PA_15) {
+    return false;
+  }
+  int n = pin & 0xF;
+  return ((GPIOA->MODER >> (n * 2)) & 0x3) == 0x2 &&
+         ((GPIOA->AFR[n >> 3] >> ((n & 7) * 4)) & 0xF) == 1;
+}
+
+// An edge that comes while the core is in stop mode is lost, as TIM2's clock
+// is stopped with it.
+static void tim2_edge(int pin, int level) {
+  if (!(TIM2->CR1 & TIM_CR1_CEN) || !tim2_routed(pin) || g_stopMode) {
+    return;
+  }
+  uint32_t count =
+      (uint32_t)((g_now - g_tim2Base) * TIM2_CLOCK_HZ / (TIM2->PSC + 1) /
+                 1000000000ULL);
+
+  // Channel 1 and 2 capture TI1 directly or indirectly; either way the
+  // polarity bit picks the edge.
+  bool ti1 = (TIM2->CCMR1 & 0x3) == 0x1 || ((TIM2->CCMR1 >> 8) & 0x3) == 0x2;
+  if (!ti1) {
+    return;
+  }
+  uint32_t flags = 0;
+  if ((TIM2->CCER & TIM_CCER_CC1E) && level == !(TIM2->CCER & TIM_CCER_CC1P)) {
+    TIM2->CCR1 = count;
+    flags |= TIM_SR_CC1IF;
+  }
+  if ((TIM2->CCER & TIM_CCER_CC2E) && level == !(TIM2->CCER & TIM_CCER_CC2P)) {
+    TIM2->CCR2 = count;
+    flags |= TIM_SR_CC2IF;
+  }
+  TIM2->SR.value |= flags;
+
+  // Reset mode triggered by TI1FP1 restarts the count on the rising edge.
+  if ((TIM2->SMCR & 0x7) == 0x4 && ((TIM2->SMCR >> 4) & 0x7) == 0x5 &&
+      level == 1) {
+    g_tim2Base = g_now;
+  }
+
+  if ((flags & TIM_SR_CC2IF) && (TIM2->DIER & TIM_DIER_CC2IE) &&
+      g_irqEnabled[TIM2_IRQ] && g_vectors[TIM2_IRQ]) {
+    IsrScope isr;
+    g_vectors[TIM2_IRQ]();
+  }
+}
+
+//------------------Ultrasonic sensor model------------------------------------
+
+// Delay between the end of the trigger pulse and the start of the echo pulse.
+static const uint64_t SONAR_ECHO_DELAY_NS = 460 * US;
+// How long the sensor holds echo high when nothing reflects the burst.
+static const uint64_t SONAR_NO_ECHO_NS = 38 * MS;
+
+struct Sonar {
+  int trigger;
+  int echo;
+  double cm = -1.0;
+  double spike = -1.0;
+  uint64_t triggerRise = 0;
+  bool busy = false;
+  uint64_t fallAt = 0;
+  uint64_t fallEvent = 0;
+  uint64_t pings = 0;
+  uint64_t crosstalk = 0;
+};
+
+static std::vector<Sonar> &sonars() {
+  static std::vector<Sonar> list = {
+      {D9, MBED_CONF_APP_ECHO_INPUT_CAPTURE ? D13 : D8}};
+  return list;
+}
+
+static void sonar_fall(Sonar &s, uint64_t at) {
+  Sonar *sp = &s;
+  s.fallAt = at;
+  s.fallEvent = schedule(at, [sp] {
+    pin_drive(sp->echo, 0);
+    sp->busy = false;
+  });
+}
+
+static void sonar_trigger(Sonar &s, int level) {
+  if (level) {
+    s.triggerRise = g_now;
+    return;
+  }
+  if (s.busy || g_now - s.triggerRise < 10 * US) {
+    return;
+  }
+  s.busy = true;
+  s.pings++;
+  double cm = s.spike >= 0 ? s.spike : s.cm;
+  s.spike = -1.0;
+  uint64_t width = cm < 0 ? SONAR_NO_ECHO_NS
+                          : (uint64_t)(cm * 2.0 / 0.03432 * US);
+  uint64_t rise = g_now + SONAR_ECHO_DELAY_NS;
+  int echo = s.echo;
+  schedule(rise, [echo] { pin_drive(echo, 1); });
+  sonar_fall(s, rise + width);
+
+  // Sensors list their neighbours next to them. A neighbour still waiting
+  // for its own echo hears this burst's reflection and ends early.
+  std::vector<Sonar> &list = sonars();
+  size_t index = &s - &list[0];
+  for (size_t n = index - 1; n != index + 2; n++) {
+    if (n == index || n >= list.size() || !list[n].busy) {
+      continue;
+    }
+    if (rise + width < list[n].fallAt) {
+      list[n].crosstalk++;
+      cancel(list[n].fallEvent);
+      sonar_fall(list[n], rise + width);
+    }
+  }
+}
+
+//------------------Time-of-flight sensor model--------------------------------
+
+// The VL53L0X's I2C address, its registers and the time a single ranging
+// takes with the default timing budget.
+static const int TOF_ADDRESS = 0x52;
+static const int TOF_SYSRANGE_START = 0x00;
+static const int TOF_SEQUENCE_CONFIG = 0x01;
+static const int TOF_INTERRUPT_CLEAR = 0x0B;
+static const int TOF_INTERRUPT_STATUS = 0x13;
+static const int TOF_RANGE_STATUS = 0x14;
+static const int TOF_PAGE = 0xFF;
+static const uint64_t TOF_RANGING_NS = 33 * MS;
+// Farthest target the sensor sees, in centimeters.
+static const double TOF_MAX_CM = 200.0;
+
+// Registers are 256 bytes with an auto-incrementing index. Writing 1 to
+// 0xFF swaps in a private page, which holds the stop variable at 0x91.
+struct Tof {
+  int address;
+  int gpio1;
+  double cm = -1.0;
+  double spike = -1.0;
+  uint8_t regs[256] = {};
+  uint8_t page[256] = {};
+  uint8_t index = 0;
+  bool ranging = false;
+  uint64_t rangings = 0;
+
+  uint8_t &reg(uint8_t r) {
+    return regs[TOF_PAGE] == 1 && r != TOF_PAGE ? page[r] : regs[r];
+  }
+};
+
+static std::vector<Tof> &tofs() {
+  static std::vector<Tof> list = [] {
+    std::vector<Tof> l = {{TOF_ADDRESS, D7}};
+    for (Tof &t : l) {
+      t.regs[TOF_SEQUENCE_CONFIG] = 0xFF;
+      t.regs[0xC0] = 0xEE;
+      t.page[0x91] = 0x3C;
+      // GPIO1 is open drain with a pull-up.
+      pin_state(t.gpio1).level = 1;
+    }
+    return l;
+  }();
+  return list;
+}
+
+// A reset of the board that the sensor kept its power through leaves it set
+// up for ranging, as the firmware's init() left it.
+static void tof_reset(bool powerLost) {
+  for (Tof &t : tofs()) {
+    t.regs[TOF_SEQUENCE_CONFIG] = powerLost ? 0xFF : 0xE8;
+  }
+}
+
+static Tof *tof_at(int address) {
+  for (Tof &t : tofs()) {
+    if (t.address == address) {
+      return &t;
+    }
+  }
+  return nullptr;
+}
+
+// A ranging or reference calibration finished: post the result and pull
+// GPIO1 low.
+static void tof_result(Tof &t) {
+  double cm = t.spike >= 0 ? t.spike : t.cm;
+  t.spike = -1.0;
+  bool valid = cm >= 0 && cm <= TOF_MAX_CM;
+  int mm = valid ? (int)(cm * 10.0 + 0.5) : 8190;
+  t.ranging = false;
+  t.rangings++;
+  t.regs[TOF_SYSRANGE_START] &= ~1;
+  t.regs[TOF_INTERRUPT_STATUS] = 0x04;
+  t.regs[TOF_RANGE_STATUS] = (valid ? 11 : 4) << 3;
+  t.regs[TOF_RANGE_STATUS + 10] = (uint8_t)(mm >> 8);
+  t.regs[TOF_RANGE_STATUS + 11] = (uint8_t)mm;
+  pin_drive(t.gpio1, 0);
+}
+
+static void tof_write(Tof &t, const char *data, int length) {
+  if (length < 1) {
+    return;
+  }
+  t.index = (uint8_t)data[0];
+  for (int i = 1; i < length; i++) {
+    uint8_t r = t.index++;
+    uint8_t value = (uint8_t)data[i];
+    bool mainPage = !(t.regs[TOF_PAGE] == 1 && r != TOF_PAGE);
+    t.reg(r) = value;
+    if (mainPage && r == TOF_SYSRANGE_START && (value & 1) && !t.ranging) {
+      t.ranging = true;
+      Tof *tp = &t;
+      schedule(g_now + TOF_RANGING_NS, [tp] { tof_result(*tp); });
+    } else if (mainPage && r == TOF_INTERRUPT_CLEAR && value) {
+      t.regs[TOF_INTERRUPT_STATUS] = 0;
+      pin_drive(t.gpio1, 1);
+    }
+  }
+}
+
+static void tof_read(Tof &t, char *data, int length) {
+  for (int i = 0; i < length; i++) {
+    data[i] = (char)t.reg(t.index++);
+  }
+}
+
+//------------------Buzzer and watchdog----------------------------------------
+
+static const int BUZZER_PIN = PB_8;
+
+struct Reaction {
+  uint64_t cause;
+  uint64_t effect;
+  bool on;
+};
+
+static bool g_buzzer = false;
+static uint64_t g_buzzerOnNs = 0;
+static uint64_t g_buzzerSince = 0;
+static int g_buzzerEdges = 0;
+static int g_buzzerWrites = 0;
+static float g_buzzerPeriod = 0.0f;
+static float g_buzzerDuty = 0.0f;
+static uint64_t g_lastStimulus = NEVER;
+static std::vector<Reaction> g_reactions;
+
+// The buzzer module sounds while its input is low, so a running PWM makes it
+// beep once per period, for the low part of it, and a duty cycle of 0 makes
+// a steady tone.
+static std::string beep() {
+  if (!g_buzzer) {
+    return "off";
+  }
+  if (g_buzzerDuty <= 0.0f) {
+    return "steady";
+  }
+  char text[32];
+  snprintf(text, sizeof(text), "%.0f/%.0f", g_buzzerPeriod * 1e3,
+           g_buzzerPeriod * (1.0f - g_buzzerDuty) * 1e3);
+  return text;
+}
+
+void pwm_update(int pin, bool running, float period, float duty) {
+  if (pin != BUZZER_PIN) {
+    return;
+  }
+  g_buzzerWrites++;
+  g_buzzerPeriod = period;
+  g_buzzerDuty = duty;
+  if (running == g_buzzer) {
+    return;
+  }
+  if (g_buzzer) {
+    g_buzzerOnNs += g_now - g_buzzerSince;
+  }
+  g_buzzer = running;
+  g_buzzerSince = g_now;
+  g_buzzerEdges++;
+  if (g_lastStimulus != NEVER) {
+    g_reactions.push_back({g_lastStimulus, g_now, running});
+    g_lastStimulus = NEVER;
+  }
+}
+
+static uint64_t g_watchdogId = 0;
+static uint64_t g_lastKick = 0;
+static uint64_t g_maxKickGap = 0;
+static uint64_t g_kicks = 0;
+
+void watchdog_kick(uint32_t timeout_ms) {
+  if (g_watchdogId != 0) {
+    cancel(g_watchdogId);
+    g_watchdogId = 0;
+    g_maxKickGap = std::max(g_maxKickGap, g_now - g_lastKick);
+    g_kicks++;
+  }
+  g_lastKick = g_now;
+  if (timeout_ms > 0) {
+    g_watchdogId = schedule(g_now + (uint64_t)timeout_ms * MS, [] {
+      fprintf(stderr, "sim: watchdog reset at %.3f s\n", g_now / 1e9);
+      finish(3);
+    });
+  }
+}
+
+static int g_resetReason = RESET_REASON_POWER_ON;
+
+int reset_reason() { return g_resetReason; }
+
+//------------------LCD model (PCF8574 + HD44780)------------------------------
+
+struct Lcd {
+  bool fourBit = false;
+  bool haveHigh = false;
+  uint8_t high = 0;
+  uint8_t port = 0;
+  uint8_t ddram[128];
+  uint8_t cgram[64];
+  bool cgMode = false;
+  int addr = 0;
+  uint64_t busyUntil = 0;
+  uint64_t violations = 0;
+  uint64_t instructions = 0;
+  uint64_t dataWrites = 0;
+
+  Lcd() { reset(true); }
+
+  // After power on, the controller runs its own reset for up to 40 ms and
+  // comes up in 8 bit mode. When the LCD kept its power through the board's
+  // reset, it is left as the firmware had it, and in the worst case half way
+  // through a byte, with the rest of the last message still on screen.
+  void reset(bool powerOn) {
+    memset(ddram, ' ', sizeof(ddram));
+    memset(cgram, 0, sizeof(cgram));
+    cgMode = false;
+    addr = 0;
+    if (powerOn) {
+      fourBit = false;
+      haveHigh = false;
+      busyUntil = 40 * MS;
+    } else {
+      fourBit = true;
+      haveHigh = true;
+      high = 0x00;
+      memcpy(ddram, "Please Back Up! ", 16);
+      busyUntil = 0;
+    }
+  }
+
+  void advance() {
+    if (cgMode) {
+      addr = (addr + 1) & 0x3F;
+    } else if (addr == 0x27) {
+      addr = 0x40;
+    } else if (addr == 0x67) {
+      addr = 0x00;
+    } else {
+      addr = (addr + 1) & 0x7F;
+    }
+  }
+
+  void execute(uint8_t value, bool rs, uint64_t t) {
+    if (t < busyUntil) {
+      violations++;
+    }
+    uint64_t duration = 37 * US;
+    if (rs) {
+      dataWrites++;
+      duration += 4 * US;
+      if (cgMode) {
+        cgram[addr & 0x3F] = value;
+      } else {
+        ddram[addr & 0x7F] = value;
+      }
+      advance();
+    } else {
+      instructions++;
+      if (value & 0x80) {
+        cgMode = false;
+        addr = value & 0x7F;
+      } else if (value & 0x40) {
+        cgMode = true;
+        addr = value & 0x3F;
+      } else if (value & 0x20) {
+        fourBit = (value & 0x10) == 0;
+      } else if (value == 0x01) {
+        memset(ddram, ' ', sizeof(ddram));
+        cgMode = false;
+        addr = 0;
+        duration = 1520 * US;
+      } else if ((value & 0xFE) == 0x02) {
+        cgMode = false;
+        addr = 0;
+        duration = 1520 * US;
+      }
+    }
+    busyUntil = t + duration;
+  }
+
+  // A byte written to the PCF8574; data is latched on the falling edge of En.
+  void expander(uint8_t value, uint64_t t) {
+    bool fall = (port & 0x04) && !(value & 0x04);
+    port = value;
+    if (!fall) {
+      return;
+    }
+    uint8_t nibble = value & 0xF0;
+    bool rs = value & 0x01;
+    if (!fourBit) {
+      execute(nibble, rs, t);
+      haveHigh = false;
+    } else if (!haveHigh) {
+      high = nibble;
+      haveHigh = true;
+    } else {
+      haveHigh = false;
+      execute(high | (nibble >> 4), rs, t);
+    }
+  }
+
+  // A row as text: CGRAM characters show as their code, 0 to 7, and the
+  // full block as '=', since '#' starts a comment in scenes.
+  std::string row(int r) const {
+    std::string s;
+    for (int c = 0; c < 16; c++) {
+      uint8_t ch = ddram[(r ? 0x40 : 0x00) + c];
+      if (ch < 8) {
+        s += (char)('0' + ch);
+      } else if (ch == 0xFF) {
+        s += '=';
+      } else if (ch < 0x20 || ch > 0x7E) {
+        s += '?';
+      } else {
+        s += (char)ch;
+      }
+    }
+    return s;
+  }
+};
+
+static const int LCD_ADDRESS = 0x4E;
+
+static Lcd g_lcd;
+static uint64_t g_i2cTransactions = 0;
+static uint64_t g_i2cBytes = 0;
+static uint64_t g_i2cBusNs = 0;
+// Keyed by each bus's SDA pin.
+static std::map<int, uint64_t> g_i2cBusyUntil;
+
+static uint64_t byte_ns(int hz) { return 9ULL * 1000000000ULL / hz; }
+
+// Account for one transaction on the bus starting now and return its length.
+static uint64_t i2c_bus(int sda, int hz, int address, const char *data,
+                        int length, bool write) {
+  uint64_t &busyUntil = g_i2cBusyUntil[sda];
+  uint64_t start = std::max(g_now, busyUntil);
+  uint64_t t = start + I2C_TRANSACTION_OVERHEAD_NS + byte_ns(hz);
+  for (int i = 0; i < length; i++) {
+    t += byte_ns(hz);
+    if (write && address == LCD_ADDRESS) {
+      g_lcd.expander((uint8_t)data[i], t);
+    }
+  }
+  g_i2cTransactions++;
+  g_i2cBytes += length + 1;
+  g_i2cBusNs += t - start;
+  busyUntil = t;
+  return t - g_now;
+}
+
+// Hand a transaction to the device at address; false if nothing answers.
+static bool i2c_device(int address, const char *tx, int tx_length, char *rx,
+                       int rx_length) {
+  if (address == LCD_ADDRESS) {
+    return true;
+  }
+  Tof *t = tof_at(address);
+  if (!t) {
+    return false;
+  }
+  tof_write(*t, tx, tx_length);
+  tof_read(*t, rx, rx_length);
+  return true;
+}
+
+int i2c_write(int sda, int hz, int address, const char *data, int length,
+              bool repeated) {
+  (void)repeated;
+  busy_wait_ns(i2c_bus(sda, hz, address, data, length, true));
+  return i2c_device(address, data, length, nullptr, 0) ? 0 : -1;
+}
+
+int i2c_read(int sda, int hz, int address, char *data, int length,
+             bool repeated) {
+  (void)repeated;
+  memset(data, 0, length);
+  busy_wait_ns(i2c_bus(sda, hz, address, data, length, false));
+  return i2c_device(address, nullptr, 0, data, length) ? 0 : -1;
+}
+
+void i2c_stop(int hz) { busy_wait_ns(1000000000ULL / hz); }
+
+int i2c_transfer(int sda, int hz, int address, const char *tx, int tx_length,
+                 char *rx, int rx_length,
+                 const std::function<void(int)> &callback, int event,
+                 bool repeated) {
+  (void)repeated;
+  if (g_i2cBusyUntil[sda] > g_now) {
+    return -1;
+  }
+  uint64_t duration = i2c_bus(sda, hz, address, tx, tx_length, true);
+  if (rx_length > 0) {
+    memset(rx, 0, rx_length);
+    duration += i2c_bus(sda, hz, address, rx, rx_length, false);
+  }
+  int result = i2c_device(address, tx, tx_length, rx, rx_length)
+                   ? I2C_EVENT_TRANSFER_COMPLETE
+                   : I2C_EVENT_ERROR_NO_SLAVE;
+  deep_sleep_lock();
+  std::function<void(int)> done = callback;
+  schedule(g_now + duration, [done, result, event] {
+    deep_sleep_unlock();
+    if (done && (result & event)) {
+      IsrScope isr;
+      done(result & event);
+    }
+  });
+  return 0;
+}
+
+//------------------UART-------------------------------------------------------
+
+// A transmitter with one byte of buffering in front of the shift register:
+// the transmit register is empty again as soon as a byte starts shifting
+// out, 10 bit times before it has gone.
+struct Uart {
+  int baud = 9600;
+  uint64_t busyUntil = 0;
+  uint64_t busyNs = 0;
+  std::function<void()> txIrq;
+  uint64_t irqEvent = 0;
+  std::vector<uint8_t> sent;
+};
+
+static std::map<int, Uart> g_uarts;
+static std::string g_uartCapture;
+
+static uint64_t uart_byte_ns(int baud) { return 10ULL * 1000000000ULL / baud; }
+
+// When the transmit register is next empty.
+static uint64_t uart_ready(const Uart &u) {
+  uint64_t byte = uart_byte_ns(u.baud);
+  return u.busyUntil > g_now + byte ? u.busyUntil - byte : g_now;
+}
+
+// Raise the transmit interrupt once the register is empty. The model raises
+// it once per byte written rather than for as long as the register stays
+// empty, so a handler that neither writes nor detaches is not called again.
+static void uart_schedule(int tx) {
+  Uart &u = g_uarts[tx];
+  if (u.irqEvent != 0) {
+    cancel(u.irqEvent);
+    u.irqEvent = 0;
+  }
+  if (!u.txIrq) {
+    return;
+  }
+  u.irqEvent = schedule(uart_ready(u), [tx] {
+    Uart &u = g_uarts[tx];
+    u.irqEvent = 0;
+    if (u.txIrq) {
+      std::function<void()> handler = u.txIrq;
+      IsrScope isr;
+      handler();
+    }
+  });
+}
+
+void uart_put(int tx, int baud, uint8_t byte) {
+  Uart &u = g_uarts[tx];
+  u.baud = baud;
+  uint64_t ready = uart_ready(u);
+  if (ready > g_now) {
+    busy_wait_ns(ready - g_now);
+  }
+  uint64_t start = std::max(g_now, u.busyUntil);
+  u.busyUntil = start + uart_byte_ns(baud);
+  u.busyNs += uart_byte_ns(baud);
+  u.sent.push_back(byte);
+  uart_schedule(tx);
+}
+
+void uart_tx_irq(int tx, int baud, std::function<void()> func) {
+  Uart &u = g_uarts[tx];
+  u.baud = baud;
+  u.txIrq = std::move(func);
+  uart_schedule(tx);
+}
+
+void uart_capture(const char *path) { g_uartCapture = path; }
+
+static void uart_save() {
+  if (g_uartCapture.empty()) {
+    return;
+  }
+  FILE *out = fopen(g_uartCapture.c_str(), "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "sim: cannot write %s\n", g_uartCapture.c_str());
+    return;
+  }
+  for (const auto &entry : g_uarts) {
+    fwrite(entry.second.sent.data(), 1, entry.second.sent.size(), out);
+  }
+  fclose(out);
+}
+
+//------------------Flash------------------------------------------------------
+
+// Typical STM32L4R5 timings: a double word program takes 82 us and a page
+// erase 22 ms. Reads cost a core cycle per byte.
+static const uint64_t FLASH_PROGRAM_NS = 82000;
+static const uint64_t FLASH_ERASE_NS = 22000000;
+static const int FLASH_DOUBLE_WORD = 8;
+
+struct Flash {
+  bool open = false;
+  uint32_t base = 0;
+  std::vector<uint8_t> bytes;
+  uint64_t reads = 0;
+  uint64_t programs = 0;
+  uint64_t erases = 0;
+  // Programs of a double word that was not erased, which the flash refuses.
+  uint64_t violations = 0;
+};
+
+static Flash g_flash;
+static std::string g_flashImage;
+
+void flash_image(const char *path) { g_flashImage = path; }
+
+void flash_open(uint32_t address, uint32_t size) {
+  if (g_flash.open) {
+    return;
+  }
+  g_flash.open = true;
+  g_flash.base = address;
+  g_flash.bytes.assign(size, 0xFF);
+  if (!g_flashImage.empty()) {
+    FILE *in = fopen(g_flashImage.c_str(), "rb");
+    if (in != nullptr) {
+      size_t n = fread(g_flash.bytes.data(), 1, size, in);
+      (void)n;
+      fclose(in);
+    }
+  }
+}
+
+static bool flash_range(uint32_t address, size_t size) {
+  return g_flash.open && address >= g_flash.base &&
+         address - g_flash.base + size <= g_flash.bytes.size();
+}
+
+bool flash_read(uint32_t address, void *data, size_t size) {
+  if (!flash_range(address, size)) {
+    return false;
+  }
+  busy_wait_ns(size * 25 / 3);
+  memcpy(data, &g_flash.bytes[address - g_flash.base], size);
+  g_flash.reads++;
+  return true;
+}
+
+bool flash_program(uint32_t address, const void *data, size_t size) {
+  if (!flash_range(address, size)) {
+    return false;
+  }
+  const uint8_t *in = (const uint8_t *)data;
+  uint8_t *out = &g_flash.bytes[address - g_flash.base];
+  for (size_t i = 0; i < size; i += FLASH_DOUBLE_WORD) {
+    busy_wait_ns(FLASH_PROGRAM_NS);
+    for (int j = 0; j < FLASH_DOUBLE_WORD; j++) {
+      if (out[i + j] != 0xFF) {
+        g_flash.violations++;
+        return false;
+      }
+    }
+    memcpy(out + i, in + i, FLASH_DOUBLE_WORD);
+    g_flash.programs++;
+  }
+  return true;
+}
+
+bool flash_erase(uint32_t address, size_t size) {
+  if (!flash_range(address, size)) {
+    return false;
+  }
+  for (size_t done = 0; done < size; done += 4096) {
+    busy_wait_ns(FLASH_ERASE_NS);
+    g_flash.erases++;
+  }
+  memset(&g_flash.bytes[address - g_flash.base], 0xFF, size);
+  return true;
+}
+
+static void flash_save() {
+  if (!g_flash.open || g_flashImage.empty()) {
+    return;
+  }
+  FILE *out = fopen(g_flashImage.c_str(), "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "sim: cannot write %s\n", g_flashImage.c_str());
+    return;
+  }
+  fwrite(g_flash.bytes.data(), 1, g_flash.bytes.size(), out);
+  fclose(out);
+}
+
+//------------------Encoder and button-----------------------------------------
+
+static const int ENCODER_A = PE_10;
+static const int ENCODER_B = PE_12;
+static const int BUTTON = PC_13;
+
+// One detent is a full quadrature cycle, 00 -> 01 -> 11 -> 10 -> 00 when
+// turning right (which QEI counts up) and the reverse when turning left.
+static void encoder_turn(uint64_t at, int detents, uint64_t detent_ns) {
+  static const int cycle[4] = {0x1, 0x3, 0x2, 0x0};
+  int steps = detents < 0 ? -detents : detents;
+  for (int d = 0; d < steps; d++) {
+    for (int i = 0; i < 4; i++) {
+      int state = detents > 0 ? cycle[i] : cycle[(6 - i) % 4];
+      uint64_t t = at + d * detent_ns + i * detent_ns / 4;
+      schedule(t, [state] {
+        pin_drive(ENCODER_B, state & 1);
+        pin_drive(ENCODER_A, (state >> 1) & 1);
+      });
+    }
+  }
+}
+
+static void on_pin_write(int pin, int level) {
+  for (Sonar &s : sonars()) {
+    if (s.trigger == pin) {
+      sonar_trigger(s, level);
+    }
+  }
+}
+
+//------------------Console----------------------------------------------------
+
+// The receiver starts out on, holding a deep sleep lock that run() takes.
+static std::deque<char> g_consoleInput;
+static std::function<void()> g_consoleSigio;
+static bool g_consoleEnabled = true;
+static uint64_t g_consoleTyped = 0;
+static uint64_t g_consoleLost = 0;
+
+int console_read(char *data, size_t size) {
+  if (g_consoleInput.empty()) {
+    return -EAGAIN;
+  }
+  size_t n = 0;
+  while (n < size && !g_consoleInput.empty()) {
+    data[n++] = g_consoleInput.front();
+    g_consoleInput.pop_front();
+  }
+  return (int)n;
+}
+
+bool console_readable() { return !g_consoleInput.empty(); }
+
+void console_sigio(std::function<void()> func) {
+  g_consoleSigio = std::move(func);
+}
+
+void console_enable(bool enabled) {
+  if (enabled == g_consoleEnabled) {
+    return;
+  }
+  g_consoleEnabled = enabled;
+  if (enabled) {
+    deep_sleep_lock();
+  } else {
+    deep_sleep_unlock();
+  }
+}
+
+// Characters arriving on the UART, with the receive interrupt.
+static void console_type(const std::string &text) {
+  g_consoleTyped += text.size();
+  if (!g_consoleEnabled) {
+    g_consoleLost += text.size();
+    return;
+  }
+  g_consoleInput.insert(g_consoleInput.end(), text.begin(), text.end());
+  if (g_consoleSigio) {
+    IsrScope isr;
+    g_consoleSigio();
+  }
+}
+
+//------------------Scene------------------------------------------------------
+
+static int g_failures = 0;
+static std::string g_sceneName;
+static std::function<bool()> g_atEnd;
+
+void at_end(std::function<bool()> check) { g_atEnd = std::move(check); }
+
+static void expect(const std::string &what, bool ok, const std::string &got) {
+  if (!ok) {
+    g_failures++;
+    fprintf(stderr, "sim: FAIL at %.3f s: expected %s, got %s\n", g_now / 1e9,
+            what.c_str(), got.c_str());
+  }
+}
+
+static std::string rtrim(std::string s) {
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\r')) {
+    s.pop_back();
+  }
+  return s;
+}
+
+bool load_scene(const char *path) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "sim: cannot open scene %s\n", path);
+    return false;
+  }
+  return load_scene(in, path);
+}
+
+bool load_scene(std::istream &in, const char *path) {
+  g_sceneName = path;
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    line = rtrim(line);
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) {
+      line = rtrim(line.substr(0, hash));
+    }
+    std::istringstream ss(line);
+    double ms;
+    std::string cmd;
+    if (!(ss >> ms >> cmd)) {
+      continue;
+    }
+    uint64_t at = (uint64_t)(ms * MS);
+    if (cmd == "dist") {
+      std::string value;
+      unsigned sensor = 0;
+      ss >> value >> sensor;
+      double cm = value == "none" ? -1.0 : atof(value.c_str());
+      schedule(at, [sensor, cm] {
+        if (sensor < sonars().size()) {
+          sonars()[sensor].cm = cm;
+        }
+        if (sensor < tofs().size()) {
+          tofs()[sensor].cm = cm;
+        }
+        g_lastStimulus = g_now;
+      });
+    } else if (cmd == "spike") {
+      double cm = 0;
+      unsigned sensor = 0;
+      ss >> cm >> sensor;
+      schedule(at, [sensor, cm] {
+        if (sensor < sonars().size()) {
+          sonars()[sensor].spike = cm;
+        }
+        if (sensor < tofs().size()) {
+          tofs()[sensor].spike = cm;
+        }
+      });
+    } else if (cmd == "press") {
+      double holdMs = 50;
+      ss >> holdMs;
+      schedule(at, [] { pin_drive(BUTTON, 1); });
+      schedule(at + (uint64_t)(holdMs * MS), [] { pin_drive(BUTTON, 0); });
+    } else if (cmd == "turn") {
+      int detents = 0;
+      double detentMs = 20;
+      ss >> detents >> detentMs;
+      encoder_turn(at, detents, (uint64_t)(detentMs * MS));
+    } else if (cmd == "reset") {
+      // Takes effect from the start, whatever the time.
+      std::string reason;
+      ss >> reason;
+      if (reason == "power") {
+        g_resetReason = RESET_REASON_POWER_ON;
+      } else if (reason == "pin") {
+        g_resetReason = RESET_REASON_PIN_RESET;
+      } else if (reason == "watchdog") {
+        g_resetReason = RESET_REASON_WATCHDOG;
+      } else if (reason == "software") {
+        g_resetReason = RESET_REASON_SOFTWARE;
+      } else {
+        fprintf(stderr, "%s:%d: unknown reset reason '%s'\n", path, lineNo,
+                reason.c_str());
+        return false;
+      }
+      bool powerLost = g_resetReason == RESET_REASON_POWER_ON ||
+                       g_resetReason == RESET_REASON_PIN_RESET;
+      g_lcd.reset(powerLost);
+      tof_reset(powerLost);
+    } else if (cmd == "key") {
+      std::string text;
+      ss >> text;
+      schedule(at, [text] { console_type(text); });
+    } else if (cmd == "expect") {
+      std::string what;
+      ss >> what;
+      if (what == "buzzer") {
+        std::string state;
+        ss >> state;
+        bool want = state == "on";
+        schedule(at, [want, state] {
+          expect("buzzer " + state, g_buzzer == want, g_buzzer ? "on" : "off");
+        });
+      } else if (what == "beep") {
+        std::string pattern;
+        ss >> pattern;
+        schedule(at, [pattern] {
+          expect("beep " + pattern, beep() == pattern, beep());
+        });
+      } else if (what == "deepsleep") {
+        double percent = 0;
+        ss >> percent;
+        schedule(at, [percent] {
+          double share = g_now > 0 ? 100.0 * g_deepSleepNs / g_now : 0.0;
+          char got[32];
+          snprintf(got, sizeof(got), "%.1f%%", share);
+          expect("deep sleep at least " + std::to_string((int)percent) + "%",
+                 share >= percent, got);
+        });
+      } else if (what == "lcd") {
+        int row = 0;
+        ss >> row;
+        std::string text;
+        std::getline(ss, text);
+        text = text.empty() ? text : text.substr(1);
+        schedule(at, [row, text] {
+          std::string got = rtrim(g_lcd.row(row));
+          expect("lcd row " + std::to_string(row) + " \"" + text + "\"",
+                 got == rtrim(text), "\"" + got + "\"");
+        });
+      } else {
+        fprintf(stderr, "%s:%d: unknown expectation '%s'\n", path, lineNo,
+                what.c_str());
+        return false;
+      }
+    } else if (cmd == "end") {
+      g_end = at;
+    } else {
+      fprintf(stderr, "%s:%d: unknown command '%s'\n", path, lineNo,
+              cmd.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+//------------------Report-----------------------------------------------------
+
+static std::chrono::steady_clock::time_point g_hostStart;
+
+static void report() {
+  double hostS = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - g_hostStart)
+                     .count();
+  double simS = g_now / 1e9;
+  if (g_buzzer) {
+    g_buzzerOnNs += g_now - g_buzzerSince;
+    g_buzzerSince = g_now;
+  }
+  fprintf(stderr, "== %s ==\n", g_sceneName.c_str());
+  fprintf(stderr, "time:     %.3f s simulated in %.3f s (%.0fx real time)\n",
+          simS, hostS, hostS > 0 ? simS / hostS : 0.0);
+  fprintf(stderr,
+          "cpu:      busy %.1f ms, sleep %.1f ms, deep sleep %.1f ms, %llu "
+          "wakeups\n",
+          g_busyNs / 1e6, g_sleepNs / 1e6, g_deepSleepNs / 1e6,
+          (unsigned long long)g_wakeups);
+  fprintf(stderr,
+          "i2c:      %llu transactions, %llu bytes, bus busy %.1f ms\n",
+          (unsigned long long)g_i2cTransactions,
+          (unsigned long long)g_i2cBytes, g_i2cBusNs / 1e6);
+  fprintf(stderr,
+          "lcd:      %llu instructions, %llu data writes, %llu timing "
+          "violations\n",
+          (unsigned long long)g_lcd.instructions,
+          (unsigned long long)g_lcd.dataWrites,
+          (unsigned long long)g_lcd.violations);
+  fprintf(stderr, "          |%s|\n          |%s|\n", g_lcd.row(0).c_str(),
+          g_lcd.row(1).c_str());
+  for (size_t i = 0; i < sonars().size(); i++) {
+    const Sonar &s = sonars()[i];
+    fprintf(stderr, "%s %zu:  %llu pings, %llu crosstalk\n",
+            i == 0 ? "sonar" : "     ", i, (unsigned long long)s.pings,
+            (unsigned long long)s.crosstalk);
+  }
+  for (size_t i = 0; i < tofs().size(); i++) {
+    fprintf(stderr, "%s %zu:    %llu rangings\n", i == 0 ? "tof" : "   ", i,
+            (unsigned long long)tofs()[i].rangings);
+  }
+  fprintf(stderr, "buzzer:   %d edges, on for %.1f ms, %d PWM writes\n",
+          g_buzzerEdges, g_buzzerOnNs / 1e6, g_buzzerWrites);
+  for (const Reaction &r : g_reactions) {
+    fprintf(stderr, "          %.3f s: %s after %.1f ms\n", r.cause / 1e9,
+            r.on ? "on " : "off", (r.effect - r.cause) / 1e6);
+  }
+  for (const auto &entry : g_uarts) {
+    fprintf(stderr, "uart:     %zu bytes at %d baud, line busy %.1f ms\n",
+            entry.second.sent.size(), entry.second.baud,
+            entry.second.busyNs / 1e6);
+  }
+  if (g_flash.open) {
+    fprintf(stderr,
+            "flash:    %llu reads, %llu double word programs, %llu page "
+            "erases, %llu violations\n",
+            (unsigned long long)g_flash.reads,
+            (unsigned long long)g_flash.programs,
+            (unsigned long long)g_flash.erases,
+            (unsigned long long)g_flash.violations);
+  }
+  fprintf(stderr, "console:  %llu characters typed, %llu lost with input off\n",
+          (unsigned long long)g_consoleTyped,
+          (unsigned long long)g_consoleLost);
+  fprintf(stderr, "watchdog: %llu kicks, longest gap %.1f ms\n",
+          (unsigned long long)g_kicks, g_maxKickGap / 1e6);
+  if (g_failures > 0) {
+    fprintf(stderr, "result:   %d expectation(s) failed\n", g_failures);
+  }
+}
+
+static void finish(int code) {
+  if (code == 0 && g_atEnd && !g_atEnd()) {
+    g_failures++;
+    fprintf(stderr, "sim: FAIL at %.3f s: end of run check\n", g_now / 1e9);
+  }
+  fflush(stdout);
+  uart_save();
+  flash_save();
+  report();
+  fflush(stderr);
+  std::_Exit(code != 0 ? code : (g_failures > 0 ? 1 : 0));
+}
+
+void run(std::function<void()> app) {
+  g_hostStart = std::chrono::steady_clock::now();
+  // The console's receiver is on from reset.
+  deep_sleep_lock();
+  Task *task = thread_start(std::move(app), osPriorityNormal, "main");
+  g_ready.clear();
+  handoff(nullptr, task);
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::hours(1));
+  }
+}
+
+} // namespace sim
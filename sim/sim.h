@@ -0,0 +1,156 @@
+/**
+ * Virtual clock, scheduler and device models behind the host stand-in
+ * mbed.h. Application code never includes this directly.
+ */
+
+#ifndef SIM_SIM_H
+#define SIM_SIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <istream>
+
+namespace mbed {
+class InterruptIn;
+template <typename F> class Callback;
+} // namespace mbed
+
+namespace sim {
+
+struct Task;
+
+// Anything a thread can block on: a mutex, semaphore or set of event flags.
+struct WaitState {
+  int32_t count = 0;
+  uint32_t flags = 0;
+  Task *owner = nullptr;
+  std::deque<Task *> waiters;
+};
+
+// Pending work of an EventQueue and the thread dispatching it, if any.
+struct QueueState {
+  std::deque<std::function<void()>> events;
+  Task *dispatcher = nullptr;
+};
+
+//------------------Running--------------------------------------------------
+
+// Load a scene file; see README.md for the format.
+bool load_scene(const char *path);
+
+// Load a scene from a stream, such as a string a program builds; path is
+// the name errors and the report give it.
+bool load_scene(std::istream &in, const char *path);
+
+// Run `app` as the main thread until the scene ends. Does not return.
+[[noreturn]] void run(std::function<void()> app);
+
+// Call check when the scene ends, before the report. If it returns false,
+// the run fails as if an expectation had.
+void at_end(std::function<bool()> check);
+
+//------------------Clock and scheduling---------------------------------------
+
+uint64_t now_ns();
+
+// Time the DWT cycle counter counts. It is the virtual clock, so code that
+// never blocks takes no time, unless host_cycles() is on: then the host CPU
+// time the process has used since is added, so that code takes as long as
+// it takes the host.
+uint64_t cycle_ns();
+void host_cycles(bool on);
+uint64_t schedule(uint64_t at_ns, std::function<void()> func);
+void cancel(uint64_t id);
+
+void busy_wait_ns(uint64_t ns);
+void sleep_ns(uint64_t ns);
+void yield();
+
+Task *thread_start(std::function<void()> func, int priority, const char *name);
+void thread_set_priority(Task *task, int priority);
+
+void mutex_lock(WaitState *state);
+bool mutex_trylock(WaitState *state);
+void mutex_unlock(WaitState *state);
+bool sem_acquire(WaitState *state, uint64_t timeout_ns);
+void sem_release(WaitState *state);
+uint32_t flags_set(WaitState *state, uint32_t flags);
+uint32_t flags_wait(WaitState *state, uint32_t flags, bool all, uint32_t ms,
+                    bool clear);
+void queue_post(QueueState *state, std::function<void()> func);
+void queue_dispatch(QueueState *state);
+
+// Marks code that runs in interrupt context, where blocking is an error.
+struct IsrScope {
+  IsrScope();
+  ~IsrScope();
+};
+
+void deep_sleep_lock();
+void deep_sleep_unlock();
+bool deep_sleep_allowed();
+// Nanoseconds the core has spent busy, asleep and in deep sleep.
+void cpu_time(uint64_t *busy_ns, uint64_t *sleep_ns, uint64_t *deep_sleep_ns);
+
+//------------------Devices----------------------------------------------------
+
+int pin_read(int pin);
+void pin_write(int pin, int value);
+// Change a pin's level without running any interrupt handlers.
+void pin_set(int pin, int value);
+void pin_listen(int pin, mbed::InterruptIn *in);
+void pin_unlisten(int pin, mbed::InterruptIn *in);
+// The most recently constructed InterruptIn on a pin, or nullptr.
+mbed::InterruptIn *pin_listener(int pin);
+
+// Interrupt vectors set through NVIC_SetVector().
+void irq_set_vector(int irq, void (*vector)());
+void irq_enable(int irq, bool enabled);
+
+void pwm_update(int pin, bool running, float period, float duty);
+
+// Send a byte on a UART, waiting while its transmit register is full.
+void uart_put(int tx, int baud, uint8_t byte);
+// Call func in interrupt context whenever the transmit register is empty.
+void uart_tx_irq(int tx, int baud, std::function<void()> func);
+// Write every byte sent on any UART to path when the run ends.
+void uart_capture(const char *path);
+
+// Transactions on the I2C bus whose SDA pin is sda. Each bus is busy on its
+// own, so a transfer only waits for others on the same bus.
+int i2c_write(int sda, int hz, int address, const char *data, int length,
+              bool repeated);
+int i2c_read(int sda, int hz, int address, char *data, int length,
+             bool repeated);
+void i2c_stop(int hz);
+int i2c_transfer(int sda, int hz, int address, const char *tx, int tx_length,
+                 char *rx, int rx_length,
+                 const std::function<void(int)> &callback, int event,
+                 bool repeated);
+
+// Internal flash behind FlashIAPBlockDevice: one region, erased to 0xFF
+// and kept in the file given to flash_image() from one run to the next.
+// Programs and erases busy wait as long as the real flash takes.
+void flash_image(const char *path);
+void flash_open(uint32_t address, uint32_t size);
+bool flash_read(uint32_t address, void *data, size_t size);
+bool flash_program(uint32_t address, const void *data, size_t size);
+bool flash_erase(uint32_t address, size_t size);
+
+void watchdog_kick(uint32_t timeout_ms);
+// Why the board last reset, a reset_reason_t.
+int reset_reason();
+
+// Console input typed by the scene, and the handler told when it arrives.
+int console_read(char *data, size_t size);
+bool console_readable();
+void console_sigio(std::function<void()> func);
+// Turn the console's receiver on or off. While it is on it holds a deep sleep
+// lock, and while it is off typed characters are lost.
+void console_enable(bool enabled);
+
+} // namespace sim
+
+#endif /* SIM_SIM_H */
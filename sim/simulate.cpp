@@ -0,0 +1,32 @@
+/**
+ * Runs the unmodified firmware in the simulator. main.cpp is compiled with
+ * main renamed to app_main, which becomes the simulated main thread.
+ *
+ * The application's console output goes to stdout, the simulator's report to
+ * stderr, and the bytes sent on the telemetry UART to the optional second
+ * argument. The optional third argument is a file holding the internal
+ * flash, read at startup and written back at the end, so settings saved in
+ * one run are there in the next.
+ */
+
+#include "mbed.h"
+
+int app_main();
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "usage: %s <scene> [telemetry output [flash image]]\n",
+            argv[0]);
+    return 2;
+  }
+  if (argc >= 3) {
+    sim::uart_capture(argv[2]);
+  }
+  if (argc == 4) {
+    sim::flash_image(argv[3]);
+  }
+  if (!sim::load_scene(argv[1])) {
+    return 2;
+  }
+  sim::run([] { app_main(); });
+}
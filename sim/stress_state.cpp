@@ -0,0 +1,160 @@
+/**
+ * Host stress test for SeqLock and SystemState.
+ *
+ * One writer thread publishes Config snapshots through a SeqLock as fast as
+ * it can, every field derived from one counter, so a snapshot mixing two
+ * writes shows up as fields that disagree. Two reader threads hammer read()
+ * and tryRead() and check every copy they get. Meanwhile two threads toggle
+ * the SystemState menu mode, standing in for the button interrupt and the
+ * main loop, a third claims redraw requests, and the readers check that the
+ * state word only ever moves forward.
+ *
+ * On a multi-core host the threads really run in parallel, unlike the
+ * firmware's, which makes it a harder test of the memory ordering than the
+ * board gives; on a single core it only sees the overlaps preemption makes.
+ * The tryRead() misses it prints tell how many overlaps a run saw. The run
+ * fails on any torn snapshot or invalid state word.
+ */
+
+#include "SeqLock.h"
+#include "SystemState.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+static const unsigned READS = 8000000;
+static const unsigned TOGGLES = 200000;
+static const int READERS = 2;
+static const int TOGGLERS = 2;
+
+// The snapshot for counter n.
+static Config snapshot(uint32_t n) {
+  Config c;
+  c.minDistance = (int32_t)n;
+  c.interval = (int32_t)(n * 2654435761u);
+  c.mode = (n >> 3) & 1 ? MODE_SETTINGS : MODE_DEFAULT;
+  return c;
+}
+
+static bool valid(const Config &c) {
+  Config expect = snapshot((uint32_t)c.minDistance);
+  return c.interval == expect.interval && c.mode == expect.mode;
+}
+
+static SeqLock<Config> config;
+static SystemState state;
+static std::atomic<bool> done(false);
+static std::atomic<unsigned> failures(0);
+
+static void fail(const char *what, unsigned long a, unsigned long b) {
+  if (failures.fetch_add(1) < 10) {
+    fprintf(stderr, "stress_state: FAIL: %s (%lu, %lu)\n", what, a, b);
+  }
+}
+
+static void writer(unsigned *writes) {
+  uint32_t n = 0;
+  while (!done.load(std::memory_order_relaxed)) {
+    config.write(snapshot(++n));
+  }
+  *writes = n;
+}
+
+static void reader(int id, unsigned *retries) {
+  uint32_t last = 0;
+  unsigned lastPresses = 0;
+  unsigned missed = 0;
+  for (unsigned i = 0; i < READS; i++) {
+    Config c;
+    // Alternate between the spinning and the single-shot read.
+    if (i & 1) {
+      c = config.read();
+    } else if (!config.tryRead(c)) {
+      missed++;
+      continue;
+    }
+    if (!valid(c)) {
+      fail("torn snapshot", (unsigned long)c.minDistance,
+           (unsigned long)(uint32_t)c.interval);
+    }
+    if ((uint32_t)c.minDistance < last) {
+      fail("snapshot went back", last, (unsigned long)c.minDistance);
+    }
+    last = (uint32_t)c.minDistance;
+
+    int mode = state.mode();
+    if (mode != MODE_DEFAULT && mode != MODE_SETTINGS) {
+      fail("invalid mode", (unsigned long)id, (unsigned long)mode);
+    }
+    unsigned presses = state.presses();
+    if (presses < lastPresses || presses > TOGGLES * TOGGLERS) {
+      fail("invalid press count", lastPresses, presses);
+    }
+    lastPresses = presses;
+  }
+  *retries = missed;
+}
+
+static void toggler() {
+  for (unsigned i = 0; i < TOGGLES; i++) {
+    state.toggleMode();
+    if (i % 16 == 0) {
+      state.requestRedraw();
+    }
+  }
+}
+
+static void redrawer(unsigned *taken) {
+  unsigned n = 0;
+  while (!done.load(std::memory_order_relaxed)) {
+    n += state.takeRedraw();
+  }
+  *taken = n;
+}
+
+int main() {
+  unsigned writes = 0, taken = 0;
+  unsigned retries[READERS] = {};
+
+  std::thread write(writer, &writes);
+  std::thread redraw(redrawer, &taken);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < READERS; i++) {
+    threads.emplace_back(reader, i, &retries[i]);
+  }
+  for (int i = 0; i < TOGGLERS; i++) {
+    threads.emplace_back(toggler);
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  done = true;
+  write.join();
+  redraw.join();
+
+  // Every press counted once, and an even number of them leaves the mode
+  // where it started.
+  unsigned presses = state.presses();
+  if (presses != TOGGLES * TOGGLERS) {
+    fail("press count", TOGGLES * TOGGLERS, presses);
+  }
+  if (state.mode() != MODE_DEFAULT) {
+    fail("final mode", MODE_DEFAULT, (unsigned long)state.mode());
+  }
+  if (config.version() != writes || !valid(config.read()) ||
+      (uint32_t)config.read().minDistance != writes) {
+    fail("final snapshot", writes, config.version());
+  }
+
+  unsigned missed = 0;
+  for (int i = 0; i < READERS; i++) {
+    missed += retries[i];
+  }
+  printf("stress_state: %u reads, %u tryRead() misses, %u writes, %u "
+         "presses, %u redraws, %u failures\n",
+         READS * READERS, missed, writes, presses, taken + state.takeRedraw(),
+         failures.load());
+  return failures.load() == 0 ? 0 : 1;
+}
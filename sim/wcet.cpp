@@ -0,0 +1,36 @@
+/**
+ * Worst-case execution time harness for the main loop. Runs the unmodified
+ * firmware like simulate, on a scene that should drive every path of the
+ * loop, with the cycle counter counting host CPU time on top of the virtual
+ * clock, so the loop's own code takes time and not only the waits modelled
+ * on the devices.
+ *
+ * When the scene ends, the loop's Wcet report goes to stdout, after the
+ * firmware's console output, and the run fails if a path never ran or a pass
+ * was over the budget. The laps are host CPU time scaled to 120 MHz cycles,
+ * not Cortex-M4 cycles: the host is faster, so the on-target report, typed
+ * "w" on the console, is the one to hold to the budget.
+ */
+
+#include "Wcet.h"
+#include "mbed.h"
+
+int app_main();
+
+extern Wcet wcet;
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <scene>\n", argv[0]);
+    return 2;
+  }
+  if (!sim::load_scene(argv[1])) {
+    return 2;
+  }
+  sim::host_cycles(true);
+  sim::at_end([] {
+    wcet.report();
+    return wcet.ok();
+  });
+  sim::run([] { app_main(); });
+}
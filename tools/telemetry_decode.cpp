@@ -0,0 +1,182 @@
+/**
+ * Host decoder for the firmware's binary telemetry stream.
+ *
+ * Reads the raw bytes from the telemetry UART, from a file or standard input,
+ * and writes one CSV row per frame to standard output:
+ *
+ *   seq,time_ms,type,sensor,echo_us,distance_cm,threshold_cm,alarm,
+ *   interval_ms,mode
+ *
+ * Fields a frame type does not carry are left empty. Frames that fail the
+ * CRC are skipped, and so are delta frames until the next key frame after a
+ * gap in the sequence numbers. A summary goes to standard error.
+ *
+ * Build and run, for example on Linux:
+ *
+ *   g++ -O2 -I.. -o telemetry_decode telemetry_decode.cpp
+ *   stty -F /dev/ttyACM0 115200 raw
+ *   ./telemetry_decode /dev/ttyACM0 > telemetry.csv
+ *
+ * The simulator's make run decodes every scene's stream this way too.
+ */
+
+#include "TelemetryFormat.h"
+
+#include <cstdio>
+#include <vector>
+
+// What the stream has told us so far, as the base for delta frames.
+struct Decoder {
+  bool haveTime = false;
+  uint32_t ms = 0;
+  bool haveThreshold = false;
+  int32_t threshold = 0;
+  bool haveSensor[TLM_MAX_SENSORS] = {};
+  int32_t echo[TLM_MAX_SENSORS] = {};
+  int32_t cm[TLM_MAX_SENSORS] = {};
+
+  bool haveSeq = false;
+  uint8_t seq = 0;
+
+  unsigned long frames = 0;
+  unsigned long corrupt = 0;
+  unsigned long lost = 0;
+  unsigned long skipped = 0;
+
+  // Forget every base after frames were lost.
+  void resync() {
+    haveTime = false;
+    haveThreshold = false;
+    for (bool &have : haveSensor) {
+      have = false;
+    }
+  }
+
+  void frame(const uint8_t *data, int length);
+};
+
+void Decoder::frame(const uint8_t *data, int length) {
+  if (length < 4 ||
+      tlmCrc16(data, length - 2) !=
+          (uint16_t)(data[length - 2] << 8 | data[length - 1])) {
+    corrupt++;
+    resync();
+    return;
+  }
+  const uint8_t *p = data + 2;
+  const uint8_t *end = data + length - 2;
+
+  uint8_t header = data[0];
+  uint8_t seq = data[1];
+  if (haveSeq && seq != (uint8_t)(this->seq + 1)) {
+    lost += (uint8_t)(seq - this->seq - 1);
+    resync();
+  }
+  haveSeq = true;
+  this->seq = seq;
+
+  bool key = header & TLM_KEY;
+  int type = header & TLM_TYPE_MASK;
+  int sensor = header >> TLM_SENSOR_SHIFT;
+
+  // Key and config frames carry four varints after the header, other sample
+  // frames three.
+  uint32_t v[4];
+  int fields = key || type == TLM_TYPE_CONFIG ? 4 : 3;
+  for (int i = 0; i < fields; i++) {
+    int n = tlmGetVarint(p, end, v[i]);
+    if (n == 0) {
+      corrupt++;
+      resync();
+      return;
+    }
+    p += n;
+  }
+
+  if (type == TLM_TYPE_CONFIG) {
+    ms = v[0];
+    threshold = tlmUnzigzag(v[1]);
+    haveTime = haveThreshold = true;
+    printf("%u,%lu,config,,,,%d,,%lu,%lu\n", seq, (unsigned long)ms,
+           (int)threshold, (unsigned long)v[2], (unsigned long)v[3]);
+    frames++;
+    return;
+  }
+  if (type != TLM_TYPE_SAMPLE) {
+    skipped++;
+    return;
+  }
+
+  if (key) {
+    ms = v[0];
+    echo[sensor] = tlmUnzigzag(v[1]);
+    cm[sensor] = tlmUnzigzag(v[2]);
+    threshold = tlmUnzigzag(v[3]);
+    haveTime = haveThreshold = haveSensor[sensor] = true;
+  } else if (haveTime && haveThreshold && haveSensor[sensor]) {
+    ms += v[0];
+    echo[sensor] += tlmUnzigzag(v[1]);
+    cm[sensor] += tlmUnzigzag(v[2]);
+  } else {
+    skipped++;
+    return;
+  }
+
+  printf("%u,%lu,sample,%d,%d,%d,%d,%d,,\n", seq, (unsigned long)ms, sensor,
+         (int)echo[sensor], (int)cm[sensor], (int)threshold,
+         (header & TLM_ALARM) ? 1 : 0);
+  frames++;
+}
+
+int main(int argc, char **argv) {
+  FILE *in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+  if (in == NULL) {
+    perror(argv[1]);
+    return 2;
+  }
+
+  printf("seq,time_ms,type,sensor,echo_us,distance_cm,threshold_cm,alarm,"
+         "interval_ms,mode\n");
+
+  Decoder decoder;
+  std::vector<uint8_t> encoded;
+  unsigned long bytes = 0;
+
+  // Whatever comes before the first delimiter may be part of a frame.
+  bool synced = false;
+
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    bytes++;
+    if (c != 0) {
+      encoded.push_back((uint8_t)c);
+      continue;
+    }
+    if (synced && !encoded.empty()) {
+      if (encoded.size() > TLM_MAX_ENCODED) {
+        decoder.corrupt++;
+        decoder.resync();
+      } else {
+        uint8_t frame[TLM_MAX_ENCODED];
+        int length = tlmCobsDecode(encoded.data(), encoded.size(), frame);
+        if (length < 0) {
+          decoder.corrupt++;
+          decoder.resync();
+        } else {
+          decoder.frame(frame, length);
+        }
+      }
+    }
+    encoded.clear();
+    synced = true;
+    fflush(stdout);
+  }
+
+  fprintf(stderr,
+          "telemetry: %lu bytes, %lu frames, %lu corrupt, %lu lost, "
+          "%lu skipped, %.1f bytes per frame\n",
+          bytes, decoder.frames, decoder.corrupt, decoder.lost,
+          decoder.skipped,
+          decoder.frames > 0 ? (double)bytes / decoder.frames : 0.0);
+  return 0;
+}